@@ -0,0 +1,607 @@
+// Benchmark suite for the evaluation pipeline: tokenizer, parser, tree and
+// compiled evaluation in double and single precision, Chebyshev surrogates
+// of the expressions, a full run over the sample grid and its statistics,
+// plot rasterization, several functions plotted together, curve sampling,
+// root and extremum finding, integration and the export formats, each over
+// a fixed expression corpus. The fast math functions are timed against
+// libm, and their errors against it are reported after the timings.
+//
+//   calculator_bench [--samples N] [--repetitions N] [--warmup N]
+//                    [--filter TEXT] [--json FILE] [--label TEXT]
+
+#include "analysis_parameters.hpp"
+#include "binary_export.hpp"
+#include "chebyshev_surrogate.hpp"
+#include "curve_sampler.hpp"
+#include "export_writer.hpp"
+#include "fast_math.hpp"
+#include "feature_finder.hpp"
+#include "graph_raster.hpp"
+#include "harness.hpp"
+#include "hoisted_expression.hpp"
+#include "parser.hpp"
+#include "quadrature.hpp"
+#include "sample_grid.hpp"
+#include "sample_series.hpp"
+#include "sample_stats.hpp"
+#include "surface_grid.hpp"
+#include "tokenizer.hpp"
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <numbers>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+// Nests fn around x depth times, e.g. sin(sin(x))
+std::string nested(const std::string &fn, int depth) {
+    std::string expression = "x";
+    for (int i = 0; i < depth; ++i) {
+        expression = fn + "(" + expression + ")";
+    }
+    return expression;
+}
+
+// A sum of terms, each a small product
+std::string long_sum(int terms) {
+    std::string expression;
+    for (int i = 1; i <= terms; ++i) {
+        expression += (i > 1 ? " + " : "") + std::to_string(i % 9 + 1) +
+                      "*x^" + std::to_string(i % 4 + 1);
+    }
+    return expression;
+}
+
+// From the default expression up to deeply nested ones; all of them are
+// accepted by the expression validator
+std::vector<std::string> corpus() {
+    return {
+        "sin(x)",
+        "x^2 - 4*x + 4",
+        "(x^3 - 2*x) / (x^2 + 3)",
+        "sin(x)*cos(x/3) + sqrt(x^2 + 1)",
+        "ln(x^2 + 1) / (1 + x^2) + arctan(x) * e^(0 - x^2 / 1000)",
+        nested("sin", 16),
+        "sqrt(" + nested("cos", 8) + " + 2) * " + nested("arctan", 8),
+        long_sum(64),
+    };
+}
+
+// Functions plotted together, with subterms in common
+std::vector<std::string> function_set() {
+    return {
+        "sin(x)*cos(x/3) + sqrt(x^2 + 1)",
+        "sin(x)*cos(x/3) - sqrt(x^2 + 1)",
+        "sin(x)*cos(x/3) * e^(0 - x^2 / 1000)",
+        "sqrt(x^2 + 1) / (1 + x^2)",
+    };
+}
+
+struct Settings {
+        BenchOptions options;
+        int samples = AnalysisParameters::MAX_SAMPLES;
+        std::string json_path;
+        std::string label;
+};
+
+// A whole-string integer of at least minimum, like parse_int in batch_cli
+int parse_int(const std::string &option, const std::string &value,
+              int minimum) {
+    size_t pos = 0;
+    int result = 0;
+    try {
+        result = std::stoi(value, &pos);
+    } catch (const std::exception &) {
+        pos = 0; // Not a number or out of range
+    }
+    if (pos == 0 || pos != value.length() || result < minimum) {
+        throw std::invalid_argument("Invalid value '" + value + "' for " +
+                                    option + ".");
+    }
+    return result;
+}
+
+void usage() {
+    std::cerr << "Usage: calculator_bench [--samples N] [--repetitions N] "
+                 "[--warmup N]\n"
+                 "                        [--filter TEXT] [--json FILE] "
+                 "[--label TEXT]\n";
+}
+
+void bench_expression(BenchRunner &runner, const std::string &expression,
+                      int samples) {
+    AnalysisParameters params(-100, 100, samples);
+    params.set_expression(expression);
+    SampleGrid grid(params.get_start(), params.get_end(), samples);
+
+    Tokenizer tokenizer;
+    std::vector<std::string> tokens = tokenizer.tokenize(expression);
+    runner.run("tokenize", expression, tokens.size(), [&] {
+        do_not_optimize(tokenizer.tokenize(expression));
+    });
+    runner.run("parse", expression, tokens.size(), [&] {
+        Parser parser(tokens, params);
+        do_not_optimize(parser.parse());
+    });
+    runner.run("compile", expression, tokens.size(), [&] {
+        Parser parser(tokens, params);
+        do_not_optimize(CompiledExpression(*parser.parse()).size());
+    });
+
+    runner.run("evaluate_tree", expression, grid.size(), [&] {
+        double sum = 0.0;
+        for (size_t i = 0; i < grid.size(); ++i) {
+            sum += params.evaluate_expression(grid.x_at(i));
+        }
+        do_not_optimize(sum);
+    });
+    std::vector<double> xs(grid.size()), ys(grid.size());
+    for (size_t i = 0; i < grid.size(); ++i) {
+        xs[i] = grid.x_at(i);
+    }
+    runner.run("evaluate_batch", expression, grid.size(), [&] {
+        params.evaluate_batch(xs.data(), ys.data(), xs.size());
+        do_not_optimize(ys[0]);
+    });
+    // The same in single precision, as the graph's float32 mode runs it
+    std::vector<float> xs32(xs.begin(), xs.end()), ys32(grid.size());
+    const CompiledExpression &compiled = params.get_compiled_expression();
+    runner.run("evaluate_batch_f32", expression, grid.size(), [&] {
+        compiled.evaluate(xs32.data(), ys32.data(), xs32.size());
+        do_not_optimize(ys32[0]);
+    });
+    // Both again with the fast math functions, as graphs are evaluated
+    runner.run("evaluate_batch_fast", expression, grid.size(), [&] {
+        compiled.evaluate(xs.data(), ys.data(), xs.size(), MathTier::Fast);
+        do_not_optimize(ys[0]);
+    });
+    runner.run("evaluate_f32_fast", expression, grid.size(), [&] {
+        compiled.evaluate(xs32.data(), ys32.data(), xs32.size(),
+                          MathTier::Fast);
+        do_not_optimize(ys32[0]);
+    });
+    // The Chebyshev fit the graph's surrogate mode makes once, speed probe
+    // included, and sampling it in place of the expression
+    ChebyshevSurrogate surrogate(
+        [&](const double *x, double *y, size_t count) {
+            compiled.evaluate(x, y, count);
+        });
+    size_t evaluations =
+        surrogate.fit(params.get_start(), params.get_end(), 1e-10).evaluations;
+    runner.run("surrogate_fit", expression, evaluations, [&] {
+        do_not_optimize(
+            surrogate.fit(params.get_start(), params.get_end(), 1e-10).pieces);
+    });
+    runner.run("surrogate_evaluate", expression, grid.size(), [&] {
+        surrogate.evaluate(xs.data(), ys.data(), xs.size());
+        do_not_optimize(ys[0]);
+    });
+    // f, f' and f'' together, against three times evaluate_batch for
+    // central differences
+    std::vector<double> dys(grid.size()), d2ys(grid.size());
+    runner.run("evaluate_derivatives", expression, grid.size(), [&] {
+        params.evaluate_derivatives(xs.data(), ys.data(), dys.data(),
+                                    d2ys.data(), xs.size());
+        do_not_optimize(d2ys[0]);
+    });
+
+    // What TUI::run_calculation does for a fresh grid
+    SampleSeries series;
+    runner.run("run_calculation", expression, grid.size(), [&] {
+        series.assign_uniform(grid.get_start(), grid.get_step(), grid.size());
+        for (size_t i = 0; i < grid.size(); ++i) {
+            xs[i] = series.x(i);
+        }
+        params.evaluate_batch(xs.data(), series.y_data(), xs.size());
+        do_not_optimize(series.y(0));
+    });
+    // What gathering the statistics adds to each evaluated batch
+    series.assign_uniform(grid.get_start(), grid.get_step(), grid.size());
+    params.evaluate_batch(xs.data(), series.y_data(), xs.size());
+    runner.run("sample_stats", expression, series.size(), [&] {
+        SampleStats stats;
+        stats.add(series.y_data(), series.size());
+        do_not_optimize(stats.fit_range().max);
+    });
+
+    // The plot area of a 200x60 terminal
+    runner.run("rasterize", expression, series.size(), [&] {
+        GraphRaster raster(187, 48, -100, 100, -5, 5);
+        raster.plot(series, '*');
+        do_not_optimize(raster.count_filled());
+    });
+}
+
+// The same functions evaluated one at a time and as one fused tape
+void bench_functions(BenchRunner &runner, int samples) {
+    std::vector<std::string> functions = function_set();
+    AnalysisParameters params(-100, 100, samples);
+    params.set_expression(functions[0]);
+    for (size_t f = 1; f < functions.size(); ++f) {
+        params.add_function(functions[f]);
+    }
+    std::vector<CompiledExpression> separate;
+    for (const std::string &function : functions) {
+        AnalysisParameters single(-100, 100, samples);
+        single.set_expression(function);
+        separate.push_back(single.get_compiled_expression());
+    }
+
+    SampleGrid grid(params.get_start(), params.get_end(), samples);
+    std::vector<double> xs(grid.size());
+    for (size_t i = 0; i < grid.size(); ++i) {
+        xs[i] = grid.x_at(i);
+    }
+    std::vector<std::vector<double>> ys(functions.size(),
+                                        std::vector<double>(xs.size()));
+    std::vector<double *> outputs;
+    for (std::vector<double> &y : ys) {
+        outputs.push_back(y.data());
+    }
+
+    const std::string label =
+        std::to_string(functions.size()) + " functions";
+    runner.run("evaluate_separate", label, grid.size(), [&] {
+        for (size_t f = 0; f < separate.size(); ++f) {
+            separate[f].evaluate(xs.data(), outputs[f], xs.size());
+        }
+        do_not_optimize(ys[0][0]);
+    });
+    runner.run("evaluate_fused", label, grid.size(), [&] {
+        params.evaluate_functions(xs.data(), outputs.data(), xs.size());
+        do_not_optimize(ys[0][0]);
+    });
+    runner.run("evaluate_fused_fast", label, grid.size(), [&] {
+        params.evaluate_functions(xs.data(), outputs.data(), xs.size(),
+                                  MathTier::Fast);
+        do_not_optimize(ys[0][0]);
+    });
+}
+
+// Arc-length sampling of the default curves, pilot pass included, and
+// drawing them as connected segments
+void bench_curves(BenchRunner &runner, int samples) {
+    AnalysisParameters params(-100, 100, samples);
+    CurveSampler sampler(
+        [&](const double *t, double *x, double *y, size_t count) {
+            params.evaluate_curve(t, x, y, count);
+        },
+        20, 10);
+    for (PlotMode mode : {PlotMode::Parametric, PlotMode::Polar}) {
+        params.set_plot_mode(mode);
+        const std::string name = mode == PlotMode::Parametric
+                                     ? "sample_parametric"
+                                     : "sample_polar";
+        SampleSeries curve;
+        runner.run(name, params.display_curve(), samples, [&] {
+            curve = sampler.sample(params.get_curve_start(),
+                                   params.get_curve_end(), samples);
+            do_not_optimize(curve.size());
+        });
+        runner.run("rasterize_lines", params.display_curve(), curve.size(),
+                   [&] {
+                       GraphRaster raster(187, 48, -10, 10, -5, 5);
+                       raster.plot_lines(curve, '*');
+                       do_not_optimize(raster.count_filled());
+                   });
+    }
+}
+
+// Tiled evaluation of the default surface over a terminal-sized grid and a
+// square grid of about the sample count
+void bench_surface(BenchRunner &runner, int samples) {
+    AnalysisParameters params(-100, 100, samples);
+    size_t side = static_cast<size_t>(std::sqrt(samples)) + 1;
+    SurfaceGrid terminal(187, 48, -10, 10, -5, 5);
+    SurfaceGrid square(side, side, -10, 10, -5, 5);
+    for (SurfaceGrid *grid : {&terminal, &square}) {
+        runner.run("evaluate_surface", params.display_surface(), grid->size(),
+                   [&] {
+                       grid->evaluate(params.get_compiled_surface());
+                       do_not_optimize(grid->at(0, 0));
+                   });
+    }
+}
+
+// One animation frame over a plot-width row, evaluating the whole
+// expression per column against the hoisted form
+void bench_animation(BenchRunner &runner) {
+    AnalysisParameters params(-100, 100, 1000);
+    params.set_animation("sin(x)*cos(x/3)+sqrt(x^2+1)*sin(t)-x*t/10");
+    const size_t columns = 187;
+    std::vector<double> xs(columns), ts(columns), ys(columns);
+    for (size_t i = 0; i < columns; ++i) {
+        xs[i] = -10 + 20.0 * i / columns;
+    }
+    HoistedExpression hoisted(params.get_compiled_animation());
+    hoisted.set_x(xs.data(), xs.size());
+    double t = 0.0;
+    runner.run("animation_frame", params.display_animation(), columns, [&] {
+        t += 0.01;
+        std::fill(ts.begin(), ts.end(), t);
+        params.get_compiled_animation().evaluate(xs.data(), ts.data(),
+                                                 ys.data(), columns);
+        do_not_optimize(ys[0]);
+    });
+    runner.run("animation_hoisted", params.display_animation(), columns,
+               [&] {
+                   t += 0.01;
+                   hoisted.evaluate(t, ys.data());
+                   do_not_optimize(ys[0]);
+               });
+}
+
+// Roots, extrema and one intersection from an evaluated grid; the items are
+// the samples scanned, the refinement evaluates only around candidates
+void bench_features(BenchRunner &runner, int samples) {
+    AnalysisParameters params(-100, 100, samples);
+    params.set_expression("sin(x)*cos(x/3) + x/20");
+    params.add_function("sqrt(x^2 + 1) / 10");
+    SampleGrid grid(params.get_start(), params.get_end(), samples);
+    SampleSeries f1(grid.get_start(), grid.get_step(), grid.size());
+    SampleSeries f2(grid.get_start(), grid.get_step(), grid.size());
+    std::vector<double> xs(grid.size());
+    for (size_t i = 0; i < grid.size(); ++i) {
+        xs[i] = grid.x_at(i);
+    }
+    double *const outputs[] = {f1.y_data(), f2.y_data()};
+    params.evaluate_functions(xs.data(), outputs, xs.size());
+
+    const CompiledExpression &first = params.get_compiled_function(0);
+    const CompiledExpression &second = params.get_compiled_function(1);
+    runner.run("find_features", params.display_expression(), f1.size(), [&] {
+        FeatureFinder finder(
+            f1, [&](double x) { return first.evaluate(x); },
+            [&](double x) {
+                double y, dy, d2y;
+                first.evaluate_derivatives(&x, &y, &dy, &d2y, 1);
+                return dy;
+            });
+        finder.find_roots();
+        finder.find_extrema();
+        finder.find_intersections(
+            f2, [&](double x) { return second.evaluate(x); }, 1);
+        do_not_optimize(finder.get_features().size());
+    });
+}
+
+// Adaptive quadrature over the domain; the items are the evaluations
+void bench_integral(BenchRunner &runner) {
+    for (const std::string &expression :
+         {std::string("sin(x)*cos(x/3) + sqrt(x^2 + 1)"),
+          std::string("e^(0 - x^2 / 1000) * cos(x)")}) {
+        AnalysisParameters params(-100, 100, 1000);
+        params.set_expression(expression);
+        Quadrature quadrature([&](const double *x, double *y, size_t count) {
+            params.evaluate_batch(x, y, count);
+        });
+        size_t evaluations =
+            quadrature.integrate(-100, 100, 1e-10).evaluations;
+        runner.run("integrate", expression, evaluations, [&] {
+            do_not_optimize(quadrature.integrate(-100, 100, 1e-10).value);
+        });
+    }
+}
+
+void bench_export(BenchRunner &runner, int samples) {
+    AnalysisParameters params(-100, 100, samples);
+    SampleGrid grid(params.get_start(), params.get_end(), samples);
+    SampleSeries series(grid.get_start(), grid.get_step(), grid.size());
+    std::vector<double> xs(grid.size());
+    for (size_t i = 0; i < grid.size(); ++i) {
+        xs[i] = series.x(i);
+    }
+    params.evaluate_batch(xs.data(), series.y_data(), xs.size());
+
+    const std::string expression = params.get_expression();
+    const std::filesystem::path directory =
+        std::filesystem::temp_directory_path();
+    TextExporter shortest(0), fixed(6);
+    runner.run("format_text", expression, series.size(), [&] {
+        do_not_optimize(shortest.format_blocks(series).size());
+    });
+    runner.run("format_text_p6", expression, series.size(), [&] {
+        do_not_optimize(fixed.format_blocks(series).size());
+    });
+    runner.run("export_text", expression, series.size(), [&] {
+        shortest.write(directory / "calculator_bench.txt", series);
+    });
+    runner.run("export_binary", expression, series.size(), [&] {
+        BinaryExporter::write(directory / "calculator_bench.bin", series,
+                              expression, params.get_variable(), false);
+    });
+    std::filesystem::remove(directory / "calculator_bench.txt");
+    std::filesystem::remove(directory / "calculator_bench.bin");
+}
+
+// A function of the fast math tier over the arguments a plot typically
+// gives it; b is the exponent of powers
+struct MathCase {
+        const char *name;
+        OpCode op;
+        std::string domain;
+        std::vector<double> a;
+        std::vector<double> b;
+};
+
+// Arguments drawn from a fixed seed so runs compare; logarithms and powers
+// get bases spread over many orders of magnitude
+std::vector<MathCase> math_cases(size_t count) {
+    std::mt19937_64 random(12345);
+    auto uniform = [&](double low, double high) {
+        std::uniform_real_distribution<double> distribution(low, high);
+        std::vector<double> values(count);
+        for (double &value : values) {
+            value = distribution(random);
+        }
+        return values;
+    };
+    auto spread = [&](double low_exponent, double high_exponent) {
+        std::vector<double> values = uniform(low_exponent, high_exponent);
+        for (double &value : values) {
+            value = std::pow(10.0, value);
+        }
+        return values;
+    };
+    // Within 1e-3 of the odd multiples of pi/2 in [-100, 100], where tan
+    // has its poles and cos its zeros
+    auto near_poles = [&] {
+        std::vector<double> values = spread(-16, -3);
+        std::vector<double> poles = uniform(-32, 32);
+        for (size_t i = 0; i < count; ++i) {
+            double offset = i % 2 ? values[i] : -values[i];
+            values[i] =
+                (std::floor(poles[i]) + 0.5) * std::numbers::pi + offset;
+        }
+        return values;
+    };
+    std::vector<double> none(count, 0.0);
+    return {
+        {"sin", OpCode::Sin, "[-100, 100]", uniform(-100, 100), none},
+        {"sin", OpCode::Sin, "[-5e5, 5e5]", uniform(-5e5, 5e5), none},
+        {"cos", OpCode::Cos, "[-100, 100]", uniform(-100, 100), none},
+        {"cos", OpCode::Cos, "(k + 1/2)pi +- 1e-3", near_poles(), none},
+        {"tan", OpCode::Tan, "[-100, 100]", uniform(-100, 100), none},
+        {"tan", OpCode::Tan, "(k + 1/2)pi +- 1e-3", near_poles(), none},
+        {"arcsin", OpCode::Arcsin, "[-1, 1]", uniform(-1, 1), none},
+        {"arccos", OpCode::Arccos, "[-1, 1]", uniform(-1, 1), none},
+        {"arctan", OpCode::Arctan, "[-1e3, 1e3]", uniform(-1e3, 1e3), none},
+        {"ln", OpCode::Ln, "[1e-300, 1e300]", spread(-300, 300), none},
+        {"log", OpCode::Log, "[1e-300, 1e300]", spread(-300, 300), none},
+        {"pow", OpCode::Power, "[1e-3, 1e3]^[-4.5, 4.5]", spread(-3, 3),
+         uniform(-4.5, 4.5)},
+        {"pow", OpCode::Power, "e^[-700, 700]",
+         std::vector<double>(count, std::exp(1.0)), uniform(-700, 700)},
+        {"pow", OpCode::Power, "[-100, 100]^2", uniform(-100, 100),
+         std::vector<double>(count, 2.0)},
+    };
+}
+
+// Each function on its own, libm against the fast tier
+void bench_fast_math(BenchRunner &runner, int samples) {
+    std::vector<double> out(samples);
+    for (const MathCase &c : math_cases(samples)) {
+        const std::string label = std::string(c.name) + " " + c.domain;
+        runner.run("math_exact", label, c.a.size(), [&] {
+            for (size_t i = 0; i < c.a.size(); ++i) {
+                out[i] = apply_operation(c.op, c.a[i], c.b[i]);
+            }
+            do_not_optimize(out[0]);
+        });
+        runner.run("math_fast", label, c.a.size(), [&] {
+            apply_fast_operation(c.op, c.a.data(), c.b.data(), out.data(),
+                                 c.a.size());
+            do_not_optimize(out[0]);
+        });
+    }
+}
+
+// Largest absolute and relative difference between the tiers per function,
+// with the argument where the relative one occurs
+void report_accuracy(std::ostream &out, size_t count) {
+    char line[256];
+    std::snprintf(line, sizeof(line), "\n%-8s %-24s %12s %12s  %s\n",
+                  "function", "arguments", "max abs err", "max rel err",
+                  "worst at");
+    out << line;
+    for (const MathCase &c : math_cases(count)) {
+        std::vector<double> fast(count);
+        apply_fast_operation(c.op, c.a.data(), c.b.data(), fast.data(),
+                             count);
+        double max_abs = 0.0, max_rel = 0.0;
+        size_t worst = 0;
+        for (size_t i = 0; i < count; ++i) {
+            double exact = apply_operation(c.op, c.a[i], c.b[i]);
+            if (!std::isfinite(exact)) {
+                continue;
+            }
+            double error = std::fabs(fast[i] - exact);
+            max_abs = std::max(max_abs, error);
+            if (exact != 0.0 && error / std::fabs(exact) > max_rel) {
+                max_rel = error / std::fabs(exact);
+                worst = i;
+            }
+        }
+        char argument[64];
+        if (c.op == OpCode::Power) {
+            std::snprintf(argument, sizeof(argument), "%.6g^%.6g",
+                          c.a[worst], c.b[worst]);
+        } else {
+            std::snprintf(argument, sizeof(argument), "%.6g", c.a[worst]);
+        }
+        std::snprintf(line, sizeof(line), "%-8s %-24s %12.3g %12.3g  %s\n",
+                      c.name, c.domain.c_str(), max_abs, max_rel, argument);
+        out << line;
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Settings settings;
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return 2;
+        }
+        std::string value = argv[++i];
+        try {
+            if (argument == "--samples") {
+                settings.samples = parse_int(argument, value, 1);
+            } else if (argument == "--repetitions") {
+                settings.options.repetitions = parse_int(argument, value, 1);
+            } else if (argument == "--warmup") {
+                settings.options.warmup = parse_int(argument, value, 0);
+            } else if (argument == "--filter") {
+                settings.options.filter = value;
+            } else if (argument == "--json") {
+                settings.json_path = value;
+            } else if (argument == "--label") {
+                settings.label = value;
+            } else {
+                usage();
+                return 2;
+            }
+        } catch (const std::exception &e) {
+            std::cerr << "calculator_bench: " << e.what() << "\n";
+            return 2;
+        }
+    }
+
+    BenchRunner runner(settings.options);
+    try {
+        for (const std::string &expression : corpus()) {
+            bench_expression(runner, expression, settings.samples);
+        }
+        bench_functions(runner, settings.samples);
+        bench_curves(runner, settings.samples);
+        bench_surface(runner, settings.samples);
+        bench_animation(runner);
+        bench_features(runner, settings.samples);
+        bench_integral(runner);
+        bench_export(runner, settings.samples);
+        bench_fast_math(runner, settings.samples);
+    } catch (const std::exception &e) {
+        std::cerr << "calculator_bench: " << e.what() << "\n";
+        return 1;
+    }
+
+    runner.print_table(std::cerr);
+    // The error report counts as a case named "accuracy" for --filter
+    if (std::string("accuracy").find(settings.options.filter) !=
+        std::string::npos) {
+        report_accuracy(std::cerr, 1 << 20);
+    }
+    if (settings.json_path.empty()) {
+        runner.write_json(std::cout, settings.label);
+    } else {
+        std::ofstream json(settings.json_path);
+        runner.write_json(json, settings.label);
+    }
+    return 0;
+}
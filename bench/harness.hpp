@@ -0,0 +1,138 @@
+#ifndef BENCH_HARNESS_HPP
+#define BENCH_HARNESS_HPP
+
+// Minimal benchmark harness shared by the bench targets: each case runs a
+// few untimed warmup iterations, then a fixed number of timed repetitions,
+// and reports the median, p99 and minimum along with time per item (sample,
+// token, row, ...) so cases of different sizes can be compared.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct BenchOptions {
+        int warmup = 3;
+        int repetitions = 20;
+        std::string filter; // Only cases whose name contains this run
+};
+
+struct BenchResult {
+        std::string name;
+        std::string expression;
+        size_t items = 0; // Work per repetition
+        int repetitions = 0;
+        double median_ns = 0.0;
+        double p99_ns = 0.0;
+        double min_ns = 0.0;
+
+        double ns_per_item() const {
+            return items > 0 ? median_ns / items : median_ns;
+        }
+};
+
+// Keeps the optimizer from discarding a benchmark's result
+template <typename T> inline void do_not_optimize(const T &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+class BenchRunner {
+    public:
+        explicit BenchRunner(const BenchOptions &options)
+            : options_(options) {}
+
+        // Times fn, which performs items units of work per call
+        void run(const std::string &name, const std::string &expression,
+                 size_t items, const std::function<void()> &fn) {
+            if (!options_.filter.empty() &&
+                (name + " " + expression).find(options_.filter) ==
+                    std::string::npos) {
+                return;
+            }
+            for (int i = 0; i < options_.warmup; ++i) {
+                fn();
+            }
+            std::vector<double> times(options_.repetitions);
+            for (double &time : times) {
+                auto started = std::chrono::steady_clock::now();
+                fn();
+                time = std::chrono::duration<double, std::nano>(
+                           std::chrono::steady_clock::now() - started)
+                           .count();
+            }
+            std::sort(times.begin(), times.end());
+
+            BenchResult result;
+            result.name = name;
+            result.expression = expression;
+            result.items = items;
+            result.repetitions = options_.repetitions;
+            result.median_ns = times[times.size() / 2];
+            result.p99_ns = times[std::min(times.size() - 1,
+                                           times.size() * 99 / 100)];
+            result.min_ns = times.front();
+            results_.push_back(result);
+        }
+
+        const std::vector<BenchResult> &get_results() const {
+            return results_;
+        }
+
+        // One aligned line per case
+        void print_table(std::ostream &out) const {
+            char line[256];
+            std::snprintf(line, sizeof(line), "%-20s %-34s %12s %12s %10s\n",
+                          "benchmark", "expression", "median us", "p99 us",
+                          "ns/item");
+            out << line;
+            for (const BenchResult &r : results_) {
+                std::string expression = r.expression.substr(0, 34);
+                std::snprintf(line, sizeof(line),
+                              "%-20s %-34s %12.1f %12.1f %10.2f\n",
+                              r.name.c_str(), expression.c_str(),
+                              r.median_ns / 1e3, r.p99_ns / 1e3,
+                              r.ns_per_item());
+                out << line;
+            }
+        }
+
+        // Machine-readable results for comparing runs across commits
+        void write_json(std::ostream &out, const std::string &label) const {
+            out << "{\n  \"label\": \"" << escape(label) << "\",\n"
+                << "  \"compiler\": \"" << escape(__VERSION__) << "\",\n"
+                << "  \"warmup\": " << options_.warmup << ",\n"
+                << "  \"repetitions\": " << options_.repetitions << ",\n"
+                << "  \"results\": [";
+            for (size_t i = 0; i < results_.size(); ++i) {
+                const BenchResult &r = results_[i];
+                out << (i == 0 ? "\n" : ",\n") << "    {\"benchmark\": \""
+                    << escape(r.name) << "\", \"expression\": \""
+                    << escape(r.expression) << "\", \"items\": " << r.items
+                    << ", \"median_ns\": " << r.median_ns
+                    << ", \"p99_ns\": " << r.p99_ns
+                    << ", \"min_ns\": " << r.min_ns
+                    << ", \"ns_per_item\": " << r.ns_per_item() << "}";
+            }
+            out << "\n  ]\n}\n";
+        }
+
+    private:
+        static std::string escape(const std::string &text) {
+            std::string escaped;
+            for (char c : text) {
+                if (c == '"' || c == '\\') {
+                    escaped += '\\';
+                }
+                escaped += c;
+            }
+            return escaped;
+        }
+
+        BenchOptions options_;
+        std::vector<BenchResult> results_;
+};
+
+#endif // BENCH_HARNESS_HPP
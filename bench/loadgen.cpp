@@ -0,0 +1,140 @@
+// Load generator for the evaluation server (calculator --serve SOCKET).
+// Each client thread opens its own connection and sends requests back to
+// back, cycling through a fixed set of expressions so the server's cache
+// sees mostly hits.
+//
+//   calculator_loadgen --socket PATH [--clients N] [--requests N]
+//                      [--samples N] [--values]
+
+#include "eval_client.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const char *const EXPRESSIONS[] = {
+    "sin(x)",
+    "sin(x)*cos(x/3)",
+    "x^2 - 4*x + 4",
+    "sqrt(x^2 + 1)",
+    "ln(x^2 + 1) / (1 + x^2)",
+    "arctan(x) * e^(0 - x^2 / 1000)",
+    "tan(x/7) + log(x^2 + 9)",
+    "(x^3 - 2*x) / (x^2 + 3)",
+};
+
+struct Options {
+        std::string socket;
+        int clients = 4;
+        int requests = 1000;
+        long long samples = 10000;
+        bool values = false; // Send x arrays instead of domains
+};
+
+void usage() {
+    std::cerr << "Usage: calculator_loadgen --socket PATH [--clients N] "
+                 "[--requests N]\n"
+                 "                          [--samples N] [--values]\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        bool has_value = i + 1 < argc;
+        if (argument == "--values") {
+            options.values = true;
+        } else if (argument == "--socket" && has_value) {
+            options.socket = argv[++i];
+        } else if (argument == "--clients" && has_value) {
+            options.clients = std::max(1, std::atoi(argv[++i]));
+        } else if (argument == "--requests" && has_value) {
+            options.requests = std::max(1, std::atoi(argv[++i]));
+        } else if (argument == "--samples" && has_value) {
+            options.samples = std::max(1LL, std::atoll(argv[++i]));
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (options.socket.empty()) {
+        usage();
+        return 2;
+    }
+
+    std::vector<double> xs(options.samples + 1);
+    for (size_t i = 0; i < xs.size(); ++i) {
+        xs[i] = -100.0 + 200.0 * i / options.samples;
+    }
+
+    const size_t num_expressions = sizeof(EXPRESSIONS) / sizeof(*EXPRESSIONS);
+    std::vector<std::vector<double>> latencies(options.clients);
+    std::vector<std::string> errors(options.clients);
+    auto started = std::chrono::steady_clock::now();
+    std::vector<std::thread> clients;
+    for (int c = 0; c < options.clients; ++c) {
+        clients.emplace_back([&, c] {
+            try {
+                EvaluationClient client(options.socket);
+                for (int r = 0; r < options.requests; ++r) {
+                    const char *expression =
+                        EXPRESSIONS[(c + r) % num_expressions];
+                    auto sent = std::chrono::steady_clock::now();
+                    EvaluationResult result =
+                        options.values
+                            ? client.evaluate_values(expression, 'x',
+                                                     xs.data(), xs.size())
+                            : client.evaluate_domain(expression, 'x', -100,
+                                                     100, options.samples);
+                    latencies[c].push_back(
+                        std::chrono::duration<double, std::micro>(
+                            std::chrono::steady_clock::now() - sent)
+                            .count());
+                    if (result.size() != xs.size()) {
+                        throw std::runtime_error("Short response.");
+                    }
+                }
+            } catch (const std::exception &e) {
+                errors[c] = e.what();
+            }
+        });
+    }
+    for (std::thread &client : clients) {
+        client.join();
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - started)
+                         .count();
+
+    std::vector<double> all;
+    for (int c = 0; c < options.clients; ++c) {
+        if (!errors[c].empty()) {
+            std::cerr << "client " << c << ": " << errors[c] << "\n";
+        }
+        all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+    }
+    if (all.empty()) {
+        return 1;
+    }
+    std::sort(all.begin(), all.end());
+    auto percentile = [&](double p) {
+        return all[std::min(all.size() - 1,
+                            static_cast<size_t>(p * all.size()))];
+    };
+
+    std::cout << all.size() << " requests from " << options.clients
+              << " clients in " << seconds << " s\n"
+              << "  " << all.size() / seconds << " requests/s, "
+              << all.size() * xs.size() / seconds / 1e6 << " M samples/s\n"
+              << "  latency us: p50 " << percentile(0.50) << ", p90 "
+              << percentile(0.90) << ", p99 " << percentile(0.99) << ", max "
+              << all.back() << "\n";
+    return all.size() == size_t(options.clients) * options.requests ? 0 : 1;
+}
@@ -2,6 +2,13 @@
 #define TUI_HPP
 
 #include "analysis_parameters.hpp"
+#include "chebyshev_surrogate.hpp"
+#include "feature_finder.hpp"
+#include "graph_raster.hpp"
+#include "sample_grid.hpp"
+#include "sample_series.hpp"
+#include "sample_stats.hpp"
+#include "surface_grid.hpp"
 #include <ncurses.h>
 #include <string>
 #include <vector>
@@ -40,11 +47,55 @@ class TUI {
                              bool &continue_interaction);
         void handle_running(int ch, std::string &message,
                             bool &continue_interaction);
+        void handle_export_precision(int ch, std::string &message,
+                                     bool &continue_interaction);
+        void handle_streaming(int ch, std::string &message,
+                              bool &continue_interaction);
+        void handle_integral(int ch, std::string &message,
+                             bool &continue_interaction);
+        void handle_plot_precision(int ch, std::string &message,
+                                   bool &continue_interaction);
+        void handle_surrogate(int ch, std::string &message,
+                              bool &continue_interaction);
+        std::string prompt_output_path(const std::string &extension) const;
         void handle_help();
 
-        void run_calculation();
+        // surrogate samples functions from surrogates_ instead of the
+        // expressions
+        void run_calculation(Precision precision = Precision::Float64,
+                             MathTier tier = MathTier::Exact,
+                             bool surrogate = false);
+        // Function mode of run_calculation, evaluated and stored as T
+        template <typename T>
+        void run_functions(Precision precision, MathTier tier, bool surrogate);
+        // Fits surrogates_ over the domain unless they already cover it for
+        // the current functions; returns whether it fitted
+        bool fit_surrogates();
+        void run_curve();
+        void run_surface();
+        void run_first_frame();
+        void run_derivatives();
+        // Rebuilds window_stats_ from the results when the graph window has
+        // moved since they were evaluated
+        void gather_window_stats();
+        // Plays the animation in the graph view until a key is pressed and
+        // returns it; shown holds the plot area as it is on screen
+        int animate_graph(GraphRaster &shown, int top, int left, int axis_row,
+                          int axis_column, int footer_x);
+        void draw_surface(WINDOW *window, int top, int left, int width,
+                          int height) const;
+
+        void export_binary();
+        void export_archive();
+        void load_comparison_run();
 
         void display_graph();
+        bool toggle_telemetry(); // False when built without telemetry
+        void toggle_trace(std::string &message);
+        void display_profile(std::string &message);
+        void find_features(std::string &message);
+        bool features_current() const; // Found for the results shown
+        void draw_telemetry(WINDOW *window, int row, int column) const;
         void adjust_graph_domain_range();
 
         void draw_help_menu();
@@ -56,8 +107,36 @@ class TUI {
         WINDOW *result_window;
         WINDOW *graph_window;
         WINDOW *help_menu_window;
+        WINDOW *telemetry_window = nullptr; // Overlay below the status box
+        bool show_telemetry_ = false;
         std::vector<std::string> menu_items;
-        std::vector<std::pair<double, double>> results_;
+        SampleSeries results_;
+        std::vector<SampleSeries> function_results_; // f2 onwards
+        std::vector<SampleSeries> derivative_results_; // f1' and f1''
+        int derivative_order_ = 0; // Derivatives shown and exported, 0-2
+        SurfaceGrid surface_; // f(x, y) at one value per plot cell
+        bool show_contours_ = false;
+        double animation_phase_ = 0.0; // Position in the sweep, 0 to 1
+        bool animation_paused_ = false;
+        std::vector<Feature> features_; // Roots, extrema and crossings of f1
+        SampleGrid features_grid_;
+        unsigned long features_revision_ = 0;
+        SampleGrid results_grid_;            // Grid results_ was sampled on
+        unsigned long results_revision_ = 0; // Expression results_ came from
+        MathTier results_tier_ = MathTier::Exact; // Functions results_ used
+        bool results_surrogate_ = false; // results_ sampled from surrogates_
+        size_t reused_samples_ = 0;          // Carried over by the last run
+        std::vector<SampleStats> results_stats_; // Per function, whole run
+        std::vector<SampleStats> window_stats_;  // Per function, x in window
+        int stats_min_x_ = 0; // Graph window window_stats_ was gathered for
+        int stats_max_x_ = 0;
+        bool fit_range_ = true; // Y range fitted to the functions, not set
+        Precision plot_precision_ = Precision::Float64; // Of graph runs
+        bool plot_surrogate_ = false; // Graph runs sample surrogates_
+        std::vector<ChebyshevSurrogate> surrogates_; // Per function
+        unsigned long surrogates_revision_ = 0; // Expression fitted to
+        SampleSeries comparison_;    // Previously exported run to overlay
+        std::string comparison_label_;
         int highlighted_item;
         int menu_size = 8;
         AnalysisParameters parameters;
@@ -2,11 +2,19 @@
 #define ANALYSIS_PARAMETERS_HPP
 
 #include "ast.hpp"
+#include "compiled_expression.hpp"
+#include "fused_expressions.hpp"
 #include <filesystem>
 #include <set>
 #include <string>
 #include <unordered_map>
 
+// What the expressions describe: y = f(x), a parametric curve
+// (x(t), y(t)) or a polar curve r(t) with the independent variable as t,
+// a surface f(x, y) over the graph window or a function f(x, t) animated
+// over the parameter range
+enum class PlotMode { Function, Parametric, Polar, Surface, Animation };
+
 class AnalysisParameters {
     public:
         AnalysisParameters(int start, int end, int num_samples);
@@ -19,38 +27,118 @@ class AnalysisParameters {
         const double get_variable_value(char variable) const;
         const std::filesystem::path get_output_directory_path() const;
         const std::string get_expression() const;
+        const int get_export_precision() const;
+        const long long get_stream_samples() const;
         const std::set<char> get_reserved_chars() const;
+        const unsigned long get_expression_revision() const;
+        const CompiledExpression &get_compiled_expression() const;
+        const size_t get_function_count() const; // f1 included
+        const std::string get_function(size_t index) const;
+        const CompiledExpression &get_compiled_function(size_t index) const;
+        const FusedExpressions &get_fused_functions() const;
+        const PlotMode get_plot_mode() const;
+        const std::string get_curve_x() const;
+        const std::string get_curve_y() const;
+        const std::string get_polar() const;
+        const double get_curve_start() const;
+        const double get_curve_end() const;
+        const char get_second_variable() const; // y of f(x, y)
+        const std::string get_surface() const;
+        const CompiledExpression &get_compiled_surface() const;
+        const char get_time_variable() const; // t of f(x, t)
+        const std::string get_animation() const;
+        const CompiledExpression &get_compiled_animation() const;
 
         std::string display_domain() const;
         std::string display_num_step() const;
         std::string display_variable() const;
         std::string display_output_directory_path(int max_width) const;
         std::string display_expression() const;
+        std::string display_function(size_t index) const;
+        std::string display_curve() const;
+        std::string display_curve_range() const;
+        std::string display_surface() const;
+        std::string display_animation() const;
+        std::string display_export_precision() const;
+        std::string display_stream_samples() const;
 
         void set_start(int new_start);
         void set_end(int new_end);
+        void set_domain(int new_start, int new_end);
         void set_num_samples(int new_samples);
         void set_variable(char new_variable);
         void set_output_directory_path(std::string new_dir);
         void set_expression(const std::string &new_expression);
+        void set_export_precision(int new_precision);
+        void set_stream_samples(long long new_samples);
+
+        // Functions plotted alongside the expression, which is always f1
+        void add_function(const std::string &new_function);
+        void remove_function(size_t index);
+        // Simplified symbolic derivative of function index as expression
+        // text, ready for add_function or set_expression
+        std::string differentiate_function(size_t index);
+
+        // Curve modes, plotted over [curve_start_, curve_end_] instead of
+        // the domain
+        void set_plot_mode(PlotMode new_mode);
+        void set_parametric(const std::string &new_x, const std::string &new_y);
+        void set_polar(const std::string &new_r);
+        void set_curve_range(double new_start, double new_end);
+        void set_surface(const std::string &new_surface);
+        void set_animation(const std::string &new_animation);
 
         bool is_valid_domain() const;
+        static bool is_valid_domain(int start, int end);
         bool is_valid_samples() const;
         bool is_valid_output_path() const;
         bool is_valid_variable() const;
         bool is_valid_expression(const std::string &expression) const;
+        bool is_valid_export_precision() const;
+        bool is_valid_stream_samples() const;
+        // The variable, or either variable while a surface or animation is
+        // compiled
+        bool is_independent_variable(char name) const;
 
         void update_step();
         void update_expression();
 
         double evaluate_expression(double variable_value);
+        void evaluate_batch(const double *values, double *results,
+                            size_t count) const;
+        // The expression with its first and second derivative
+        void evaluate_derivatives(const double *values, double *results,
+                                  double *first, double *second,
+                                  size_t count) const;
+        // results[k] receives function k (0 is the expression)
+        void evaluate_functions(const double *values, double *const *results,
+                                size_t count,
+                                MathTier tier = MathTier::Exact) const;
+        // The same in single precision, for plotting
+        void evaluate_functions(const float *values, float *const *results,
+                                size_t count,
+                                MathTier tier = MathTier::Exact) const;
+        // Points of the current curve for count parameter values
+        void evaluate_curve(const double *values, double *x, double *y,
+                            size_t count) const;
 
         void set_variable_value(char variable, double value);
 
         static const int MAX_SAMPLES = 100000;
         static const int MIN_SAMPLES = 100;
+        static const int MAX_EXPORT_PRECISION = 17; // Digits in a double
+        static const long long MAX_STREAM_SAMPLES = 10000000000LL;
+        static const size_t MAX_FUNCTIONS = 5;
 
     private:
+        CompiledExpression compile_function(const std::string &function);
+        std::string rename_variable(const std::string &expression) const;
+        std::string rename_variables(const std::string &expression,
+                                     char old_second, char new_second) const;
+        CompiledExpression compile_two_variables(const std::string &function,
+                                                 char second);
+        void fuse_functions();
+
         int start_;
         int end_;
         int num_samples_;
@@ -59,10 +147,30 @@ class AnalysisParameters {
         char old_variable_;
         std::filesystem::path output_directory_path_;
         std::string expression_;
+        int export_precision_;     // 0 = shortest round-trip
+        long long stream_samples_; // Samples for streamed exports
         std::unordered_map<char, double>
             variable_values; // Stores variable values
         std::set<char> reserved_chars;
         std::unique_ptr<ASTNode> ast_;
+        CompiledExpression compiled_; // Flattened ast_ for batch evaluation
+        std::vector<std::string> functions_;          // f2 onwards
+        std::vector<CompiledExpression> compiled_functions_;
+        FusedExpressions fused_; // compiled_ and compiled_functions_ merged
+        PlotMode plot_mode_ = PlotMode::Function;
+        std::string curve_x_;
+        std::string curve_y_;
+        std::string polar_;
+        FusedExpressions parametric_; // x(t) and y(t) in one pass
+        CompiledExpression compiled_polar_;
+        double curve_start_ = 0.0;
+        double curve_end_ = 6.283185307179586; // One turn
+        std::string surface_;
+        CompiledExpression compiled_surface_;
+        std::string animation_;
+        CompiledExpression compiled_animation_;
+        char second_variable_ = 0; // Also accepted while it is set
+        unsigned long expression_revision_ = 0; // Bumped whenever ast_ changes
 };
 
 #endif // ANALYSIS_PARAMETERS_HPP
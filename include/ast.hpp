@@ -5,6 +5,7 @@
 #include <string>
 
 class AnalysisParameters;
+class CompiledExpression;
 
 // Base AST Node class
 class ASTNode {
@@ -12,6 +13,20 @@ class ASTNode {
         virtual ~ASTNode() = default;
         virtual double evaluate() const = 0;
         virtual bool contains_variable(char variable) const = 0; // New method
+        // Appends this subtree to program and returns its result slot
+        virtual int compile(CompiledExpression &program) const = 0;
+
+        virtual std::unique_ptr<ASTNode> clone() const = 0;
+        // Symbolic derivative in variable, unsimplified
+        virtual std::unique_ptr<ASTNode>
+        differentiate(char variable) const = 0;
+        // Copy with constants folded and identities such as x*1, x+0 and
+        // x^1 removed
+        virtual std::unique_ptr<ASTNode> simplify() const = 0;
+        // Expression text that parses back to an equivalent tree
+        virtual std::string to_string() const = 0;
+        // Binding strength of the outermost operation, for parentheses
+        virtual int precedence() const;
 };
 
 // Derived class for numeric literals
@@ -21,6 +36,12 @@ class NumberNode : public ASTNode {
         double evaluate() const override;
         bool contains_variable(
             char variable) const override; // Implementation in .cpp
+        int compile(CompiledExpression &program) const override;
+        std::unique_ptr<ASTNode> clone() const override;
+        std::unique_ptr<ASTNode> differentiate(char variable) const override;
+        std::unique_ptr<ASTNode> simplify() const override;
+        std::string to_string() const override;
+        int precedence() const override;
     private:
         double value;
 };
@@ -32,6 +53,11 @@ class VariableNode : public ASTNode {
         double evaluate() const override;
         bool contains_variable(
             char variable) const override; // Implementation in .cpp
+        int compile(CompiledExpression &program) const override;
+        std::unique_ptr<ASTNode> clone() const override;
+        std::unique_ptr<ASTNode> differentiate(char variable) const override;
+        std::unique_ptr<ASTNode> simplify() const override;
+        std::string to_string() const override;
     private:
         char name;
         AnalysisParameters &parameters; // Reference to AnalysisParameters
@@ -45,7 +71,28 @@ class BinaryOpNode : public ASTNode {
         double evaluate() const override;
         bool contains_variable(
             char variable) const override; // Implementation in .cpp
+        int compile(CompiledExpression &program) const override;
+        std::unique_ptr<ASTNode> clone() const override;
+        std::unique_ptr<ASTNode> differentiate(char variable) const override;
+        std::unique_ptr<ASTNode> simplify() const override;
+        std::string to_string() const override;
+        int precedence() const override;
+
+        // oper(l, r) with the simplifications of simplify applied to the
+        // top level; l and r are expected to be simplified already
+        static std::unique_ptr<ASTNode> make(char oper,
+                                             std::unique_ptr<ASTNode> l,
+                                             std::unique_ptr<ASTNode> r);
+        // -operand, written 0-operand like the parser's unary minus
+        static std::unique_ptr<ASTNode>
+        negate(std::unique_ptr<ASTNode> operand);
+
     private:
+        bool is_negation() const;
+        // A negative number, or a product or quotient led by one, which
+        // prints with a leading minus
+        static bool starts_negative(const std::unique_ptr<ASTNode> &node);
+
         char op;
         std::unique_ptr<ASTNode> left, right;
 };
@@ -57,6 +104,11 @@ class FunctionNode : public ASTNode {
         double evaluate() const override;
         bool contains_variable(
             char variable) const override; // Implementation in .cpp
+        int compile(CompiledExpression &program) const override;
+        std::unique_ptr<ASTNode> clone() const override;
+        std::unique_ptr<ASTNode> differentiate(char variable) const override;
+        std::unique_ptr<ASTNode> simplify() const override;
+        std::string to_string() const override;
     private:
         std::string func;
         std::unique_ptr<ASTNode> argument;
@@ -67,5 +119,7 @@ std::unique_ptr<ASTNode>
 generate_ast_from_expression(const std::string &expression,
                              AnalysisParameters &params);
 double evaluate_expression(const std::unique_ptr<ASTNode> &ast);
+// Simplified symbolic derivative of ast in variable
+std::unique_ptr<ASTNode> differentiate_ast(const ASTNode &ast, char variable);
 
 #endif // AST_HPP
@@ -0,0 +1,62 @@
+#ifndef BATCH_CLI_HPP
+#define BATCH_CLI_HPP
+
+#include "analysis_parameters.hpp"
+#include "stream_export.hpp"
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// One headless evaluation: an expression, its grid and where to write it
+struct BatchJob {
+        std::string expression;
+        char variable = 'x';
+        int start = -100;
+        int end = 100;
+        long long samples = 10000;
+        int precision = 0;
+        ExportFormat format = ExportFormat::Text;
+        std::string output = "output";
+};
+
+// Command-line front end that runs the AnalysisParameters pipeline without
+// ncurses, for scripts and pipelines:
+//   calculator --expr "sin(x)" --domain -100:100 --samples 1e6
+//              --out file --format bin|txt|gor
+//   calculator --jobs jobs.txt
+//   producer | calculator --expr "sin(x)" --pipe bin | consumer
+//   calculator --serve /tmp/calculator.sock
+class BatchCLI {
+    public:
+        BatchCLI(int argc, char **argv);
+
+        // Runs every job and returns the process exit code
+        int run();
+
+        static void print_usage(std::ostream &out);
+
+    private:
+        void parse_arguments();
+        void apply_option(BatchJob &job, const std::string &name,
+                          const std::string &value) const;
+        std::vector<BatchJob> load_job_file(const std::string &path) const;
+        int execute(const std::vector<BatchJob> &jobs) const;
+        void run_job(const BatchJob &job, AnalysisParameters &params) const;
+        void print_profile(const BatchJob &job,
+                           const AnalysisParameters &params) const;
+        void run_pipe(AnalysisParameters &params) const;
+        void run_server() const;
+
+        std::vector<std::string> arguments_;
+        BatchJob defaults_;
+        std::string job_file_;
+        std::string pipe_formats_; // Set when filtering stdin to stdout
+        std::string socket_path_;  // Set when serving requests
+        unsigned workers_;
+        std::string trace_path_; // Chrome trace written after the run
+        bool quiet_;
+        bool profile_; // Print a per-subterm cost breakdown per job
+        bool help_;
+};
+
+#endif // BATCH_CLI_HPP
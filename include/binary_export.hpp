@@ -0,0 +1,160 @@
+#ifndef BINARY_EXPORT_HPP
+#define BINARY_EXPORT_HPP
+
+#include "export_writer.hpp"
+#include "sample_series.hpp"
+#include "stream_export.hpp"
+#include "surface_grid.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+
+// On-disk header of a binary run. The expression text follows the header,
+// then the x column (only for explicit grids) and the y column, each
+// starting on a 64-byte boundary so a mapped file can be used in place.
+// A surface (GRID) has no x column; x_offset points at its
+// BinaryGridHeader instead and the y column holds f(x, y) row by row.
+// Surfaces are written as GRID_VERSION so readers that predate them
+// reject the file instead of taking the grid header for an x column.
+struct BinaryRunHeader {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t flags;
+        std::uint64_t sample_count;
+        double start;
+        double end;
+        double step;
+        std::uint64_t x_offset; // 0 when x is implicit
+        std::uint64_t y_offset;
+        std::uint32_t expression_length;
+        char variable;
+        char reserved[11];
+
+        static constexpr char MAGIC[8] = {'T', 'U', 'I', 'C',
+                                          'A', 'L', 'C', 'B'};
+        static const std::uint32_t VERSION = 1;
+        static const std::uint32_t GRID_VERSION = 2;
+        static const std::uint32_t FLOAT32_COLUMNS = 1u << 0;
+        static const std::uint32_t EXPLICIT_X = 1u << 1;
+        static const std::uint32_t GRID = 1u << 2;
+        static const std::uint32_t KNOWN_FLAGS =
+            FLOAT32_COLUMNS | EXPLICIT_X | GRID;
+        static const size_t COLUMN_ALIGNMENT = 64;
+};
+static_assert(sizeof(BinaryRunHeader) == 80, "Header layout must not change");
+
+// Shape of a surface run: rows of columns values, the first row at max_y
+struct BinaryGridHeader {
+        std::uint64_t columns;
+        std::uint64_t rows;
+        double min_x;
+        double max_x;
+        double min_y;
+        double max_y;
+};
+static_assert(sizeof(BinaryGridHeader) == 48,
+              "Grid layout must not change");
+
+// Describes the run being written: the expression it came from and the
+// grid it covers
+struct BinaryRunInfo {
+        std::string expression;
+        char variable = 'x';
+        double start = 0.0;
+        double end = 0.0;
+        double step = 0.0;
+        std::uint64_t sample_count = 0;
+        bool explicit_x = false;
+        bool float32 = false;
+        std::optional<BinaryGridHeader> grid; // Surfaces only
+};
+
+// Lays out a binary run at its final size up front, then places each chunk
+// at its offset with pwrite, so chunks can arrive from a stream
+class BinaryExporter {
+    public:
+        BinaryExporter(const std::filesystem::path &path,
+                       const BinaryRunInfo &info);
+        ~BinaryExporter();
+
+        BinaryExporter(const BinaryExporter &) = delete;
+        BinaryExporter &operator=(const BinaryExporter &) = delete;
+
+        // Writes chunk as samples [first_index, first_index + chunk.size())
+        void write_chunk(size_t first_index, const SampleSeries &chunk);
+        void close();
+        size_t file_size() const;
+
+        // Writes a whole in-memory series in one call
+        static ExportStats write(const std::filesystem::path &path,
+                                 const SampleSeries &series,
+                                 const std::string &expression, char variable,
+                                 bool float32);
+        static ExportStats write_grid(const std::filesystem::path &path,
+                                      const SurfaceGrid &grid,
+                                      const std::string &expression,
+                                      char variable, bool float32);
+
+    private:
+        void write_column(const double *values, size_t count,
+                          std::uint64_t offset);
+
+        int fd_;
+        BinaryRunInfo info_;
+        BinaryRunHeader header_;
+        size_t file_size_;
+};
+
+// Streams chunks into a binary run file
+class BinaryChunkSink : public ChunkSink {
+    public:
+        BinaryChunkSink(const std::filesystem::path &path,
+                        const BinaryRunInfo &info);
+
+        void write_chunk(const SampleSeries &chunk) override;
+        void finish() override;
+        size_t bytes_written() const override;
+
+    private:
+        BinaryExporter exporter_;
+        size_t next_index_;
+};
+
+// Read-only memory mapping of a binary run. Loading only validates the
+// header; the columns are read straight from the mapped pages.
+class MappedRun {
+    public:
+        explicit MappedRun(const std::filesystem::path &path);
+        ~MappedRun();
+
+        MappedRun(const MappedRun &) = delete;
+        MappedRun &operator=(const MappedRun &) = delete;
+
+        const std::string &get_expression() const;
+        char get_variable() const;
+        double get_start() const;
+        double get_end() const;
+        double get_step() const;
+        size_t size() const;
+        bool is_float32() const;
+        bool is_uniform() const; // False for surfaces, which have no x
+        bool is_grid() const;
+        BinaryGridHeader get_grid() const; // Surfaces only
+
+        double x(size_t index) const; // Throws for surfaces
+        double y(size_t index) const;
+
+        // Copies the run into a series for the graph view; surfaces have
+        // no series form
+        SampleSeries to_series() const;
+
+    private:
+        const unsigned char *data_;
+        size_t length_;
+        const BinaryRunHeader *header_;
+        std::string expression_;
+};
+
+#endif // BINARY_EXPORT_HPP
@@ -0,0 +1,83 @@
+#ifndef CHEBYSHEV_SURROGATE_HPP
+#define CHEBYSHEV_SURROGATE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// How a fit went and what it bought
+struct SurrogateFit {
+        size_t pieces = 0;       // In the final partition
+        size_t exact_pieces = 0; // Left to the exact evaluator
+        size_t evaluations = 0;  // Of the exact evaluator while fitting
+        // Largest error over the fitted pieces, in the units of the
+        // tolerance: the difference to f at the check points, or the
+        // coefficient tail where that is larger, over max(1, |f|)
+        double max_error = 0.0;
+        double seconds = 0.0; // Spent fitting
+        // Single-thread cost per point of the exact evaluator and of the
+        // surrogate, over the same uniform points of the fitted interval
+        double exact_ns = 0.0;
+        double surrogate_ns = 0.0;
+
+        double speedup() const; // exact_ns / surrogate_ns, 0 if unmeasured
+};
+
+// Piecewise Chebyshev approximation of a function on [a, b], to stand in
+// for an expensive expression when the same interval is sampled again and
+// again. Fitting works in rounds like the quadrature: every open piece is
+// interpolated at DEGREE + 1 Chebyshev points and checked against f at the
+// DEGREE points in between, all in batch calls over the thread pool;
+// pieces within tolerance are kept and the rest are halved. Pieces that
+// still miss it when they are too narrow to split, or where f is not
+// finite, are non-smooth (a pole, a kink, the edge of ln's domain) and are
+// evaluated exactly.
+class ChebyshevSurrogate {
+    public:
+        // Fills y for count x values; called from pool threads, so it must
+        // be thread-safe
+        using Evaluator =
+            std::function<void(const double *x, double *y, size_t count)>;
+
+        ChebyshevSurrogate() = default;
+        explicit ChebyshevSurrogate(Evaluator evaluator);
+
+        // tolerance is relative to the magnitude of f on each piece, or
+        // absolute where f is smaller than 1
+        const SurrogateFit &fit(double a, double b, double tolerance);
+
+        // The surrogate at count points, which are fastest in ascending
+        // order; points outside the fit or on exact pieces go to f
+        void evaluate(const double *x, double *y, size_t count) const;
+        void evaluate(const float *x, float *y, size_t count) const;
+
+        bool covers(double a, double b) const; // Within the fitted interval
+        const SurrogateFit &get_fit() const;
+
+        static constexpr size_t DEGREE = 16;
+        static constexpr size_t NODES = DEGREE + 1;  // Per piece
+        static constexpr size_t CHECKS = DEGREE;     // Per piece
+        static constexpr size_t INITIAL_PIECES = 8;
+        static constexpr size_t MAX_PIECES = 1 << 14; // Open at once
+        static constexpr int MAX_ROUNDS = 40;
+        // Pieces narrower than this share of [a, b] are not split again
+        static constexpr double MIN_WIDTH = 0x1p-24;
+        static constexpr size_t CHUNK_PIECES = 32;   // Per batch call
+        static constexpr size_t PROBE_POINTS = 4096; // For the speedup
+
+    private:
+        template <typename T>
+        void evaluate_values(const T *x, T *y, size_t count) const;
+        void measure_speed(double a, double b);
+
+        Evaluator evaluator_;
+        double start_ = 0.0;
+        double end_ = 0.0;
+        std::vector<double> breaks_; // Piece k is [breaks_[k], breaks_[k + 1]]
+        std::vector<double> coefficients_; // NODES per piece
+        std::vector<uint8_t> exact_;       // Per piece
+        SurrogateFit fit_;
+};
+
+#endif // CHEBYSHEV_SURROGATE_HPP
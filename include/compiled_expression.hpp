@@ -0,0 +1,123 @@
+#ifndef COMPILED_EXPRESSION_HPP
+#define COMPILED_EXPRESSION_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class ASTNode;
+class ExpressionProfile;
+
+// Operations of a compiled expression
+enum class OpCode {
+    Constant,
+    Variable,
+    SecondVariable, // y of a surface f(x, y) or t of an animation f(x, t)
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Power,
+    Sin,
+    Cos,
+    Tan,
+    Arcsin,
+    Arccos,
+    Arctan,
+    Log,
+    Ln,
+    Sqrt
+};
+
+// How the elementary functions are computed: Exact calls libm, Fast uses
+// the bounded-error approximations of fast_math.hpp, for screen plots
+enum class MathTier { Exact, Fast };
+
+// One step of a compiled expression. Its result lives in the slot with the
+// same index as the instruction; operands refer to earlier slots.
+struct Instruction {
+        OpCode op;
+        int left = -1;
+        int right = -1;
+        double value = 0.0; // Constant only
+};
+
+// Flat, post-order form of an AST that evaluates whole batches of x values
+// one operation at a time, instead of walking the tree once per sample.
+// It holds no reference to AnalysisParameters, so a compiled expression can
+// be shared between threads.
+class CompiledExpression {
+    public:
+        CompiledExpression();
+        explicit CompiledExpression(const ASTNode &root);
+
+        // Builders used by ASTNode::compile; each returns the result slot.
+        // Operations on constants are folded as they are added.
+        int add_constant(double value, const std::string &label = "");
+        int add_variable(char name);
+        int add_second_variable(char name);
+        int add_binary(char op, int left, int right);
+        int add_function(const std::string &name, int argument);
+
+        bool empty() const;
+        size_t size() const;
+        const std::vector<Instruction> &get_instructions() const;
+
+        // Source-like text of the subexpression computed by a slot
+        const std::string &get_label(int slot) const;
+
+        double evaluate(double x) const;
+        void evaluate(const double *x, double *y, size_t count,
+                      MathTier tier = MathTier::Exact) const;
+        // For surfaces: out[i] = f(x[i], second[i])
+        void evaluate(const double *x, const double *second, double *out,
+                      size_t count) const;
+        // In single precision throughout, for plots: half the memory and
+        // twice the lanes per vector register
+        void evaluate(const float *x, float *y, size_t count,
+                      MathTier tier = MathTier::Exact) const;
+
+        // f, f' and f'' in x in one pass by forward-mode differentiation:
+        // every slot carries its first and second derivative next to its
+        // value, and y matches evaluate exactly
+        void evaluate_derivatives(const double *x, double *y, double *dy,
+                                  double *d2y, size_t count) const;
+
+        // Same results as evaluate, additionally timing every instruction
+        void evaluate_profiled(const double *x, double *y, size_t count,
+                               ExpressionProfile &profile) const;
+
+        static constexpr size_t BATCH_SIZE = 256;
+
+    private:
+        int push(const Instruction &instruction, const std::string &label,
+                 int precedence);
+        void pop_slots(size_t count);
+        template <typename T>
+        void evaluate_lanes(const T *x, const T *second, T *out, size_t count,
+                            MathTier tier) const;
+        template <typename T>
+        void evaluate_block(const T *x, const T *second, T *y, size_t count,
+                            T *scratch, MathTier tier) const;
+
+        std::vector<Instruction> instructions_;
+        std::vector<std::string> labels_;
+        std::vector<int> precedence_; // For parenthesizing labels
+};
+
+// Applies a single operation, shared by constant folding and evaluation
+double apply_operation(OpCode op, double left, double right);
+float apply_operation(OpCode op, float left, float right);
+
+// Runs one instruction over count lanes: x (and second, for surfaces) holds
+// the variable, a and b the operand slots and out the instruction's own slot
+void apply_instruction(const Instruction &instruction, const double *x,
+                       double *out, const double *a, const double *b,
+                       size_t count, const double *second = nullptr,
+                       MathTier tier = MathTier::Exact);
+void apply_instruction(const Instruction &instruction, const float *x,
+                       float *out, const float *a, const float *b,
+                       size_t count, const float *second = nullptr,
+                       MathTier tier = MathTier::Exact);
+
+#endif // COMPILED_EXPRESSION_HPP
@@ -0,0 +1,118 @@
+#ifndef COMPRESSED_ARCHIVE_HPP
+#define COMPRESSED_ARCHIVE_HPP
+
+#include "sample_series.hpp"
+#include "stream_export.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Appends values of up to 64 bits to a byte buffer, most significant first
+class BitWriter {
+    public:
+        void write(std::uint64_t value, int bits);
+        void write_bit(bool bit);
+        std::vector<std::uint8_t> &finish(); // Flushes the partial byte
+
+    private:
+        std::vector<std::uint8_t> bytes_;
+        std::uint64_t pending_ = 0;
+        int pending_bits_ = 0;
+};
+
+// Reads values written by BitWriter
+class BitReader {
+    public:
+        BitReader(const std::uint8_t *data, size_t size);
+        std::uint64_t read(int bits);
+        bool read_bit();
+
+    private:
+        const std::uint8_t *data_;
+        size_t size_;
+        size_t bit_position_;
+};
+
+// File header of a compressed archive. Blocks of up to BLOCK_SAMPLES
+// samples follow, each a {count, bytes} pair and its bit stream.
+struct ArchiveHeader {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t flags;
+        std::uint64_t sample_count;
+        std::uint64_t block_count;
+        double start;
+        double step;
+        std::uint32_t expression_length;
+        char variable;
+        char reserved[3];
+
+        static constexpr char MAGIC[8] = {'T', 'U', 'I', 'C',
+                                          'A', 'L', 'C', 'Z'};
+        static const std::uint32_t VERSION = 1;
+        static const std::uint32_t EXPLICIT_X = 1u << 0;
+        static const size_t BLOCK_SAMPLES = 1 << 16;
+};
+static_assert(sizeof(ArchiveHeader) == 56, "Header layout must not change");
+
+// Streaming Gorilla-style encoder. y values are stored as the XOR with the
+// previous value, which is mostly zero bits for smooth functions; explicit
+// x values use delta-of-delta of their bit patterns, and uniform x is kept
+// implicit as start/step in the header. Each block restarts the predictors
+// so blocks decode independently.
+class ArchiveEncoder : public ChunkSink {
+    public:
+        ArchiveEncoder(const std::filesystem::path &path,
+                       const std::string &expression, char variable,
+                       bool explicit_x, double start, double step);
+        ~ArchiveEncoder() override;
+
+        void write_chunk(const SampleSeries &chunk) override;
+        void finish() override;
+        size_t bytes_written() const override;
+
+        // Size of the samples before compression
+        size_t raw_bytes() const;
+
+    private:
+        void encode_block(const SampleSeries &chunk, size_t begin,
+                          size_t end);
+
+        int fd_;
+        ArchiveHeader header_;
+        size_t bytes_;
+};
+
+// Streaming decoder that hands an archive back one block at a time
+class ArchiveDecoder {
+    public:
+        explicit ArchiveDecoder(const std::filesystem::path &path);
+        ~ArchiveDecoder();
+
+        ArchiveDecoder(const ArchiveDecoder &) = delete;
+        ArchiveDecoder &operator=(const ArchiveDecoder &) = delete;
+
+        const std::string &get_expression() const;
+        char get_variable() const;
+        size_t size() const;
+
+        // Decodes the next block into chunk; false once the archive is done
+        bool next_chunk(SampleSeries &chunk);
+
+        // Decodes the remaining blocks into a single series
+        SampleSeries read_all();
+
+    private:
+        void read_exact(void *data, size_t size);
+
+        int fd_;
+        ArchiveHeader header_;
+        std::string expression_;
+        std::uint64_t blocks_read_;
+        std::uint64_t samples_read_;
+        std::vector<std::uint8_t> buffer_;
+};
+
+#endif // COMPRESSED_ARCHIVE_HPP
@@ -0,0 +1,43 @@
+#ifndef CURVE_SAMPLER_HPP
+#define CURVE_SAMPLER_HPP
+
+#include "sample_series.hpp"
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// Samples a plane curve (x(t), y(t)) with a fixed evaluation budget, placed
+// by arc length rather than uniformly in t: a uniform pilot pass measures
+// how far the curve moves over every interval, and the rest of the budget
+// is spread at equal arc-length steps, so fast sections get more points and
+// slow ones fewer.
+class CurveSampler {
+    public:
+        // Fills x and y for count parameter values; called from pool
+        // threads, so it must be thread-safe
+        using Evaluator = std::function<void(const double *t, double *x,
+                                             double *y, size_t count)>;
+
+        // Lengths are measured in units of x_scale and y_scale, e.g. the
+        // visible window, so both axes count equally on screen
+        CurveSampler(Evaluator evaluator, double x_scale = 1.0,
+                     double y_scale = 1.0);
+
+        // At most budget evaluations over [t_start, t_end], returned as an
+        // explicit series in parameter order
+        SampleSeries sample(double t_start, double t_end,
+                            size_t budget) const;
+
+        static constexpr size_t MIN_BUDGET = 16;
+        static constexpr size_t PILOT_DIVISOR = 4; // Budget share of the pilot
+
+    private:
+        void evaluate(const std::vector<double> &t, std::vector<double> &x,
+                      std::vector<double> &y) const;
+
+        Evaluator evaluator_;
+        double x_scale_;
+        double y_scale_;
+};
+
+#endif // CURVE_SAMPLER_HPP
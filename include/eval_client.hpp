@@ -0,0 +1,54 @@
+#ifndef EVAL_CLIENT_HPP
+#define EVAL_CLIENT_HPP
+
+#include "eval_protocol.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// y values returned by the server, either copied inline or mapped from the
+// shared buffer it sent
+class EvaluationResult {
+    public:
+        EvaluationResult();
+        EvaluationResult(std::vector<double> values);
+        EvaluationResult(SharedBuffer shared, size_t count);
+
+        const double *data() const;
+        size_t size() const;
+        double operator[](size_t i) const;
+
+    private:
+        std::vector<double> values_;
+        SharedBuffer shared_;
+        size_t count_;
+};
+
+// Blocking client for EvaluationServer; one request at a time per client
+class EvaluationClient {
+    public:
+        explicit EvaluationClient(const std::string &socket_path);
+        ~EvaluationClient();
+
+        EvaluationClient(const EvaluationClient &) = delete;
+        EvaluationClient &operator=(const EvaluationClient &) = delete;
+
+        // f at intervals + 1 evenly spaced points over [start, end]
+        EvaluationResult evaluate_domain(const std::string &expression,
+                                         char variable, double start,
+                                         double end, std::uint64_t intervals);
+
+        // f at each of the count given x values
+        EvaluationResult evaluate_values(const std::string &expression,
+                                         char variable, const double *xs,
+                                         size_t count);
+
+    private:
+        EvaluationResult exchange(EvalRequestHeader &request,
+                                  const std::string &expression,
+                                  const double *xs);
+
+        int socket_;
+};
+
+#endif // EVAL_CLIENT_HPP
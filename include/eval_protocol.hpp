@@ -0,0 +1,87 @@
+#ifndef EVAL_PROTOCOL_HPP
+#define EVAL_PROTOCOL_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// Wire format of the evaluation server. Both ends run on the same machine,
+// so headers and values are native-endian.
+//
+// A request is an EvalRequestHeader, the expression text and, for VALUES
+// requests, count doubles. Large value arrays travel in a memfd passed with
+// the header instead of inline. A response is an EvalResponseHeader followed
+// by either the error message or count doubles, again in a memfd when large.
+
+struct EvalRequestHeader {
+        char magic[4];         // "TCRQ"
+        std::uint32_t kind;    // DOMAIN or VALUES
+        std::uint32_t flags;   // VALUES_IN_MEMFD
+        std::uint32_t expression_length;
+        std::uint64_t count;   // DOMAIN: intervals, VALUES: x values
+        double start;          // DOMAIN only
+        double end;            // DOMAIN only
+        char variable;
+        char reserved[7];
+
+        // count + 1 points over start:end
+        static const std::uint32_t DOMAIN = 0;
+        static const std::uint32_t VALUES = 1; // Caller supplied x values
+        static const std::uint32_t VALUES_IN_MEMFD = 1;
+};
+
+struct EvalResponseHeader {
+        char magic[4];        // "TCRS"
+        std::int32_t status;  // OK or ERROR
+        std::uint32_t flags;  // RESULTS_IN_MEMFD
+        std::uint32_t message_length;
+        std::uint64_t count;  // Number of y values
+
+        static const std::int32_t OK = 0;
+        static const std::int32_t ERROR = 1;
+        static const std::uint32_t RESULTS_IN_MEMFD = 1;
+};
+
+static_assert(sizeof(EvalRequestHeader) == 48, "Request header layout");
+static_assert(sizeof(EvalResponseHeader) == 24, "Response header layout");
+
+// Payloads at least this large go through shared memory
+const size_t SHARED_PAYLOAD_BYTES = 1 << 20;
+const size_t MAX_EXPRESSION_LENGTH = 4096;
+const std::uint64_t MAX_REQUEST_VALUES = std::uint64_t(1) << 28;
+
+// Sends all of data, attaching fd (when not -1) to the first byte
+void send_message(int socket, const void *data, size_t size, int fd = -1);
+
+// Receives exactly size bytes and any descriptor sent with them into fd
+// (-1 if none). Returns false if the peer closed before the first byte.
+bool receive_message(int socket, void *data, size_t size, int &fd);
+
+// A mapped memfd used to hand large arrays between processes
+class SharedBuffer {
+    public:
+        SharedBuffer();
+        ~SharedBuffer();
+        SharedBuffer(SharedBuffer &&other) noexcept;
+        SharedBuffer &operator=(SharedBuffer &&other) noexcept;
+        SharedBuffer(const SharedBuffer &) = delete;
+        SharedBuffer &operator=(const SharedBuffer &) = delete;
+
+        // Creates a new buffer of size bytes, sealed against resizing
+        static SharedBuffer create(size_t size);
+        // Maps a received descriptor, taking ownership of it; it must be
+        // sealed against shrinking
+        static SharedBuffer map(int fd, size_t size);
+
+        void *data() const;
+        size_t size() const;
+        int fd() const;
+
+    private:
+        void release();
+
+        int fd_;
+        void *data_;
+        size_t size_;
+};
+
+#endif // EVAL_PROTOCOL_HPP
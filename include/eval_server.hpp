@@ -0,0 +1,70 @@
+#ifndef EVAL_SERVER_HPP
+#define EVAL_SERVER_HPP
+
+#include "compiled_expression.hpp"
+#include "eval_protocol.hpp"
+#include "thread_pool.hpp"
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+// Compiled expressions keyed by variable and text. Lookups take a shared
+// lock, so concurrent hits never serialize; misses compile outside the lock.
+class ExpressionCache {
+    public:
+        explicit ExpressionCache(size_t capacity = DEFAULT_CAPACITY);
+
+        // Throws std::invalid_argument for an invalid expression or variable
+        std::shared_ptr<const CompiledExpression>
+        get(const std::string &expression, char variable);
+
+        size_t size() const;
+        size_t get_hits() const;
+        size_t get_misses() const;
+
+        static const size_t DEFAULT_CAPACITY = 1024;
+
+    private:
+        size_t capacity_;
+        mutable std::shared_mutex mutex_;
+        std::unordered_map<std::string,
+                           std::shared_ptr<const CompiledExpression>>
+            entries_;
+        std::deque<std::string> order_; // Insertion order, for eviction
+        std::atomic<size_t> hits_;
+        std::atomic<size_t> misses_;
+};
+
+// Serves evaluation requests (see eval_protocol.hpp) on a Unix domain
+// socket. Each connection is handled by one of a fixed set of workers and
+// may carry any number of requests; large requests are additionally split
+// across the shared pool.
+class EvaluationServer {
+    public:
+        EvaluationServer(const std::string &socket_path, unsigned workers);
+        ~EvaluationServer();
+
+        // Accepts connections until stop becomes true
+        void run(const std::atomic<bool> &stop);
+
+        const ExpressionCache &get_cache() const;
+        size_t get_requests() const;
+
+    private:
+        void serve_connection(int client);
+        // Returns false when the connection should be closed
+        bool handle_request(int client);
+        void send_error(int client, const std::string &message);
+
+        std::string socket_path_;
+        int listen_fd_;
+        std::atomic<bool> stopping_;
+        std::atomic<size_t> requests_;
+        ExpressionCache cache_;
+        ThreadPool workers_; // Declared last so it drains first
+};
+
+#endif // EVAL_SERVER_HPP
@@ -0,0 +1,71 @@
+#ifndef EXPORT_WRITER_HPP
+#define EXPORT_WRITER_HPP
+
+#include "sample_series.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Opens path for writing, truncating it, and returns the descriptor
+int open_output_file(const std::filesystem::path &path);
+
+// Writes all of data at offset, retrying short writes
+void pwrite_fully(int fd, const void *data, size_t size,
+                  std::uint64_t offset);
+
+// Writes all of data to a stream such as a pipe, retrying short writes
+void write_fully(int fd, const void *data, size_t size);
+
+// Size and timing of a completed export
+struct ExportStats {
+        size_t rows = 0;
+        size_t bytes = 0;
+        double seconds = 0.0;
+        double megabytes_per_second() const;
+};
+
+// Writes "x y" text rows, optionally followed by the y values of further
+// series on the same x values. Values are formatted with std::to_chars,
+// either shortest round-trip (precision 0) or with a fixed number of
+// significant digits, and row ranges are formatted in parallel.
+class TextExporter {
+    public:
+        explicit TextExporter(int precision = 0);
+
+        // Appends rows [begin, end) of series to out, each with the y
+        // values of columns appended
+        void format_rows(const SampleSeries &series, size_t begin, size_t end,
+                         std::string &out,
+                         const std::vector<const SampleSeries *> &columns =
+                             {}) const;
+
+        // Appends count values to out, one per line
+        void format_values(const double *values, size_t count,
+                           std::string &out) const;
+
+        ExportStats write(const std::filesystem::path &path,
+                          const SampleSeries &series,
+                          const std::vector<const SampleSeries *> &columns =
+                              {}) const;
+
+        // Formats the whole series as consecutive text blocks in parallel
+        std::vector<std::string>
+        format_blocks(const SampleSeries &series,
+                      const std::vector<const SampleSeries *> &columns =
+                          {}) const;
+
+        // Hands the blocks to fd in order with as few writev calls as
+        // possible, returning the number of bytes written
+        static size_t write_blocks(int fd, std::vector<std::string> &blocks);
+
+        static constexpr size_t MAX_ROW_LENGTH = 64;
+
+    private:
+        char *format_value(char *first, char *last, double value) const;
+
+        int precision_;
+};
+
+#endif // EXPORT_WRITER_HPP
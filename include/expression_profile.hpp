@@ -0,0 +1,47 @@
+#ifndef EXPRESSION_PROFILE_HPP
+#define EXPRESSION_PROFILE_HPP
+
+#include "compiled_expression.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One subexpression in a profile breakdown
+struct SubtermCost {
+        std::string label;
+        int depth = 0;          // 0 for the whole expression
+        size_t calls = 0;       // Samples evaluated by this node
+        double self_ns = 0.0;   // Time in this node's own operation
+        double total_ns = 0.0;  // Including its operands
+        std::uint64_t self_cycles = 0;
+};
+
+// Calls and time per node of a compiled expression, filled by
+// CompiledExpression::evaluate_profiled
+class ExpressionProfile {
+    public:
+        explicit ExpressionProfile(const CompiledExpression &expression);
+
+        void add(size_t slot, size_t calls, double ns, std::uint64_t cycles);
+
+        size_t get_samples() const;
+        double get_total_ns() const;
+
+        // Every subterm, root first, each followed by its operands
+        std::vector<SubtermCost> breakdown() const;
+
+        // One line per subterm: share of the total, share spent in the node
+        // itself, and the indented subterm, cut to width columns
+        std::vector<std::string> report(size_t width) const;
+
+    private:
+        void collect(int slot, int depth,
+                     std::vector<SubtermCost> &out) const;
+
+        const CompiledExpression &expression_;
+        std::vector<size_t> calls_;
+        std::vector<double> ns_;
+        std::vector<std::uint64_t> cycles_;
+};
+
+#endif // EXPRESSION_PROFILE_HPP
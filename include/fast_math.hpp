@@ -0,0 +1,46 @@
+#ifndef FAST_MATH_HPP
+#define FAST_MATH_HPP
+
+#include "compiled_expression.hpp"
+#include <cstddef>
+
+// Polynomial approximations of the elementary functions, for evaluating
+// plots where a value only has to pick a terminal row. Each reduces its
+// argument to a short interval with a few exact steps and evaluates a fixed
+// polynomial there, so there are no table lookups and no branches on the
+// common path; arguments outside the documented ranges fall back to libm.
+// Maximum errors against libm, as measured by calculator_bench's accuracy
+// report, are given per function (relative unless noted).
+
+// |x| <= 5e5, 3e-16 absolute; libm beyond
+double fast_sin(double x);
+// |x| <= 5e5, 3e-16 absolute; libm beyond. Relative error grows near the
+// zeros, to 1e-7 at the doubles closest to odd multiples of pi/2
+double fast_cos(double x);
+// |x| <= 5e5, 5e-16 outside 1e-3 of the poles; within that the reduced
+// argument's error dominates, up to 1e-7 at the doubles closest to a pole.
+// libm beyond 5e5
+double fast_tan(double x);
+// 9e-16
+double fast_arctan(double x);
+// 1.1e-15
+double fast_arcsin(double x);
+// 9e-16
+double fast_arccos(double x);
+// Normal positive x, 3e-16; libm otherwise
+double fast_ln(double x);
+// Normal positive x, 3e-16; libm otherwise
+double fast_log(double x);
+// Whole exponents up to 16 by multiplication; positive bases with
+// |b * ln(a)| <= 708 as exp(b * ln(a)), 2e-16 * (1 + |b * ln(a)|); libm
+// otherwise
+double fast_pow(double a, double b);
+
+// Runs op over count lanes with the approximations above where it has one;
+// returns false, writing nothing, for the operations it leaves to libm
+bool apply_fast_operation(OpCode op, const double *a, const double *b,
+                          double *out, size_t count);
+bool apply_fast_operation(OpCode op, const float *a, const float *b,
+                          float *out, size_t count);
+
+#endif // FAST_MATH_HPP
@@ -0,0 +1,77 @@
+#ifndef FEATURE_FINDER_HPP
+#define FEATURE_FINDER_HPP
+
+#include "sample_series.hpp"
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+enum class FeatureKind { Root, Minimum, Maximum, Intersection };
+
+// A refined point of interest of a function
+struct Feature {
+        FeatureKind kind;
+        double x;
+        double y;
+        size_t other = 0; // Function crossed, for intersections
+};
+
+// Finds the roots, extrema and intersections of a sampled function. A
+// parallel scan over the samples brackets every sign change of the values,
+// of their differences or of the gap to another function, and each bracket
+// is refined with Brent's method against the function itself, so only
+// points near candidates are evaluated again.
+class FeatureFinder {
+    public:
+        // Value at one point; called from pool threads, so it must be
+        // thread-safe
+        using Evaluator = std::function<double(double)>;
+
+        // samples holds function on a grid; slope is its derivative
+        FeatureFinder(const SampleSeries &samples, Evaluator function,
+                      Evaluator slope);
+
+        void find_roots();
+        void find_extrema();
+        // Crossings with function index, sampled on the same grid in
+        // other_samples
+        void find_intersections(const SampleSeries &other_samples,
+                                Evaluator other, size_t index);
+
+        const std::vector<Feature> &get_features() const; // Sorted by x
+        size_t get_evaluations() const; // Spent refining
+        bool is_truncated() const;      // More than MAX_FEATURES of a kind
+
+        // A summary line, then one line per feature cut to width columns
+        std::vector<std::string> report(size_t width) const;
+
+        // Zero of f in [a, b] by Brent's method, given fa and fb of opposite
+        // sign; adds the evaluations it makes to evaluations
+        static double brent(const Evaluator &f, double a, double b, double fa,
+                            double fb, size_t &evaluations);
+
+        static constexpr size_t MAX_FEATURES = 1000; // Per kind
+        static constexpr size_t SCAN_CHUNK = 4096;
+        static constexpr int MAX_ITERATIONS = 100;
+
+    private:
+        // Indices i in [begin, end) where found(i), in order
+        std::vector<size_t>
+        scan(size_t begin, size_t end,
+             const std::function<bool(size_t)> &found) const;
+        // Refines every candidate with refine_one, which returns false to
+        // drop it, and appends the kept features
+        void refine(const std::vector<size_t> &candidates,
+                    const std::function<bool(size_t, Feature &, size_t &)>
+                        &refine_one);
+
+        const SampleSeries &samples_;
+        Evaluator function_;
+        Evaluator slope_;
+        std::vector<Feature> features_;
+        size_t evaluations_ = 0;
+        bool truncated_ = false;
+};
+
+#endif // FEATURE_FINDER_HPP
@@ -0,0 +1,39 @@
+#ifndef FUSED_EXPRESSIONS_HPP
+#define FUSED_EXPRESSIONS_HPP
+
+#include "compiled_expression.hpp"
+#include <cstddef>
+#include <vector>
+
+// Several compiled expressions merged into one instruction tape, so they are
+// evaluated in a single pass over x. Identical subexpressions (the variable,
+// equal constants, sin(x) used by two functions, ...) are computed once per
+// batch and shared by every function that uses them.
+class FusedExpressions {
+    public:
+        FusedExpressions();
+        explicit FusedExpressions(
+            const std::vector<const CompiledExpression *> &functions);
+
+        bool empty() const;
+        size_t get_function_count() const;
+        size_t size() const; // Instructions left after sharing
+        size_t get_shared_count() const; // Instructions sharing removed
+
+        // ys[k][i] receives function k at x[i]; thread-safe
+        void evaluate(const double *x, double *const *ys, size_t count,
+                      MathTier tier = MathTier::Exact) const;
+        void evaluate(const float *x, float *const *ys, size_t count,
+                      MathTier tier = MathTier::Exact) const;
+
+    private:
+        template <typename T>
+        void evaluate_lanes(const T *x, T *const *ys, size_t count,
+                            MathTier tier) const;
+
+        std::vector<Instruction> instructions_;
+        std::vector<int> outputs_; // Result slot of every function
+        size_t shared_count_ = 0;
+};
+
+#endif // FUSED_EXPRESSIONS_HPP
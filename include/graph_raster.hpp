@@ -0,0 +1,49 @@
+#ifndef GRAPH_RASTER_HPP
+#define GRAPH_RASTER_HPP
+
+#include "sample_series.hpp"
+#include <vector>
+
+// Character cells of the plot area inside the graph's inner box, filled
+// without touching ncurses. Cell (0, 0) is the inner box's top-left corner
+// and rows grow downwards; only the interior (the box edges excluded) is
+// ever plotted.
+class GraphRaster {
+    public:
+        GraphRaster(int width, int height, double min_x, double max_x,
+                    double min_y, double max_y);
+
+        int get_width() const;
+        int get_height() const;
+
+        int column_of(double x) const;
+        int row_of(double y) const;
+
+        // Marks every finite in-window point of series with glyph; later
+        // calls draw over earlier ones
+        void plot(const SampleSeries &series, char glyph);
+        // Connects consecutive finite points of series with straight runs
+        // of glyph, clipped to the window; a non-finite point breaks the line
+        void plot_lines(const SampleSeries &series, char glyph);
+        void clear();
+
+        // 0 for an empty cell
+        char at(int row, int column) const;
+        size_t count_filled() const;
+
+    private:
+        void draw_segment(double x0, double y0, double x1, double y1,
+                          char glyph);
+
+        int width_;
+        int height_;
+        double min_x_;
+        double max_x_;
+        double min_y_;
+        double max_y_;
+        double x_range_;
+        double y_range_;
+        std::vector<char> cells_; // (height_ + 1) rows of (width_ + 1)
+};
+
+#endif // GRAPH_RASTER_HPP
@@ -0,0 +1,44 @@
+#ifndef HOISTED_EXPRESSION_HPP
+#define HOISTED_EXPRESSION_HPP
+
+#include "compiled_expression.hpp"
+#include <cstddef>
+#include <vector>
+
+// A compiled f(x, t) split by what each instruction depends on, for
+// evaluating the same x values at many t. Instructions on x alone run once
+// per set_x, instructions on t alone run once per frame as scalars, and
+// only the ones on both run per x value every frame.
+class HoistedExpression {
+    public:
+        HoistedExpression();
+        explicit HoistedExpression(const CompiledExpression &expression);
+
+        // Fixes the x values and evaluates everything that depends on x only
+        void set_x(const double *x, size_t count);
+        // out[i] = f(x[i], t) for the x values of the last set_x
+        void evaluate(double t, double *out);
+
+        size_t size() const; // x values
+        size_t get_hoisted_count() const;   // Instructions run per set_x
+        size_t get_per_frame_count() const; // Instructions run per frame
+        size_t get_per_value_count() const; // Instructions run per x value
+
+    private:
+        // Bit set of the inputs an instruction's result depends on
+        enum Dependence : unsigned char { NONE = 0, ON_X = 1, ON_T = 2 };
+
+        const double *operand(int slot, size_t begin);
+        void broadcast(int slot, double value);
+
+        std::vector<Instruction> instructions_;
+        std::vector<unsigned char> dependence_;
+        std::vector<int> column_;      // Slot's column in x_values_, or -1
+        std::vector<double> x_values_; // Columns of count_ values per slot
+        std::vector<double> scalars_;  // Values of the slots without x
+        std::vector<double> lanes_;    // BATCH_SIZE lanes per slot
+        size_t count_ = 0;
+        size_t x_columns_ = 0;
+};
+
+#endif // HOISTED_EXPRESSION_HPP
@@ -0,0 +1,50 @@
+#ifndef PIPE_FILTER_HPP
+#define PIPE_FILTER_HPP
+
+#include "compiled_expression.hpp"
+#include "export_writer.hpp"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Encoding of the values on either side of the filter
+enum class PipeFormat { Text, Binary };
+
+// Evaluates an expression for arbitrary x values read from a descriptor and
+// writes one y per x, in order, to another:
+//   Text   - whitespace separated numbers in, one number per line out
+//   Binary - native-endian doubles
+// Whatever a read returns is parsed, evaluated in batches and written out
+// before the next read, so memory stays bounded and a slow consumer simply
+// blocks the producer.
+class PipeFilter {
+    public:
+        PipeFilter(const CompiledExpression &expression, PipeFormat input,
+                   PipeFormat output, int precision = 0);
+
+        ExportStats run(int in_fd, int out_fd);
+
+        static const size_t READ_SIZE = 1 << 20; // Bytes per read
+
+    private:
+        // Reads once and appends the complete values to xs_; false at EOF
+        bool read_text(int fd);
+        bool read_binary(int fd);
+        void evaluate_and_write(int fd);
+
+        const CompiledExpression &expression_;
+        PipeFormat input_;
+        PipeFormat output_;
+        TextExporter formatter_;
+        std::string pending_;        // Unparsed input carried between reads
+        std::vector<double> xs_;
+        std::vector<double> ys_;
+        std::string text_;
+        ExportStats stats_;
+};
+
+// Parses "txt", "bin", or "IN:OUT" such as "txt:bin"
+void parse_pipe_formats(const std::string &value, PipeFormat &input,
+                        PipeFormat &output);
+
+#endif // PIPE_FILTER_HPP
@@ -0,0 +1,62 @@
+#ifndef QUADRATURE_HPP
+#define QUADRATURE_HPP
+
+#include <cstddef>
+#include <functional>
+#include <limits>
+
+// Integral of a function over [a, b] with what it cost and how it ended
+struct QuadratureResult {
+        double value = 0.0;
+        double error = 0.0; // Estimated absolute error
+        size_t evaluations = 0;
+        size_t intervals = 0; // In the final partition
+        // Every interval met its share of the tolerance, or the error
+        // rounding leaves in it
+        bool converged = false;
+        bool finite = true; // False when f was NaN or infinite somewhere
+        // First non-finite point, or the centre of the interval with the
+        // largest error left when not converged
+        double trouble_x = std::numeric_limits<double>::quiet_NaN();
+};
+
+// Running sum with Kahan-Babuska compensation, so adding thousands of
+// interval contributions of mixed sign loses no more than one rounding
+struct CompensatedSum {
+        double sum = 0.0;
+        double compensation = 0.0;
+
+        void add(double value);
+        void merge(const CompensatedSum &other);
+        double get() const;
+};
+
+// Adaptive Gauss-Kronrod quadrature (7-point Gauss, 15-point Kronrod). Work
+// proceeds in rounds: the 15 nodes of every interval still open are
+// evaluated in batch calls spread over the thread pool, intervals whose
+// error fits their share of the tolerance (in proportion to their width)
+// are accepted into a compensated sum, and the rest are bisected for the
+// next round.
+class Quadrature {
+    public:
+        // Fills y for count x values; called from pool threads, so it must
+        // be thread-safe
+        using Evaluator =
+            std::function<void(const double *x, double *y, size_t count)>;
+
+        explicit Quadrature(Evaluator evaluator);
+
+        // tolerance is the absolute error allowed over the whole of [a, b]
+        QuadratureResult integrate(double a, double b, double tolerance) const;
+
+        static constexpr size_t NODES = 15;            // Per interval
+        static constexpr size_t INITIAL_INTERVALS = 16;
+        static constexpr size_t MAX_INTERVALS = 1 << 16; // Open at once
+        static constexpr int MAX_ROUNDS = 60;
+        static constexpr size_t CHUNK_INTERVALS = 32; // Per batch call
+
+    private:
+        Evaluator evaluator_;
+};
+
+#endif // QUADRATURE_HPP
@@ -0,0 +1,31 @@
+#ifndef SAMPLE_GRID_HPP
+#define SAMPLE_GRID_HPP
+
+#include <cstddef>
+#include <vector>
+
+// Uniform grid of sample positions over an integer domain, including both
+// endpoints: x_i = start + i * step, step = (end - start) / num_samples
+class SampleGrid {
+    public:
+        SampleGrid();
+        SampleGrid(int start, int end, int num_samples);
+
+        int get_start() const;
+        int get_end() const;
+        int get_num_samples() const;
+        double get_step() const;
+        size_t size() const;
+        double x_at(size_t index) const;
+
+        // For every point of this grid, the index of the exactly coincident
+        // point in the previous grid, or -1 if it has to be evaluated
+        std::vector<long> map_onto(const SampleGrid &previous) const;
+
+    private:
+        int start_;
+        int end_;
+        int num_samples_;
+};
+
+#endif // SAMPLE_GRID_HPP
@@ -0,0 +1,97 @@
+#ifndef SAMPLE_SERIES_HPP
+#define SAMPLE_SERIES_HPP
+
+#include <cstddef>
+#include <limits>
+#include <new>
+#include <vector>
+
+// Allocator that places every column on its own cache line so that scans
+// over x or y start on a vector-friendly boundary
+template <typename T, size_t Alignment = 64> class AlignedAllocator {
+    public:
+        using value_type = T;
+
+        template <typename U> struct rebind {
+                using other = AlignedAllocator<U, Alignment>;
+        };
+
+        AlignedAllocator() noexcept = default;
+        template <typename U>
+        AlignedAllocator(const AlignedAllocator<U, Alignment> &) noexcept {}
+
+        T *allocate(size_t n) {
+            return static_cast<T *>(
+                ::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+        }
+        void deallocate(T *p, size_t) noexcept {
+            ::operator delete(p, std::align_val_t(Alignment));
+        }
+
+        template <typename U>
+        bool operator==(const AlignedAllocator<U, Alignment> &) const noexcept {
+            return true;
+        }
+};
+
+template <typename T> using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+// Smallest and largest finite value of a column
+struct ValueRange {
+        double min = std::numeric_limits<double>::infinity();
+        double max = -std::numeric_limits<double>::infinity();
+        bool empty() const { return min > max; }
+};
+
+// How a series stores y. Float32 is for plotting: half the memory of a
+// run, and the evaluator fits twice the lanes in a vector register.
+enum class Precision { Float64, Float32 };
+
+// Struct-of-arrays storage for evaluated samples. Uniform runs keep x
+// implicit (start + i * step) and only store the y column, as doubles or,
+// for a uniform series made float32, as floats; y() reads either.
+class SampleSeries {
+    public:
+        SampleSeries(); // Explicit x
+        SampleSeries(double start, double step, size_t size,
+                     Precision precision = Precision::Float64); // Uniform x
+
+        bool is_uniform() const;
+        Precision get_precision() const;
+        double get_start() const;
+        double get_step() const;
+        size_t size() const;
+        bool empty() const;
+
+        double x(size_t index) const;
+        double y(size_t index) const;
+        double *y_data(); // Empty for a float32 series
+        const double *y_data() const;
+        float *y32_data(); // Empty for a float64 series
+        const float *y32_data() const;
+        const double *x_data() const; // nullptr when x is implicit
+
+        void assign_uniform(double start, double step, size_t size);
+        void reserve(size_t capacity);
+        void resize(size_t size);
+        void clear();
+        void set_y(size_t index, double value);
+        void append(double y);           // Uniform series
+        void append(double x, double y); // Explicit series
+
+        ValueRange y_range() const;
+        size_t count_nan() const;
+        size_t count_inf() const;
+        size_t memory_bytes() const;
+
+    private:
+        bool uniform_;
+        Precision precision_ = Precision::Float64;
+        double start_;
+        double step_;
+        AlignedVector<double> x_;
+        AlignedVector<double> y_;
+        AlignedVector<float> y32_;
+};
+
+#endif // SAMPLE_SERIES_HPP
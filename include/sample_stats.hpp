@@ -0,0 +1,66 @@
+#ifndef SAMPLE_STATS_HPP
+#define SAMPLE_STATS_HPP
+
+#include "sample_series.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Summary of evaluated values gathered while they are produced. Each range
+// of a parallel pass fills its own SampleStats and the partials are merged
+// afterwards, so the results are never scanned again. Percentiles come from
+// a histogram with BUCKETS_PER_OCTAVE buckets between successive powers of
+// two, which keeps them within a few percent of the exact value at any
+// magnitude and makes partials mergeable by adding counts.
+class SampleStats {
+    public:
+        void add(double value);
+        void add(const double *values, size_t count);
+        void add(const float *values, size_t count);
+        void merge(const SampleStats &other);
+
+        size_t get_count() const; // Finite or not
+        size_t get_finite() const;
+        size_t get_nan() const;
+        size_t get_inf() const;
+        double get_min() const; // Of the finite values
+        double get_max() const;
+        double get_mean() const;
+        // Value below which a fraction p of the finite values lie; NaN when
+        // there are none
+        double percentile(double p) const;
+
+        // Range to plot the values in: their extent, cut at Tukey's outer
+        // fences (FENCE interquartile ranges beyond the quartiles) so a
+        // pole or a few huge values do not flatten everything else, with a
+        // margin either side
+        ValueRange fit_range() const;
+
+        static constexpr int MANTISSA_BITS = 4; // Picking the bucket
+        static constexpr int BUCKETS_PER_OCTAVE = 1 << MANTISSA_BITS;
+        static constexpr int MIN_EXPONENT = -64; // Smaller counts as zero
+        static constexpr int MAX_EXPONENT = 64;  // Larger goes in the top
+        static constexpr double FENCE = 3.0;
+        static constexpr double MARGIN = 0.05; // Of the range, either side
+
+    private:
+        template <typename T> void add_values(const T *values, size_t count);
+
+        static constexpr size_t SIDE =
+            (MAX_EXPONENT - MIN_EXPONENT) * BUCKETS_PER_OCTAVE;
+        static constexpr size_t BUCKETS = 2 * SIDE + 1; // Both signs, zero
+        static size_t bucket_of(double value);
+        // Smallest magnitude of an offset into one side
+        static double magnitude_of(size_t offset);
+
+        std::vector<uint64_t> histogram_; // Allocated by the first add
+        size_t finite_ = 0;
+        size_t nan_ = 0;
+        size_t inf_ = 0;
+        double sum_ = 0.0;
+        double min_ = std::numeric_limits<double>::infinity();
+        double max_ = -std::numeric_limits<double>::infinity();
+};
+
+#endif // SAMPLE_STATS_HPP
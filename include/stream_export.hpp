@@ -0,0 +1,75 @@
+#ifndef STREAM_EXPORT_HPP
+#define STREAM_EXPORT_HPP
+
+#include "analysis_parameters.hpp"
+#include "export_writer.hpp"
+#include "sample_series.hpp"
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <memory>
+
+// Receives consecutive chunks of a streamed run on the writer thread
+class ChunkSink {
+    public:
+        virtual ~ChunkSink() = default;
+        virtual void write_chunk(const SampleSeries &chunk) = 0;
+        virtual void finish() = 0;
+        virtual size_t bytes_written() const = 0;
+};
+
+// Streams chunks to a text file in the same format as TextExporter
+class TextChunkSink : public ChunkSink {
+    public:
+        TextChunkSink(const std::filesystem::path &path,
+                      const TextExporter &exporter);
+        ~TextChunkSink() override;
+
+        void write_chunk(const SampleSeries &chunk) override;
+        void finish() override;
+        size_t bytes_written() const override;
+
+    private:
+        int fd_;
+        TextExporter exporter_;
+        size_t bytes_;
+};
+
+// File formats a streamed run can be written in
+enum class ExportFormat { Text, Binary, Archive };
+
+// File extension, including the dot, used for a format
+std::string extension_for(ExportFormat format);
+
+// Creates the sink that writes a stream of num_samples intervals over the
+// current domain of params in the given format
+std::unique_ptr<ChunkSink> make_chunk_sink(ExportFormat format,
+                                           const std::filesystem::path &path,
+                                           const AnalysisParameters &params,
+                                           long long num_samples);
+
+// Evaluates the current expression over a uniform grid of any size in fixed
+// size chunks. Two chunk buffers form a ring: while a writer thread hands
+// one to the sink the other is being evaluated, so memory stays constant
+// no matter how many samples are requested.
+class StreamExporter {
+    public:
+        explicit StreamExporter(AnalysisParameters &params,
+                                size_t chunk_size = DEFAULT_CHUNK_SIZE);
+
+        // Streams num_samples intervals (num_samples + 1 points) over the
+        // current domain. progress is called on the calling thread with the
+        // fraction completed after each chunk.
+        ExportStats run(long long num_samples, ChunkSink &sink,
+                        const std::function<void(double)> &progress = {});
+
+        static const size_t DEFAULT_CHUNK_SIZE = 1 << 16;
+
+    private:
+        void evaluate_chunk(SampleSeries &chunk);
+
+        AnalysisParameters &parameters;
+        size_t chunk_size_;
+};
+
+#endif // STREAM_EXPORT_HPP
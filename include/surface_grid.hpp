@@ -0,0 +1,52 @@
+#ifndef SURFACE_GRID_HPP
+#define SURFACE_GRID_HPP
+
+#include "compiled_expression.hpp"
+#include "sample_series.hpp"
+#include <cstddef>
+
+// Values of a surface f(x, y) on a columns x rows grid spanning
+// [min_x, max_x] x [min_y, max_y], both ends included. Values are stored
+// row-major with row 0 at max_y, the way the terminal shows them.
+class SurfaceGrid {
+    public:
+        SurfaceGrid();
+        SurfaceGrid(size_t columns, size_t rows, double min_x, double max_x,
+                    double min_y, double max_y);
+
+        size_t get_columns() const;
+        size_t get_rows() const;
+        double get_min_x() const;
+        double get_max_x() const;
+        double get_min_y() const;
+        double get_max_y() const;
+        size_t size() const;
+        bool empty() const;
+
+        double x_at(size_t column) const;
+        double y_at(size_t row) const;
+        double at(size_t row, size_t column) const;
+        const double *data() const;
+
+        // Finite values only; empty when there are none
+        ValueRange range() const;
+        size_t memory_bytes() const;
+
+        // Fills the grid tile by tile across the thread pool; each tile's
+        // inputs and result fit in the per-core cache
+        void evaluate(const CompiledExpression &surface);
+
+        static constexpr size_t TILE_COLUMNS = 64;
+        static constexpr size_t TILE_ROWS = 16;
+
+    private:
+        size_t columns_;
+        size_t rows_;
+        double min_x_;
+        double max_x_;
+        double min_y_;
+        double max_y_;
+        AlignedVector<double> values_;
+};
+
+#endif // SURFACE_GRID_HPP
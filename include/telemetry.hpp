@@ -0,0 +1,91 @@
+#ifndef TELEMETRY_HPP
+#define TELEMETRY_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+
+// Pipeline stages timed for the telemetry overlay
+enum class TelemetryStage { Parse, Evaluate, Render, Export, Count };
+
+struct StageTiming {
+        double last_seconds = 0.0;
+        double total_seconds = 0.0;
+        size_t calls = 0;
+};
+
+// Process-wide counters behind the TUI's telemetry overlay. Stages can be
+// recorded from any thread (the evaluation server parses on its workers).
+class Telemetry {
+    public:
+        static Telemetry &instance();
+
+        void record(TelemetryStage stage, double seconds);
+        StageTiming get_timing(TelemetryStage stage) const;
+
+        // Outcome of the last run over the sample grid
+        void record_samples(size_t evaluated, size_t reused, size_t nan,
+                            size_t inf);
+        void record_memory(size_t bytes); // Keeps the peak as well
+
+        size_t get_evaluated() const;
+        size_t get_reused() const;
+        size_t get_nan() const;
+        size_t get_inf() const;
+        size_t get_memory() const;
+        size_t get_peak_memory() const;
+
+        static const char *stage_name(TelemetryStage stage);
+
+    private:
+        Telemetry();
+
+        mutable std::mutex mutex_;
+        StageTiming timings_[static_cast<int>(TelemetryStage::Count)];
+        size_t evaluated_;
+        size_t reused_;
+        size_t nan_;
+        size_t inf_;
+        size_t memory_;
+        size_t peak_memory_;
+};
+
+// Records the time from construction to stop() or destruction
+class ScopedTimer {
+    public:
+        explicit ScopedTimer(TelemetryStage stage);
+        ~ScopedTimer();
+
+        ScopedTimer(const ScopedTimer &) = delete;
+        ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+        void stop();
+
+    private:
+        TelemetryStage stage_;
+        std::chrono::steady_clock::time_point started_;
+        bool running_;
+};
+
+// The macros are the only way the pipeline touches telemetry, so building
+// without CALCULATOR_TELEMETRY leaves no timer code behind (arguments are
+// not evaluated either)
+#ifdef CALCULATOR_TELEMETRY
+#define TELEMETRY_CONCAT_(a, b) a##b
+#define TELEMETRY_CONCAT(a, b) TELEMETRY_CONCAT_(a, b)
+#define TELEMETRY_SCOPE(stage)                                                 \
+    ScopedTimer TELEMETRY_CONCAT(telemetry_scope_, __LINE__)(stage)
+#define TELEMETRY_TIMER(name, stage) ScopedTimer name(stage)
+#define TELEMETRY_STOP(name) name.stop()
+#define TELEMETRY_SAMPLES(evaluated, reused, nan, inf)                         \
+    Telemetry::instance().record_samples(evaluated, reused, nan, inf)
+#define TELEMETRY_MEMORY(bytes) Telemetry::instance().record_memory(bytes)
+#else
+#define TELEMETRY_SCOPE(stage) ((void)0)
+#define TELEMETRY_TIMER(name, stage) ((void)0)
+#define TELEMETRY_STOP(name) ((void)0)
+#define TELEMETRY_SAMPLES(evaluated, reused, nan, inf) ((void)0)
+#define TELEMETRY_MEMORY(bytes) ((void)0)
+#endif
+
+#endif // TELEMETRY_HPP
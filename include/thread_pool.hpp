@@ -0,0 +1,42 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads shared by the parallel passes of the program
+class ThreadPool {
+    public:
+        explicit ThreadPool(unsigned num_threads);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        static ThreadPool &shared(); // One worker per hardware thread
+
+        unsigned size() const;
+        void submit(std::function<void()> task);
+
+        // Splits [0, count) into ranges of at least min_chunk items and runs
+        // fn(begin, end) on each. The caller works through ranges too, so it
+        // is safe to call from inside a pool task.
+        void parallel_for(size_t count, size_t min_chunk,
+                          const std::function<void(size_t, size_t)> &fn);
+
+    private:
+        void worker_loop();
+
+        std::vector<std::thread> workers_;
+        std::queue<std::function<void()>> tasks_;
+        std::mutex mutex_;
+        std::condition_variable condition_;
+        bool stopping_;
+};
+
+#endif // THREAD_POOL_HPP
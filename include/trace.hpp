@@ -0,0 +1,117 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// One completed span. Names and categories must be string literals so
+// recording never allocates.
+struct TraceEvent {
+        const char *name;
+        const char *category;
+        std::uint64_t start_ns; // Since the tracer's epoch
+        std::uint64_t duration_ns;
+        std::uint64_t items; // Samples, bytes, ... (0 = none)
+};
+
+// Fixed-size event ring owned by one thread. Only the owner writes, so
+// recording is a plain store plus a release increment; a flush copies the
+// newest events and drops any the owner overwrote while it was copying.
+class TraceRing {
+    public:
+        TraceRing(std::uint32_t thread_id, std::string thread_name);
+
+        void push(const TraceEvent &event);
+        std::vector<TraceEvent> snapshot() const;
+
+        std::uint32_t get_thread_id() const;
+        const std::string &get_thread_name() const;
+        void set_thread_name(std::string name);
+
+        static const size_t CAPACITY = 1 << 15;
+
+    private:
+        std::vector<TraceEvent> events_;
+        std::atomic<std::uint64_t> head_; // Events ever pushed
+        std::uint32_t thread_id_;
+        std::string thread_name_;
+};
+
+// Collects spans from every thread into Chrome trace-event JSON, which
+// chrome://tracing and ui.perfetto.dev open directly. Recording is off until
+// start() and costs one relaxed load per span while off.
+class Tracer {
+    public:
+        static Tracer &instance();
+
+        void start();
+        void stop();
+        bool is_enabled() const;
+        std::uint64_t now_ns() const;
+
+        void record(const char *name, const char *category,
+                    std::uint64_t start_ns, std::uint64_t items);
+        // Names the calling thread in the trace; cheap until it records
+        void set_thread_name(const char *name);
+
+        // Writes every recorded span and returns how many were written
+        size_t write(const std::filesystem::path &path) const;
+
+    private:
+        Tracer();
+        TraceRing &ring_for_thread();
+
+        std::atomic<bool> enabled_;
+        std::chrono::steady_clock::time_point epoch_;
+        mutable std::mutex mutex_; // Guards rings_, touched once per thread
+        std::vector<std::shared_ptr<TraceRing>> rings_;
+};
+
+// Records the time from construction to destruction as one span
+class TraceSpan {
+    public:
+        TraceSpan(const char *name, const char *category,
+                  std::uint64_t items = 0);
+        ~TraceSpan();
+
+        TraceSpan(const TraceSpan &) = delete;
+        TraceSpan &operator=(const TraceSpan &) = delete;
+
+        void set_items(std::uint64_t items);
+        void end(); // Records now instead of at destruction
+
+    private:
+        const char *name_;
+        const char *category_;
+        std::uint64_t start_ns_;
+        std::uint64_t items_;
+        bool active_;
+};
+
+// Like the telemetry timers, spans only exist in CALCULATOR_TELEMETRY builds
+#ifdef CALCULATOR_TELEMETRY
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SPAN(name, category)                                             \
+    TraceSpan TRACE_CONCAT(trace_span_, __LINE__)(name, category)
+#define TRACE_SPAN_ITEMS(name, category, items)                                \
+    TraceSpan TRACE_CONCAT(trace_span_, __LINE__)(name, category, items)
+#define TRACE_SPAN_NAMED(variable, name, category)                             \
+    TraceSpan variable(name, category)
+#define TRACE_END(variable) variable.end()
+#define TRACE_THREAD_NAME(name) Tracer::instance().set_thread_name(name)
+#else
+#define TRACE_SPAN(name, category) ((void)0)
+#define TRACE_SPAN_ITEMS(name, category, items) ((void)0)
+#define TRACE_SPAN_NAMED(variable, name, category) ((void)0)
+#define TRACE_END(variable) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#endif
+
+#endif // TRACE_HPP
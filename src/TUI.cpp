@@ -1,21 +1,70 @@
 #include "TUI.hpp"
+#include "binary_export.hpp"
+#include "compressed_archive.hpp"
+#include "curve_sampler.hpp"
+#include "export_writer.hpp"
+#include "expression_profile.hpp"
+#include "graph_raster.hpp"
+#include "hoisted_expression.hpp"
+#include "quadrature.hpp"
+#include "stream_export.hpp"
+#include "telemetry.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include <algorithm>
 #include <cctype>
+#include <chrono>
 #include <cmath>
+#include <cstdio>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <ncurses.h>
 #include <sstream>
 #include <string>
 
 constexpr int STATUS_WINDOW_WIDTH = 85;
 
+// Marker and color of every plotted function, f1 first; the color pairs
+// start at FUNCTION_COLOR_PAIR
+constexpr char FUNCTION_GLYPHS[] = "*+#@%";
+constexpr short FUNCTION_COLORS[] = {COLOR_GREEN, COLOR_YELLOW, COLOR_CYAN,
+                                     COLOR_MAGENTA, COLOR_RED};
+constexpr short FUNCTION_COLOR_PAIR = 2;
+
+// Heatmap shades from low to high; the ten shades share five colors
+constexpr char HEATMAP_SHADES[] = " .:-=+*#%@";
+constexpr short HEATMAP_COLORS[] = {COLOR_BLUE, COLOR_CYAN, COLOR_GREEN,
+                                    COLOR_YELLOW, COLOR_RED};
+constexpr short HEATMAP_COLOR_PAIR =
+    FUNCTION_COLOR_PAIR + AnalysisParameters::MAX_FUNCTIONS;
+
+// Markers of f1's first and second derivative, in color pairs after the
+// heatmap's
+constexpr char DERIVATIVE_GLYPHS[] = "'\"";
+constexpr short DERIVATIVE_COLORS[] = {COLOR_BLUE, COLOR_WHITE};
+constexpr short DERIVATIVE_COLOR_PAIR =
+    HEATMAP_COLOR_PAIR + sizeof(HEATMAP_COLORS) / sizeof(HEATMAP_COLORS[0]);
+
+// Markers of f1's roots, minima, maxima and crossings, in FeatureKind order
+constexpr char FEATURE_GLYPHS[] = "Ov^X";
+
+// Frame rate the animation aims for and the time one sweep of the parameter
+// range takes
+constexpr int ANIMATION_FPS = 30;
+constexpr double ANIMATION_SWEEP_SECONDS = 4.0;
+
+// Error the graph's surrogates are fitted to, relative to |f| where that is
+// above 1
+constexpr double SURROGATE_TOLERANCE = 1e-10;
+
 TUI::TUI() : highlighted_item(0), parameters(-100, 100, 10000), help_page(0) {
     menu_window = nullptr;
     status_window = nullptr;
     graph_window = nullptr;
     help_menu_window = nullptr;
-    help_total_pages = 9;
+    help_total_pages = 22;
     help_pages = {
         "\n"
         "Welcome to the TUI Graphing Calculator help menu.\n"
@@ -71,7 +120,9 @@ TUI::TUI() : highlighted_item(0), parameters(-100, 100, 10000), help_page(0) {
         "   If the user pressed 'G', they will be taken to a window showing a\n"
         "   graphical representation of the expression. The default window "
         "size\n"
-        "   for the graph is [-10, 10] horizontally, and [-5, 5] vertically.\n"
+        "   for the graph is [-10, 10] horizontally; vertically it is fitted\n"
+        "   to the functions, from statistics gathered while they are\n"
+        "   evaluated, with poles and other outliers cut off.\n"
         "   The user can press 'W' to change the window size, they will be "
         "prompted\n"
         "   to enter new values for the window size. These are limited to "
@@ -80,10 +131,133 @@ TUI::TUI() : highlighted_item(0), parameters(-100, 100, 10000), help_page(0) {
         "   minimums must be less than the maximums. If the user enters "
         "incorrect\n"
         "   parameters, they will be prompted to re-enter correct parameters.\n"
+        "   'F' fits the vertical range to the functions again.\n"
         "   When in the graph view, the user can press 'B' where they will "
         "return\n"
         "   back to the initial menu that appears when the users selects run\n",
 
+        "\n"
+        "1. Run: Export Formats\n"
+        "\n"
+        "   Values are written with the shortest text that reads back to the\n"
+        "   exact same number. Pressing 'P' lets the user instead choose a\n"
+        "   fixed number of significant digits (1 to 17), or 0 to return to\n"
+        "   the shortest form.\n"
+        "\n"
+        "   Pressing 'S' streams a much larger export, up to 1e10 samples,\n"
+        "   straight to a file. The expression is evaluated in chunks while\n"
+        "   earlier chunks are written, so memory use does not grow with the\n"
+        "   number of samples. The count may be entered as e.g. 1e8.\n"
+        "\n"
+        "   Pressing 'X' saves the run in a compact binary format (float64\n"
+        "   or float32 columns) that other tools can map without parsing.\n"
+        "   'L' loads such a file and overlays it on the graph with 'o'\n"
+        "   markers; 'C' in the graph view clears the comparison.\n"
+        "   Pressing 'Z' saves a losslessly compressed archive (.gor), which\n"
+        "   can also be loaded with 'L'. Streams can be written as text,\n"
+        "   binary or compressed archives.\n",
+
+        "\n"
+        "1. Run: Telemetry\n"
+        "\n"
+        "   Pressing 'T' on the run screen, or in the graph view, toggles a\n"
+        "   telemetry overlay with the time of the last parse, evaluation,\n"
+        "   graph render and export, the evaluation rate in samples per\n"
+        "   second, how many samples were reused from the previous run, the\n"
+        "   NaN and infinity counts, and the current and peak memory held by\n"
+        "   the results.\n"
+        "\n"
+        "   Pressing 'R' starts recording a trace of everything that follows\n"
+        "   (parsing, each evaluation chunk per thread, rendering and file\n"
+        "   writes); pressing it again saves the trace as JSON for\n"
+        "   chrome://tracing or ui.perfetto.dev. A trace still recording at\n"
+        "   exit is saved as calculator_trace.json in the export directory.\n"
+        "   Builds configured with -DCALCULATOR_TELEMETRY=OFF contain neither\n"
+        "   the timers nor the tracer.\n"
+        "\n"
+        "   Pressing 'F' profiles the expression: every subterm is listed\n"
+        "   with its share of the evaluation time, including and excluding\n"
+        "   its operands.\n",
+
+        "\n"
+        "1. Run: Derivatives\n"
+        "\n"
+        "   Pressing 'D' in the graph view of a function plots f1's first\n"
+        "   derivative with ' markers, pressing it again adds the second\n"
+        "   derivative with \" markers, and a third press hides both.\n"
+        "\n"
+        "   The derivatives are exact rather than estimated from neighbouring\n"
+        "   samples: every step of the expression also works out its first\n"
+        "   and second derivative, so f, f' and f'' come out of one pass.\n"
+        "   While derivatives are shown, 'O' writes them as extra columns\n"
+        "   after x and f, in the order x f f' f''.\n",
+
+        "\n"
+        "1. Run: Roots, Extrema and Intersections\n"
+        "\n"
+        "   Pressing 'A' lists f1's roots, minima and maxima and the points\n"
+        "   where it crosses the other functions, and marks them in the\n"
+        "   graph view: O root, v minimum, ^ maximum, X crossing.\n"
+        "\n"
+        "   The samples are scanned in parallel for changes of sign, of\n"
+        "   slope or of the gap to another function. Each one is narrowed\n"
+        "   down with Brent's method on the function itself (on its exact\n"
+        "   derivative for extrema), evaluating only around the candidate.\n"
+        "   Sign changes across a pole, as in tan(x), are not roots.\n",
+
+        "\n"
+        "1. Run: Integration\n"
+        "\n"
+        "   Pressing 'I' integrates f1 over the domain or over bounds you\n"
+        "   enter, to the absolute error you ask for (e.g. 1e-10).\n"
+        "\n"
+        "   Intervals are refined where f changes fastest: each is measured\n"
+        "   with a 7-point and a 15-point rule, and the ones whose results\n"
+        "   disagree by more than their share of the tolerance are halved.\n"
+        "   The pieces are evaluated in parallel and added up without losing\n"
+        "   digits to rounding. If f is not finite somewhere, as ln(x) below\n"
+        "   zero or 1/x at zero, the integral is reported as undefined, and\n"
+        "   if the error will not come down, where it may diverge.\n",
+
+        "\n"
+        "1. Run: Plotting Precision\n"
+        "\n"
+        "   Pressing 'E' switches the graph between float64 (the default)\n"
+        "   and float32. In float32 the functions are evaluated and stored\n"
+        "   in single precision: half the memory per sample, and twice as\n"
+        "   many values per vector instruction, which is still far finer\n"
+        "   than a terminal cell. The graph shows which precision it used\n"
+        "   next to the domain. Saved files, roots and integrals are always\n"
+        "   computed in float64, as are the derivatives ('D' in the graph).\n",
+
+        "\n"
+        "1. Run: Fast Math\n"
+        "\n"
+        "   Graphs of functions evaluate sin, cos, tan, arcsin, arccos,\n"
+        "   arctan, log, ln and powers with polynomial approximations\n"
+        "   instead of the C library: a few exact steps bring the argument\n"
+        "   into a short interval, then a fixed polynomial runs over whole\n"
+        "   batches of samples in vector instructions. Their error is within\n"
+        "   a few units in the last place of a double, far below a terminal\n"
+        "   cell, and arguments they do not cover (sin of 1e6, ln of 0, ...)\n"
+        "   go to the library. The graph shows 'fast math' next to the\n"
+        "   domain. Saved files, roots, integrals and derivatives use the\n"
+        "   library functions.\n",
+
+        "\n"
+        "1. Run: Surrogate\n"
+        "\n"
+        "   Pressing 'U' makes graphs sample a fit of the functions instead\n"
+        "   of the expressions. Each function is split into pieces over the\n"
+        "   domain, fitted with a degree 16 Chebyshev polynomial on each, and\n"
+        "   pieces off by more than 1e-10 (relative) are halved until they\n"
+        "   fit. Pieces that never do, around a pole, a kink or where f is\n"
+        "   undefined, are evaluated exactly. The fit is made once and then\n"
+        "   reused for new sample counts and domains inside it, and costs the\n"
+        "   same per sample however deep the expression is. The graph shows\n"
+        "   the pieces, the largest error and the speedup measured over the\n"
+        "   expressions. Saved files, roots and integrals stay exact.\n",
+
         "\n"
         "2. Input Function:\n"
         "\n"
@@ -135,6 +309,79 @@ TUI::TUI() : highlighted_item(0), parameters(-100, 100, 10000), help_page(0) {
         "   the user to enter something like:\n"
         "     - sin(pi) + 2 * ln(3 / x) - sqrt(682) + tan(g - x)\n",
 
+        "\n"
+        "2. Input Function: Multiple Functions\n"
+        "\n"
+        "   Up to five functions can be plotted together. 'C' changes the\n"
+        "   expression, which is always f1; 'A' adds another function and\n"
+        "   'D' removes one by its number. Every function is drawn in the\n"
+        "   graph view with its own marker and color (f1 '*', f2 '+', f3\n"
+        "   '#', f4 '@', f5 '%'), with a legend above the plot.\n"
+        "\n"
+        "   All functions are sampled on the same grid and evaluated in a\n"
+        "   single pass, split across the processor's cores. Subexpressions\n"
+        "   they have in common, such as the sin(x) in sin(x) * 2 and\n"
+        "   sin(x) + 1, are only computed once. Exports contain f1 only.\n",
+
+        "\n"
+        "2. Input Function: Symbolic Derivatives\n"
+        "\n"
+        "   'P' adds the derivative of a function as a new function, asking\n"
+        "   for its number when more than one is plotted. The derivative is\n"
+        "   worked out from the expression with the sum, product, quotient,\n"
+        "   power and chain rules, then simplified, so the derivative of\n"
+        "   x*sin(x) is shown as sin(x)+x*cos(x). Pressing 'P' on the new\n"
+        "   function gives the next derivative. Other variables are held\n"
+        "   constant. A minus sign may start an expression or exponent, as\n"
+        "   in -x^2 or x^-1, which derivatives often need.\n",
+
+        "\n"
+        "2. Input Function: Parametric and Polar Curves\n"
+        "\n"
+        "   'M' switches between plotting functions, a parametric curve\n"
+        "   (x(t), y(t)) and a polar curve r(t), where t is the independent\n"
+        "   variable. In the curve modes 'C' enters the curve and 'R' the\n"
+        "   parameter range, which defaults to one turn, [0, 2*pi].\n"
+        "\n"
+        "   The number of samples is the budget of evaluations for a curve.\n"
+        "   A quarter of it is spread evenly over the range to measure how\n"
+        "   far the curve travels, and the rest is placed at equal distances\n"
+        "   along the curve, so fast sections get more points and slow ones\n"
+        "   fewer. The graph view joins the points with line segments, and\n"
+        "   'O', 'X' and 'Z' export the points in order.\n",
+
+        "\n"
+        "2. Input Function: Surfaces\n"
+        "\n"
+        "   The fourth mode of 'M' plots a surface f(x, y) as a heatmap. 'C'\n"
+        "   enters the surface, which may use the independent variable and\n"
+        "   y (or x when the independent variable is y). The surface is\n"
+        "   evaluated over the graph window, one value per cell at the\n"
+        "   current terminal size, so 'W' in the graph view zooms it.\n"
+        "\n"
+        "   The grid is split into tiles of 64 x 16 cells that are evaluated\n"
+        "   in parallel. The shades run from the lowest value ' ' to the\n"
+        "   highest '@', and 'V' switches to contour lines, which mark where\n"
+        "   the value crosses from one band to the next. 'X' exports a\n"
+        "   square grid of about the number of samples in binary format.\n",
+
+        "\n"
+        "2. Input Function: Animation\n"
+        "\n"
+        "   The fifth mode of 'M' animates a function f(x, t), such as\n"
+        "   sin(x-t), with t swept over the parameter range ('R') every\n"
+        "   four seconds. 'C' enters the function; t becomes x when the\n"
+        "   independent variable is t. The graph view plays it at up to 30\n"
+        "   frames per second and 'P' pauses it.\n"
+        "\n"
+        "   Each frame evaluates one point per plot column. Parts of the\n"
+        "   function that only depend on x are computed once, parts that\n"
+        "   only depend on t once per frame, and only the cells that changed\n"
+        "   since the last frame are redrawn. When a frame takes too long\n"
+        "   the next ones are skipped instead of drawn late, and the top\n"
+        "   line shows t, the frame rate and the skipped frames. Runs and\n"
+        "   exports hold the function at the start of the range.\n",
+
         "\n"
         "3. Change Domain\n"
         "   The change domain option allows the user to change the domain\n"
@@ -206,6 +453,7 @@ TUI::TUI() : highlighted_item(0), parameters(-100, 100, 10000), help_page(0) {
 TUI::~TUI() { terminate(); }
 
 void TUI::initialize() {
+    TRACE_THREAD_NAME("main");
     initscr();
     cbreak();
     noecho();
@@ -215,6 +463,20 @@ void TUI::initialize() {
     if (has_colors()) {
         start_color();
         init_pair(1, COLOR_WHITE, COLOR_BLACK);
+        for (short i = 0;
+             i < static_cast<short>(AnalysisParameters::MAX_FUNCTIONS); ++i) {
+            init_pair(FUNCTION_COLOR_PAIR + i, FUNCTION_COLORS[i],
+                      COLOR_BLACK);
+        }
+        for (short i = 0; i < static_cast<short>(sizeof(HEATMAP_COLORS) /
+                                                 sizeof(HEATMAP_COLORS[0]));
+             ++i) {
+            init_pair(HEATMAP_COLOR_PAIR + i, HEATMAP_COLORS[i], COLOR_BLACK);
+        }
+        for (short i = 0; i < 2; ++i) {
+            init_pair(DERIVATIVE_COLOR_PAIR + i, DERIVATIVE_COLORS[i],
+                      COLOR_BLACK);
+        }
     } else {
         terminate();
         std::cerr << "Your terminal does not support color\n";
@@ -261,6 +523,23 @@ void TUI::terminate() {
     if (help_menu_window)
         delwin(help_menu_window);
     endwin();
+
+#ifdef CALCULATOR_TELEMETRY
+    // A trace still recording at exit is saved rather than lost
+    Tracer &tracer = Tracer::instance();
+    if (tracer.is_enabled()) {
+        tracer.stop();
+        std::filesystem::path path =
+            parameters.get_output_directory_path() / "calculator_trace.json";
+        try {
+            size_t spans = tracer.write(path);
+            std::cerr << "Trace with " << spans << " spans written to "
+                      << path.string() << "\n";
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << "\n";
+        }
+    }
+#endif
 }
 
 void TUI::draw_main() {
@@ -304,7 +583,7 @@ void TUI::draw_main() {
     int title_start_x = 6;
     int title_start_y = getmaxy(stdscr) / 10;
 
-    for (int i = 0; i < title.size(); i++) {
+    for (int i = 0; i < static_cast<int>(title.size()); i++) {
         mvwprintw(stdscr, title_start_y + i, title_start_x, title[i].c_str());
     }
 
@@ -366,10 +645,16 @@ void TUI::execute_command(int command) {
     switch (command) {
     case 0: // Run Function
         // run_calculation();
-        message = "Ran calculation: " + parameters.display_expression();
+        message = "Ran calculation: " + parameters.display_curve();
+        if (parameters.get_plot_mode() == PlotMode::Function &&
+            parameters.get_function_count() > 1) {
+            message += " and " +
+                       std::to_string(parameters.get_function_count() - 1) +
+                       " more";
+        }
         break;
     case 1: // Input Function
-        message = parameters.display_expression();
+        message = parameters.display_curve();
         break;
     case 2: // Change Domain/Range
         message = parameters.display_domain();
@@ -571,10 +856,58 @@ void TUI::show_status(const std::string &initial_message, int command) {
         mvwprintw(status_window, 8, 2, "Press 'B' to go back");
 
         if (command == 0) {
+            mvwprintw(status_window, 2, 2,
+                      "Press 'A' to find roots, extrema and crossings or 'I' "
+                      "to integrate");
             mvwprintw(status_window, 3, 2,
-                      "Press 'O' to save output to file or 'G' to view graph");
+                      "Press 'O' to save output to file, 'G' to view graph or "
+                      "'E' to plot in %s",
+                      plot_precision_ == Precision::Float32 ? "float64"
+                                                            : "float32");
+            mvwprintw(status_window, 4, 2,
+                      "Press 'P' to change export precision, 'F' to profile "
+                      "or 'U' to plot %s",
+                      plot_surrogate_ ? "exactly" : "a surrogate");
+            mvwprintw(status_window, 5, 2,
+                      "Press 'S' to stream a large export straight to file");
+            mvwprintw(status_window, 6, 2,
+                      "Press 'X' to save a binary run or 'L' to compare with "
+                      "one");
+            mvwprintw(status_window, 7, 2,
+                      "Press 'Z' to save a compressed archive, 'T' for "
+                      "telemetry or 'R' to trace");
         } else if (command == 1) {
-            mvwprintw(status_window, 3, 2, "Press 'C' to change function");
+            if (parameters.get_plot_mode() == PlotMode::Function) {
+                mvwprintw(status_window, 2, 2,
+                          "Press 'P' to add the derivative of a function");
+                mvwprintw(status_window, 3, 2,
+                          "Press 'C' to change f1, 'A' to add, 'D' to remove "
+                          "or 'M' to change mode");
+                for (size_t f = 1; f < parameters.get_function_count(); ++f) {
+                    mvwaddnstr(status_window, 3 + f, 4,
+                               parameters.display_function(f).c_str(),
+                               status_width - 6);
+                }
+            } else if (parameters.get_plot_mode() == PlotMode::Surface) {
+                mvwprintw(status_window, 3, 2,
+                          "Press 'C' to change the surface or 'M' to change "
+                          "mode");
+                mvwaddnstr(status_window, 5, 4,
+                           parameters.display_surface().c_str(),
+                           status_width - 6);
+                mvwprintw(status_window, 6, 4,
+                          "Evaluated over the graph window ('W' in the "
+                          "graph view)");
+            } else {
+                mvwprintw(status_window, 3, 2,
+                          "Press 'C' to change the curve, 'R' to change the "
+                          "range or 'M' to change mode");
+                mvwaddnstr(status_window, 5, 4,
+                           parameters.display_curve().c_str(),
+                           status_width - 6);
+                mvwprintw(status_window, 6, 4, "%s",
+                          parameters.display_curve_range().c_str());
+            }
         } else if (command == 2) {
             mvwprintw(status_window, 3, 2,
                       "Press 'S' to change start or 'E' to change end");
@@ -589,6 +922,24 @@ void TUI::show_status(const std::string &initial_message, int command) {
                       "Press 'D' to change the output directory");
         }
 
+        // The telemetry overlay hangs below the run screen's status box
+        if (command == 0 && show_telemetry_) {
+            if (telemetry_window == nullptr) {
+                telemetry_window =
+                    newwin(6, status_width, status_start_y + status_height,
+                           status_start_x);
+            }
+            werase(telemetry_window);
+            box(telemetry_window, 0, 0);
+            draw_telemetry(telemetry_window, 1, 2);
+            wnoutrefresh(telemetry_window);
+        } else if (telemetry_window != nullptr) {
+            delwin(telemetry_window);
+            telemetry_window = nullptr;
+            touchwin(stdscr);
+            wnoutrefresh(stdscr);
+        }
+
         wnoutrefresh(status_window);
         doupdate();
 
@@ -598,13 +949,53 @@ void TUI::show_status(const std::string &initial_message, int command) {
         case 'O':
         case 'g':
         case 'G':
+        case 'x':
+        case 'X':
+        case 'l':
+        case 'L':
+        case 'z':
+        case 'Z':
             if (command == 0)
                 handle_running(ch, message, continue_interaction);
             break;
+        case 'p':
+        case 'P':
+            if (command == 0)
+                handle_export_precision(ch, message, continue_interaction);
+            else if (command == 1)
+                handle_function(ch, message, continue_interaction);
+            break;
+        case 'r':
+        case 'R':
+            if (command == 0)
+                toggle_trace(message);
+            else if (command == 1)
+                handle_function(ch, message, continue_interaction);
+            break;
+        case 'm':
+        case 'M':
+            if (command == 1)
+                handle_function(ch, message, continue_interaction);
+            break;
+        case 'f':
+        case 'F':
+            if (command == 0)
+                display_profile(message);
+            break;
+        case 't':
+        case 'T':
+            if (command == 0 && !toggle_telemetry())
+                message = "Telemetry is disabled in this build "
+                          "(CALCULATOR_TELEMETRY=OFF)";
+            break;
         case 'c':
         case 'C':
+        case 'a':
+        case 'A':
             if (command == 1)
                 handle_function(ch, message, continue_interaction);
+            else if (command == 0 && (ch == 'a' || ch == 'A'))
+                find_features(message);
             break;
         case 's':
         case 'S':
@@ -612,6 +1003,20 @@ void TUI::show_status(const std::string &initial_message, int command) {
         case 'E':
             if (command == 2)
                 handle_domain(ch, message, continue_interaction);
+            else if (command == 0 && (ch == 's' || ch == 'S'))
+                handle_streaming(ch, message, continue_interaction);
+            else if (command == 0)
+                handle_plot_precision(ch, message, continue_interaction);
+            break;
+        case 'i':
+        case 'I':
+            if (command == 0)
+                handle_integral(ch, message, continue_interaction);
+            break;
+        case 'u':
+        case 'U':
+            if (command == 0)
+                handle_surrogate(ch, message, continue_interaction);
             break;
         case 'v':
         case 'V':
@@ -625,7 +1030,9 @@ void TUI::show_status(const std::string &initial_message, int command) {
             break;
         case 'd':
         case 'D':
-            if (command == 6)
+            if (command == 1)
+                handle_function(ch, message, continue_interaction);
+            else if (command == 6)
                 handle_output_directory(ch, message, continue_interaction);
             break;
         case 'b':
@@ -639,6 +1046,10 @@ void TUI::show_status(const std::string &initial_message, int command) {
 
     delwin(status_window);
     status_window = nullptr;
+    if (telemetry_window != nullptr) {
+        delwin(telemetry_window);
+        telemetry_window = nullptr;
+    }
 
     touchwin(stdscr);
     refresh();
@@ -746,7 +1157,67 @@ void TUI::handle_variable(int ch, std::string &message,
 
 void TUI::handle_function(int ch, std::string &message,
                           bool &continue_interaction) {
-    if (ch == 'c' || ch == 'C') {
+    PlotMode mode = parameters.get_plot_mode();
+    if (ch == 'm' || ch == 'M') {
+        // Cycles function -> parametric -> polar -> surface -> animation
+        // -> function
+        if (mode == PlotMode::Function) {
+            parameters.set_plot_mode(PlotMode::Parametric);
+        } else if (mode == PlotMode::Parametric) {
+            parameters.set_plot_mode(PlotMode::Polar);
+        } else if (mode == PlotMode::Polar) {
+            parameters.set_plot_mode(PlotMode::Surface);
+        } else if (mode == PlotMode::Surface) {
+            parameters.set_plot_mode(PlotMode::Animation);
+        } else {
+            parameters.set_plot_mode(PlotMode::Function);
+        }
+        message = parameters.display_curve();
+    } else if (mode != PlotMode::Function && (ch == 'c' || ch == 'C')) {
+        std::string variable(1, parameters.get_variable());
+        try {
+            if (mode == PlotMode::Surface) {
+                std::string new_surface;
+                get_string_input("Enter f(" + variable + ", " +
+                                     parameters.get_second_variable() + "): ",
+                                 new_surface);
+                parameters.set_surface(new_surface);
+            } else if (mode == PlotMode::Animation) {
+                std::string new_animation;
+                get_string_input("Enter f(" + variable + ", " +
+                                     parameters.get_time_variable() + "): ",
+                                 new_animation);
+                parameters.set_animation(new_animation);
+            } else if (mode == PlotMode::Parametric) {
+                std::string new_x, new_y;
+                get_string_input("Enter x(" + variable + "): ", new_x);
+                get_string_input("Enter y(" + variable + "): ", new_y);
+                parameters.set_parametric(new_x, new_y);
+            } else {
+                std::string new_r;
+                get_string_input("Enter r(" + variable + "): ", new_r);
+                parameters.set_polar(new_r);
+            }
+            message = parameters.display_curve();
+        } catch (const std::exception &e) {
+            message = e.what(); // The previous curve is kept
+        }
+    } else if (mode != PlotMode::Function && mode != PlotMode::Surface &&
+               (ch == 'r' || ch == 'R')) {
+        std::string new_start, new_end;
+        get_string_input("Enter parameter start (e.g. 0): ", new_start);
+        get_string_input("Enter parameter end (e.g. 6.2832): ", new_end);
+        try {
+            parameters.set_curve_range(std::stod(new_start),
+                                       std::stod(new_end));
+            message = parameters.display_curve_range();
+        } catch (const std::invalid_argument &e) {
+            message = "Invalid Parameters: Enter two numbers with start "
+                      "less than end.";
+        } catch (const std::out_of_range &e) {
+            message = "Invalid Parameters: Parameter out of range.";
+        }
+    } else if (ch == 'c' || ch == 'C') {
         std::string new_expression;
         get_string_input("Enter new expression: ", new_expression);
         try {
@@ -762,69 +1233,1161 @@ void TUI::handle_function(int ch, std::string &message,
             doupdate();
             wgetch(status_window);
         }
+    } else if (mode == PlotMode::Function && (ch == 'a' || ch == 'A')) {
+        std::string new_function;
+        get_string_input("Enter function to add: ", new_function);
+        try {
+            parameters.add_function(new_function);
+            message = parameters.display_function(
+                parameters.get_function_count() - 1);
+        } catch (const std::exception &e) {
+            message = e.what();
+        }
+    } else if (mode == PlotMode::Function && (ch == 'p' || ch == 'P')) {
+        // The derivative is worked out symbolically and added as text, so it
+        // is compiled, fused and displayed like any other function
+        int index = 1;
+        if (parameters.get_function_count() > 1) {
+            get_single_number_input("Function to differentiate (1-" +
+                                        std::to_string(
+                                            parameters.get_function_count()) +
+                                        "): ",
+                                    index);
+        }
+        try {
+            parameters.add_function(
+                parameters.differentiate_function(index - 1));
+            message = parameters.display_function(
+                parameters.get_function_count() - 1);
+        } catch (const std::exception &e) {
+            message = e.what();
+        }
+    } else if (mode == PlotMode::Function && (ch == 'd' || ch == 'D')) {
+        if (parameters.get_function_count() < 2) {
+            message = "Only f1 is plotted; add a function with 'A'";
+            return;
+        }
+        int index = 0;
+        get_single_number_input("Function to remove (2-" +
+                                    std::to_string(
+                                        parameters.get_function_count()) +
+                                    "): ",
+                                index);
+        try {
+            parameters.remove_function(index - 1);
+            message = parameters.display_expression();
+        } catch (const std::exception &e) {
+            message = e.what();
+        }
     }
 }
 
 void TUI::handle_running(int ch, std::string &message,
                          bool &continue_interaction) {
-    run_calculation();
-    if (ch == 'o' || ch == 'O') {
-        std::string filename;
-        get_string_input(
-            "Enter filename to save to, output will save to <filename>.txt: ",
-            filename);
-
-        std::string filepath =
-            (parameters.get_output_directory_path() / filename).string();
-
-        std::string full_filepath = filepath + ".txt";
-
-        int file_index = 0;
-        while (std::ifstream(full_filepath)) {
-            file_index++;
-            full_filepath = filepath + std::to_string(file_index) + ".txt";
-        }
-
-        std::ofstream outfile(full_filepath);
+    TRACE_SPAN("handle_running", "tui");
+    // Only the graph uses the plotting precision, the fast functions and
+    // the surrogates, which are fitted to libm's values; files get doubles
+    // from libm
+    if (ch == 'g' || ch == 'G') {
+        run_calculation(plot_precision_,
+                        plot_surrogate_ ? MathTier::Exact : MathTier::Fast,
+                        plot_surrogate_);
+    } else {
+        run_calculation();
+    }
+    bool surface = parameters.get_plot_mode() == PlotMode::Surface;
+    if (surface && (ch == 'o' || ch == 'O' || ch == 'z' || ch == 'Z')) {
+        message = "Surfaces are exported in the binary format ('X')";
+    } else if (ch == 'o' || ch == 'O') {
+        std::string full_filepath = prompt_output_path(".txt");
 
         werase(status_window);
         box(status_window, 0, 0);
 
-        if (!outfile) {
-            mvwprintw(status_window, 1, 2, "Error opening output file.");
-        } else {
-            for (const auto &[x, y] : results_) {
-                outfile << x << " " << y << "\n";
+        try {
+            // The derivatives shown in the graph follow f1 as extra columns
+            std::vector<const SampleSeries *> columns;
+            std::string header = "x f";
+            if (parameters.get_plot_mode() == PlotMode::Function) {
+                for (int order = 1; order <= derivative_order_; ++order) {
+                    columns.push_back(&derivative_results_[order - 1]);
+                    header += " f" + std::string(order, '\'');
+                }
             }
+            TextExporter exporter(parameters.get_export_precision());
+            ExportStats stats =
+                exporter.write(full_filepath, results_, columns);
             std::string display_filename =
                 full_filepath.substr(full_filepath.find_last_of("/") + 1);
             mvwprintw(status_window, 3, 2, "Results written to: %s",
                       display_filename.c_str());
+            mvwprintw(status_window, 4, 2,
+                      "Wrote %.2f MB in %.1f ms (%.0f MB/s)", stats.bytes / 1e6,
+                      stats.seconds * 1e3, stats.megabytes_per_second());
+            if (!columns.empty()) {
+                mvwprintw(status_window, 5, 2, "Columns: %s", header.c_str());
+            }
+        } catch (const std::exception &e) {
+            mvwprintw(status_window, 1, 2, "%s", e.what());
+        }
+        mvwprintw(status_window, 8, 2, "Press any key to continue...");
+        wnoutrefresh(status_window);
+        doupdate();
+        wgetch(status_window);
+
+    } else if (ch == 'g' || ch == 'G') {
+        display_graph();
+    } else if (ch == 'x' || ch == 'X') {
+        export_binary();
+    } else if (ch == 'l' || ch == 'L') {
+        load_comparison_run();
+    } else if (ch == 'z' || ch == 'Z') {
+        export_archive();
+    }
+}
+
+void TUI::export_binary() {
+    std::string full_filepath = prompt_output_path(".bin");
+    char column_type;
+    get_char_input("Store columns as float32 instead of float64? (y/n): ",
+                   column_type);
+
+    werase(status_window);
+    box(status_window, 0, 0);
+
+    try {
+        bool float32 = column_type == 'y' || column_type == 'Y';
+        ExportStats stats;
+        if (parameters.get_plot_mode() == PlotMode::Surface) {
+            // A square grid with about the requested number of samples over
+            // the graph window
+            size_t side = static_cast<size_t>(
+                              std::sqrt(parameters.get_num_samples())) + 1;
+            SurfaceGrid grid(side, side, user_min_x_, user_max_x_,
+                             user_min_y_, user_max_y_);
+            grid.evaluate(parameters.get_compiled_surface());
+            stats = BinaryExporter::write_grid(full_filepath, grid,
+                                               parameters.get_surface(),
+                                               parameters.get_variable(),
+                                               float32);
+        } else {
+            stats = BinaryExporter::write(full_filepath, results_,
+                                          parameters.get_expression(),
+                                          parameters.get_variable(), float32);
+        }
+        std::string display_filename =
+            full_filepath.substr(full_filepath.find_last_of("/") + 1);
+        mvwprintw(status_window, 3, 2, "Results written to: %s",
+                  display_filename.c_str());
+        mvwprintw(status_window, 4, 2, "Wrote %.2f MB in %.1f ms (%.0f MB/s)",
+                  stats.bytes / 1e6, stats.seconds * 1e3,
+                  stats.megabytes_per_second());
+    } catch (const std::exception &e) {
+        mvwprintw(status_window, 1, 2, "%s", e.what());
+    }
+    mvwprintw(status_window, 8, 2, "Press any key to continue...");
+    wnoutrefresh(status_window);
+    doupdate();
+    wgetch(status_window);
+}
+
+void TUI::export_archive() {
+    std::string full_filepath = prompt_output_path(".gor");
+
+    werase(status_window);
+    box(status_window, 0, 0);
+
+    try {
+        TELEMETRY_TIMER(export_timer, TelemetryStage::Export);
+        auto started = std::chrono::steady_clock::now();
+        ArchiveEncoder encoder(full_filepath, parameters.get_expression(),
+                               parameters.get_variable(),
+                               !results_.is_uniform(), results_.get_start(),
+                               results_.get_step());
+        encoder.write_chunk(results_);
+        encoder.finish();
+        TELEMETRY_STOP(export_timer);
+        double encode_seconds = std::chrono::duration<double>(
+                                    std::chrono::steady_clock::now() - started)
+                                    .count();
+
+        // Decoding the file back both verifies it and times the decoder
+        started = std::chrono::steady_clock::now();
+        ArchiveDecoder decoder(full_filepath);
+        SampleSeries chunk;
+        while (decoder.next_chunk(chunk)) {
+        }
+        double decode_seconds = std::chrono::duration<double>(
+                                    std::chrono::steady_clock::now() - started)
+                                    .count();
+
+        double raw_megabytes = encoder.raw_bytes() / 1e6;
+        std::string display_filename =
+            full_filepath.substr(full_filepath.find_last_of("/") + 1);
+        mvwprintw(status_window, 3, 2, "Results written to: %s",
+                  display_filename.c_str());
+        mvwprintw(status_window, 4, 2,
+                  "Compressed %.2f MB to %.2f MB (ratio %.2f:1)",
+                  raw_megabytes, encoder.bytes_written() / 1e6,
+                  static_cast<double>(encoder.raw_bytes()) /
+                      encoder.bytes_written());
+        mvwprintw(status_window, 5, 2,
+                  "Encode %.0f MB/s, decode %.0f MB/s",
+                  raw_megabytes / std::max(encode_seconds, 1e-9),
+                  raw_megabytes / std::max(decode_seconds, 1e-9));
+    } catch (const std::exception &e) {
+        mvwprintw(status_window, 1, 2, "%s", e.what());
+    }
+    mvwprintw(status_window, 8, 2, "Press any key to continue...");
+    wnoutrefresh(status_window);
+    doupdate();
+    wgetch(status_window);
+}
+
+void TUI::load_comparison_run() {
+    std::string filename;
+    get_string_input("Enter .bin or .gor run to compare with (relative to "
+                     "the output directory): ",
+                     filename);
+    std::filesystem::path path(filename);
+    if (path.is_relative()) {
+        path = parameters.get_output_directory_path() / path;
+    }
+
+    try {
+        std::string variable;
+        std::string expression;
+        if (path.extension() == ".gor") {
+            // Archives decode block by block straight into the overlay
+            ArchiveDecoder decoder(path);
+            comparison_ = decoder.read_all();
+            variable = std::string(1, decoder.get_variable());
+            expression = decoder.get_expression();
+        } else {
+            MappedRun run(path);
+            comparison_ = run.to_series();
+            variable = std::string(1, run.get_variable());
+            expression = run.get_expression();
+        }
+        comparison_label_ = "Compared: f(" + variable + ") = " + expression;
+    } catch (const std::exception &e) {
+        werase(status_window);
+        box(status_window, 0, 0);
+        mvwprintw(status_window, 1, 2, "%s", e.what());
+        mvwprintw(status_window, 8, 2, "Press any key to continue...");
+        wnoutrefresh(status_window);
+        doupdate();
+        wgetch(status_window);
+        return;
+    }
+    display_graph();
+}
+
+void TUI::handle_integral(int ch, std::string &message,
+                          bool &continue_interaction) {
+    if (parameters.get_plot_mode() != PlotMode::Function) {
+        message = "Integrals are computed for functions ('M' on the Input "
+                  "Function screen)";
+        return;
+    }
+    double lower = parameters.get_start();
+    double upper = parameters.get_end();
+    double tolerance;
+    char whole;
+    get_char_input("Integrate over the domain [" +
+                       std::to_string(parameters.get_start()) + ", " +
+                       std::to_string(parameters.get_end()) + "]? (y/n): ",
+                   whole);
+    try {
+        if (whole != 'y' && whole != 'Y') {
+            std::string lower_input, upper_input;
+            get_string_input("Enter lower bound (e.g. 0): ", lower_input);
+            get_string_input("Enter upper bound (e.g. 3.1416): ", upper_input);
+            lower = std::stod(lower_input);
+            upper = std::stod(upper_input);
+        }
+        std::string tolerance_input;
+        get_string_input("Enter tolerance (e.g. 1e-10): ", tolerance_input);
+        tolerance = std::stod(tolerance_input);
+    } catch (const std::exception &e) {
+        message = "Invalid Parameters: Bounds and tolerance must be numbers.";
+        return;
+    }
+    if (!std::isfinite(lower) || !std::isfinite(upper) || !(tolerance > 0)) {
+        message = "Invalid Parameters: Bounds must be finite and the "
+                  "tolerance positive.";
+        return;
+    }
+
+    Quadrature quadrature([this](const double *x, double *y, size_t count) {
+        parameters.evaluate_batch(x, y, count);
+    });
+    QuadratureResult result = quadrature.integrate(lower, upper, tolerance);
+
+    char buffer[160];
+    if (!result.finite) {
+        std::snprintf(buffer, sizeof(buffer),
+                      "Integral over [%g, %g] is undefined: f is not finite "
+                      "at x = %.6g",
+                      lower, upper, result.trouble_x);
+    } else if (!result.converged) {
+        std::snprintf(buffer, sizeof(buffer),
+                      "Integral over [%g, %g] = %.12g may diverge near x = "
+                      "%.6g (error %.2g)",
+                      lower, upper, result.value, result.trouble_x,
+                      result.error);
+    } else {
+        std::snprintf(buffer, sizeof(buffer),
+                      "Integral over [%g, %g] = %.15g (error %.2g, %zu "
+                      "evaluations)",
+                      lower, upper, result.value, result.error,
+                      result.evaluations);
+    }
+    message = buffer;
+}
+
+void TUI::handle_streaming(int ch, std::string &message,
+                           bool &continue_interaction) {
+    if (ch != 's' && ch != 'S') {
+        return;
+    }
+    std::string samples_input;
+    get_string_input("Enter number of samples to stream (e.g. 1e8): ",
+                     samples_input);
+    try {
+        size_t pos;
+        double samples = std::stod(samples_input, &pos);
+        if (pos != samples_input.length() || samples != std::floor(samples)) {
+            throw std::invalid_argument(
+                "Invalid Parameters: Streamed samples must be an integer");
+        }
+        parameters.set_stream_samples(static_cast<long long>(samples));
+    } catch (const std::exception &e) {
+        mvwprintw(status_window, 5, 2, "%s", e.what());
+        mvwprintw(status_window, 8, 2, "Press any key to continue...");
+        wnoutrefresh(status_window);
+        doupdate();
+        wgetch(status_window);
+        message = parameters.display_stream_samples();
+        return;
+    }
+
+    char format;
+    get_char_input("Stream as 'T' text, 'B' binary or 'Z' compressed: ",
+                   format);
+    format = std::toupper(format);
+    ExportFormat export_format = format == 'B'   ? ExportFormat::Binary
+                                 : format == 'Z' ? ExportFormat::Archive
+                                                 : ExportFormat::Text;
+    std::string full_filepath =
+        prompt_output_path(extension_for(export_format));
+
+    werase(status_window);
+    box(status_window, 0, 0);
+    mvwprintw(status_window, 1, 2, "%s",
+              parameters.display_stream_samples().c_str());
+
+    try {
+        const long long num_samples = parameters.get_stream_samples();
+        std::unique_ptr<ChunkSink> sink = make_chunk_sink(
+            export_format, full_filepath, parameters, num_samples);
+        StreamExporter streamer(parameters);
+        int last_percent = -1;
+        ExportStats stats =
+            streamer.run(num_samples, *sink,
+                         [&](double fraction) {
+                             int percent = static_cast<int>(fraction * 100);
+                             if (percent != last_percent) {
+                                 last_percent = percent;
+                                 mvwprintw(status_window, 3, 2,
+                                           "Streaming... %d%%", percent);
+                                 wnoutrefresh(status_window);
+                                 doupdate();
+                             }
+                         });
+        std::string display_filename =
+            full_filepath.substr(full_filepath.find_last_of("/") + 1);
+        mvwprintw(status_window, 3, 2, "Results written to: %s",
+                  display_filename.c_str());
+        mvwprintw(status_window, 4, 2, "Wrote %.2f MB in %.2f s (%.0f MB/s)",
+                  stats.bytes / 1e6, stats.seconds,
+                  stats.megabytes_per_second());
+    } catch (const std::exception &e) {
+        mvwprintw(status_window, 5, 2, "%s", e.what());
+    }
+    mvwprintw(status_window, 8, 2, "Press any key to continue...");
+    wnoutrefresh(status_window);
+    doupdate();
+    wgetch(status_window);
+    message = parameters.display_stream_samples();
+}
+
+std::string TUI::prompt_output_path(const std::string &extension) const {
+    std::string filename;
+    std::string prompt = "Enter filename to save to, output will save to "
+                         "<filename>" + extension + ": ";
+    get_string_input(prompt, filename);
+
+    std::string filepath =
+        (parameters.get_output_directory_path() / filename).string();
+
+    std::string full_filepath = filepath + extension;
+
+    int file_index = 0;
+    while (std::ifstream(full_filepath)) {
+        file_index++;
+        full_filepath = filepath + std::to_string(file_index) + extension;
+    }
+    return full_filepath;
+}
+
+void TUI::handle_export_precision(int ch, std::string &message,
+                                  bool &continue_interaction) {
+    if (ch == 'p' || ch == 'P') {
+        int new_precision;
+        get_single_number_input(
+            "Enter significant digits (0 for shortest round-trip): ",
+            new_precision);
+        try {
+            parameters.set_export_precision(new_precision);
+            message = parameters.display_export_precision();
+        } catch (const std::exception &e) {
+            mvwprintw(status_window, 5, 2, e.what());
+            parameters.set_export_precision(0);
+            message = parameters.display_export_precision();
             mvwprintw(status_window, 8, 2, "Press any key to continue...");
             wnoutrefresh(status_window);
             doupdate();
             wgetch(status_window);
         }
+    }
+}
 
-    } else if (ch == 'g' || ch == 'G') {
-        display_graph();
+void TUI::handle_plot_precision(int ch, std::string &message,
+                                bool &continue_interaction) {
+    if (ch == 'e' || ch == 'E') {
+        plot_precision_ = plot_precision_ == Precision::Float64
+                              ? Precision::Float32
+                              : Precision::Float64;
+        message = plot_precision_ == Precision::Float32
+                      ? "Graphs are evaluated and stored as float32; files "
+                        "stay float64"
+                      : "Graphs are evaluated and stored as float64";
+    }
+}
+
+void TUI::handle_surrogate(int ch, std::string &message,
+                           bool &continue_interaction) {
+    if (ch == 'u' || ch == 'U') {
+        plot_surrogate_ = !plot_surrogate_;
+        message = plot_surrogate_
+                      ? "Graphs are sampled from a Chebyshev fit; files stay "
+                        "exact"
+                      : "Graphs are evaluated from the expressions";
+    }
+}
+
+void TUI::run_calculation(Precision precision, MathTier tier,
+                          bool surrogate) {
+    if (parameters.get_plot_mode() == PlotMode::Surface) {
+        run_surface();
+        return;
+    }
+    if (parameters.get_plot_mode() == PlotMode::Animation) {
+        run_first_frame();
+        return;
+    }
+    if (parameters.get_plot_mode() != PlotMode::Function) {
+        run_curve();
+        return;
+    }
+    if (precision == Precision::Float32) {
+        run_functions<float>(precision, tier, surrogate);
+    } else {
+        run_functions<double>(precision, tier, surrogate);
+    }
+}
+
+template <typename T>
+void TUI::run_functions(Precision precision, MathTier tier, bool surrogate) {
+    TRACE_SPAN("run_calculation", "evaluate");
+    TELEMETRY_TIMER(evaluate_timer, TelemetryStage::Evaluate);
+    SampleGrid grid(parameters.get_start(), parameters.get_end(),
+                    parameters.get_num_samples());
+    bool refitted = surrogate && fit_surrogates();
+
+    // Points that coincide with the previous grid keep their value as long
+    // as the expression, the precision, the math tier and the surrogates
+    // are unchanged, so a domain or sample count tweak only pays for the
+    // new points
+    std::vector<long> previous;
+    if (results_revision_ == parameters.get_expression_revision() &&
+        results_.size() == results_grid_.size() &&
+        results_.get_precision() == precision && results_tier_ == tier &&
+        results_surrogate_ == surrogate && !refitted) {
+        previous = grid.map_onto(results_grid_);
+    }
+
+    // Every function shares the grid, so one series per function
+    size_t functions = parameters.get_function_count();
+    std::vector<SampleSeries> results(
+        functions, SampleSeries(grid.get_start(), grid.get_step(),
+                                grid.size(), precision));
+    // Statistics are gathered as the values come in, split by whether x
+    // lies in the graph window; partials are keyed by where they start so
+    // they merge in the same order every run
+    struct StatsPartial {
+            size_t begin;
+            std::vector<SampleStats> outside;
+            std::vector<SampleStats> inside;
+    };
+    std::vector<StatsPartial> partials;
+    std::mutex partials_mutex;
+    double window_min = user_min_x_, window_max = user_max_x_;
+
+    reused_samples_ = 0;
+    std::vector<size_t> missing;
+    std::vector<T> xs;
+    StatsPartial reused{0, std::vector<SampleStats>(functions),
+                        std::vector<SampleStats>(functions)};
+    for (size_t i = 0; i < grid.size(); ++i) {
+        if (!previous.empty() && previous[i] >= 0) {
+            double x = results[0].x(i);
+            std::vector<SampleStats> &stats =
+                x >= window_min && x <= window_max ? reused.inside
+                                                   : reused.outside;
+            results[0].set_y(i, results_.y(previous[i]));
+            stats[0].add(results[0].y(i));
+            for (size_t f = 1; f < functions; ++f) {
+                results[f].set_y(i, function_results_[f - 1].y(previous[i]));
+                stats[f].add(results[f].y(i));
+            }
+            ++reused_samples_;
+            continue;
+        }
+        missing.push_back(i);
+        xs.push_back(static_cast<T>(results[0].x(i)));
+    }
+
+    // The remaining points are evaluated in batches across the pool, all
+    // functions in the same pass. xs is in order, so the part of a batch in
+    // the window is one run of it.
+    std::vector<std::vector<T>> ys(functions, std::vector<T>(xs.size()));
+    ThreadPool::shared().parallel_for(
+        xs.size(), 4096, [&](size_t begin, size_t end) {
+            TRACE_SPAN_ITEMS("evaluate chunk", "evaluate", end - begin);
+            std::vector<T *> outputs(functions);
+            for (size_t f = 0; f < functions; ++f) {
+                outputs[f] = ys[f].data() + begin;
+            }
+            if (surrogate) {
+                for (size_t f = 0; f < functions; ++f) {
+                    surrogates_[f].evaluate(xs.data() + begin, outputs[f],
+                                            end - begin);
+                }
+            } else {
+                parameters.evaluate_functions(xs.data() + begin,
+                                              outputs.data(), end - begin,
+                                              tier);
+            }
+
+            size_t first = std::lower_bound(xs.begin() + begin,
+                                            xs.begin() + end, window_min) -
+                           xs.begin();
+            size_t last = std::upper_bound(xs.begin() + first,
+                                           xs.begin() + end, window_max) -
+                          xs.begin();
+            StatsPartial partial{begin, std::vector<SampleStats>(functions),
+                                 std::vector<SampleStats>(functions)};
+            for (size_t f = 0; f < functions; ++f) {
+                partial.outside[f].add(ys[f].data() + begin, first - begin);
+                partial.inside[f].add(ys[f].data() + first, last - first);
+                partial.outside[f].add(ys[f].data() + last, end - last);
+            }
+            std::lock_guard<std::mutex> lock(partials_mutex);
+            partials.push_back(std::move(partial));
+        });
+    for (size_t f = 0; f < functions; ++f) {
+        for (size_t k = 0; k < missing.size(); ++k) {
+            results[f].set_y(missing[k], ys[f][k]);
+        }
+    }
+
+    std::sort(partials.begin(), partials.end(),
+              [](const StatsPartial &a, const StatsPartial &b) {
+                  return a.begin < b.begin;
+              });
+    results_stats_.assign(functions, SampleStats());
+    window_stats_.assign(functions, SampleStats());
+    partials.insert(partials.begin(), std::move(reused));
+    for (const StatsPartial &partial : partials) {
+        for (size_t f = 0; f < functions; ++f) {
+            window_stats_[f].merge(partial.inside[f]);
+            results_stats_[f].merge(partial.inside[f]);
+            results_stats_[f].merge(partial.outside[f]);
+        }
+    }
+    stats_min_x_ = user_min_x_;
+    stats_max_x_ = user_max_x_;
+
+    results_ = std::move(results[0]);
+    function_results_.assign(std::make_move_iterator(results.begin() + 1),
+                             std::make_move_iterator(results.end()));
+    results_grid_ = grid;
+    results_revision_ = parameters.get_expression_revision();
+    results_tier_ = tier;
+    results_surrogate_ = surrogate;
+    TELEMETRY_STOP(evaluate_timer);
+
+    TELEMETRY_SAMPLES(missing.size(), reused_samples_,
+                      results_stats_[0].get_nan(), results_stats_[0].get_inf());
+    size_t memory = results_.memory_bytes();
+    for (const SampleSeries &series : function_results_) {
+        memory += series.memory_bytes();
+    }
+    TELEMETRY_MEMORY(memory);
+
+    if (derivative_order_ > 0) {
+        run_derivatives();
+    }
+}
+
+bool TUI::fit_surrogates() {
+    size_t functions = parameters.get_function_count();
+    if (surrogates_revision_ == parameters.get_expression_revision() &&
+        surrogates_.size() == functions &&
+        surrogates_[0].covers(parameters.get_start(), parameters.get_end())) {
+        return false;
+    }
+    TRACE_SPAN("fit_surrogates", "evaluate");
+    surrogates_.clear();
+    for (size_t f = 0; f < functions; ++f) {
+        surrogates_.emplace_back(
+            [this, f](const double *x, double *y, size_t count) {
+                parameters.get_compiled_function(f).evaluate(x, y, count);
+            });
+        surrogates_.back().fit(parameters.get_start(), parameters.get_end(),
+                               SURROGATE_TOLERANCE);
     }
+    surrogates_revision_ = parameters.get_expression_revision();
+    return true;
 }
 
-void TUI::run_calculation() {
-    double start = parameters.get_start();
-    double end = parameters.get_end();
-    double step = parameters.get_step();
+void TUI::run_derivatives() {
+    TRACE_SPAN("run_derivatives", "evaluate");
+    TELEMETRY_TIMER(evaluate_timer, TelemetryStage::Evaluate);
+    // f1, f1' and f1'' of each point come out of one pass, so f1 is
+    // refreshed along with its derivatives. The derivatives are always
+    // doubles; a float32 f1 keeps the values it has.
+    std::vector<SampleSeries> derivatives(
+        2, SampleSeries(results_.get_start(), results_.get_step(),
+                        results_.size()));
+    bool float32 = results_.get_precision() == Precision::Float32;
+    ThreadPool::shared().parallel_for(
+        results_.size(), 4096, [&](size_t begin, size_t end) {
+            TRACE_SPAN_ITEMS("differentiate chunk", "evaluate", end - begin);
+            std::vector<double> xs(end - begin);
+            std::vector<double> ys(float32 ? end - begin : 0);
+            for (size_t i = begin; i < end; ++i) {
+                xs[i - begin] = results_.x(i);
+            }
+            parameters.evaluate_derivatives(
+                xs.data(), float32 ? ys.data() : results_.y_data() + begin,
+                derivatives[0].y_data() + begin,
+                derivatives[1].y_data() + begin, end - begin);
+        });
+    derivative_results_ = std::move(derivatives);
+    TELEMETRY_STOP(evaluate_timer);
+}
 
-    results_.clear();
-    for (double x = start; x <= end; x += step) {
-        parameters.set_variable_value(parameters.get_variable(), x);
-        double y = parameters.evaluate_expression(x);
-        results_.emplace_back(x, y);
+void TUI::gather_window_stats() {
+    TRACE_SPAN("gather_window_stats", "evaluate");
+    std::vector<const SampleSeries *> series{&results_};
+    for (const SampleSeries &function : function_results_) {
+        series.push_back(&function);
+    }
+    std::vector<std::pair<size_t, std::vector<SampleStats>>> partials;
+    std::mutex mutex;
+    ThreadPool::shared().parallel_for(
+        results_.size(), 4096, [&](size_t begin, size_t end) {
+            std::vector<SampleStats> stats(series.size());
+            for (size_t i = begin; i < end; ++i) {
+                double x = results_.x(i);
+                if (x < user_min_x_ || x > user_max_x_) {
+                    continue;
+                }
+                for (size_t f = 0; f < series.size(); ++f) {
+                    stats[f].add(series[f]->y(i));
+                }
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            partials.emplace_back(begin, std::move(stats));
+        });
+    std::sort(partials.begin(), partials.end(),
+              [](const auto &a, const auto &b) { return a.first < b.first; });
+    window_stats_.assign(series.size(), SampleStats());
+    for (const auto &[begin, stats] : partials) {
+        for (size_t f = 0; f < series.size(); ++f) {
+            window_stats_[f].merge(stats[f]);
+        }
+    }
+    stats_min_x_ = user_min_x_;
+    stats_max_x_ = user_max_x_;
+}
+
+void TUI::run_first_frame() {
+    TRACE_SPAN("run_first_frame", "evaluate");
+    TELEMETRY_TIMER(evaluate_timer, TelemetryStage::Evaluate);
+    // The run and its exports hold the animation at the start of the range
+    SampleGrid grid(parameters.get_start(), parameters.get_end(),
+                    parameters.get_num_samples());
+    SampleSeries results(grid.get_start(), grid.get_step(), grid.size());
+    ThreadPool::shared().parallel_for(
+        grid.size(), 4096, [&](size_t begin, size_t end) {
+            TRACE_SPAN_ITEMS("evaluate chunk", "evaluate", end - begin);
+            std::vector<double> xs(end - begin);
+            std::vector<double> ts(end - begin, parameters.get_curve_start());
+            for (size_t i = begin; i < end; ++i) {
+                xs[i - begin] = results.x(i);
+            }
+            parameters.get_compiled_animation().evaluate(
+                xs.data(), ts.data(), results.y_data() + begin, end - begin);
+        });
+    results_ = std::move(results);
+    function_results_.clear();
+    results_revision_ = 0; // Not reusable by a later function run
+    TELEMETRY_STOP(evaluate_timer);
+
+    TELEMETRY_SAMPLES(results_.size(), 0, results_.count_nan(),
+                      results_.count_inf());
+    TELEMETRY_MEMORY(results_.memory_bytes());
+}
+
+int TUI::animate_graph(GraphRaster &shown, int top, int left, int axis_row,
+                       int axis_column, int footer_x) {
+    using Clock = std::chrono::steady_clock;
+    const std::chrono::duration<double> frame_time(1.0 / ANIMATION_FPS);
+
+    // One x value per plot column; everything that depends on x alone is
+    // evaluated here, once for the whole animation
+    int width = shown.get_width();
+    SampleSeries curve(user_min_x_, double(user_max_x_ - user_min_x_) / width,
+                       width + 1);
+    std::vector<double> xs(curve.size());
+    for (size_t i = 0; i < curve.size(); ++i) {
+        xs[i] = curve.x(i);
+    }
+    HoistedExpression hoisted(parameters.get_compiled_animation());
+    hoisted.set_x(xs.data(), xs.size());
+
+    // shown mirrors the plot area on screen; frames are drawn into frame and
+    // only the cells that differ from shown are written, a cleared cell
+    // getting its axis character back
+    GraphRaster frame(shown);
+    auto background = [&](int row, int column) -> chtype {
+        if (row == axis_row && column == axis_column) {
+            return '+';
+        }
+        return row == axis_row ? '-' : column == axis_column ? '|' : ' ';
+    };
+
+    double t_start = parameters.get_curve_start();
+    double t_range = parameters.get_curve_end() - t_start;
+    // Instruction counts after the hints on the bottom row (footer_x),
+    // frame statistics in the top-right corner
+    char status[96];
+    std::snprintf(status, sizeof(status),
+                  "Instructions: %zu hoisted, %zu per frame, %zu per x",
+                  hoisted.get_hoisted_count(), hoisted.get_per_frame_count(),
+                  hoisted.get_per_value_count());
+    int footer_end = getmaxx(graph_window) - 2;
+    if (footer_x < footer_end) {
+        mvwaddnstr(graph_window, top + frame.get_height() + 1, footer_x,
+                   status, footer_end - footer_x);
+    }
+    int status_column = std::max(28, left + frame.get_width() - 59);
+
+    Clock::time_point last = Clock::now();
+    Clock::time_point next_frame = last;
+    Clock::time_point fps_start = last;
+    int fps_frames = 0;
+    double fps = 0.0;
+    size_t skipped = 0;
+    while (true) {
+        Clock::time_point now = Clock::now();
+        if (!animation_paused_) {
+            // t follows the clock, so a slow frame moves the curve further
+            // instead of slowing the sweep down
+            animation_phase_ += std::chrono::duration<double>(now - last)
+                                    .count() /
+                                ANIMATION_SWEEP_SECONDS;
+            animation_phase_ -= std::floor(animation_phase_);
+        }
+        last = now;
+        double t = t_start + animation_phase_ * t_range;
+
+        {
+            TRACE_SPAN_ITEMS("animation frame", "render", curve.size());
+            hoisted.evaluate(t, curve.y_data());
+            frame.clear();
+            frame.plot_lines(curve, FUNCTION_GLYPHS[0]);
+        }
+        size_t written = 0;
+        for (int row = 1; row < frame.get_height(); ++row) {
+            for (int column = 1; column < frame.get_width(); ++column) {
+                char glyph = frame.at(row, column);
+                if (glyph == shown.at(row, column)) {
+                    continue;
+                }
+                mvwaddch(graph_window, top + row, left + column,
+                         glyph != 0
+                             ? glyph | COLOR_PAIR(FUNCTION_COLOR_PAIR)
+                             : background(row, column));
+                ++written;
+            }
+        }
+        std::swap(frame, shown);
+
+        ++fps_frames;
+        double fps_elapsed =
+            std::chrono::duration<double>(Clock::now() - fps_start).count();
+        if (fps_elapsed >= 1.0) {
+            fps = fps_frames / fps_elapsed;
+            fps_frames = 0;
+            fps_start = Clock::now();
+        }
+        std::snprintf(status, sizeof(status),
+                      "%c = %-10.4g%5.1f fps (target %d) %5zu cells %4zu "
+                      "skipped",
+                      parameters.get_time_variable(), t, fps, ANIMATION_FPS,
+                      written, skipped);
+        mvwprintw(graph_window, 1, status_column, "%s", status);
+        wnoutrefresh(graph_window);
+        doupdate();
+
+        // Deadlines that already passed are dropped rather than rendered
+        // late, so a slow expression lowers the frame rate but never
+        // queues frames up
+        next_frame += std::chrono::duration_cast<Clock::duration>(frame_time);
+        now = Clock::now();
+        if (next_frame < now) {
+            size_t missed =
+                static_cast<size_t>((now - next_frame) / frame_time);
+            skipped += missed;
+            next_frame +=
+                std::chrono::duration_cast<Clock::duration>(frame_time *
+                                                            missed);
+            if (next_frame < now) {
+                next_frame = now;
+            }
+        }
+        int wait_ms =
+            animation_paused_
+                ? -1
+                : static_cast<int>(
+                      std::chrono::duration_cast<std::chrono::milliseconds>(
+                          next_frame - now)
+                          .count());
+        wtimeout(graph_window, wait_ms);
+        int ch = wgetch(graph_window);
+        if (ch != ERR) {
+            wtimeout(graph_window, -1);
+            return ch;
+        }
+    }
+}
+
+void TUI::run_surface() {
+    TRACE_SPAN("run_surface", "evaluate");
+    TELEMETRY_TIMER(evaluate_timer, TelemetryStage::Evaluate);
+    // One value per plot cell of the graph view at the current terminal
+    // size, over the graph window
+    int terminal_max_x, terminal_max_y;
+    getmaxyx(stdscr, terminal_max_y, terminal_max_x);
+    size_t columns = std::max(2, terminal_max_x - 14);
+    size_t rows = std::max(2, terminal_max_y - 13);
+    surface_ = SurfaceGrid(columns, rows, user_min_x_, user_max_x_,
+                           user_min_y_, user_max_y_);
+    surface_.evaluate(parameters.get_compiled_surface());
+    TELEMETRY_STOP(evaluate_timer);
+
+    TELEMETRY_SAMPLES(
+        surface_.size(), 0,
+        std::count_if(surface_.data(), surface_.data() + surface_.size(),
+                      [](double value) { return std::isnan(value); }),
+        std::count_if(surface_.data(), surface_.data() + surface_.size(),
+                      [](double value) { return std::isinf(value); }));
+    TELEMETRY_MEMORY(surface_.memory_bytes());
+}
+
+void TUI::draw_surface(WINDOW *window, int top, int left, int width,
+                       int height) const {
+    ValueRange range = surface_.range();
+    double span = range.max > range.min ? range.max - range.min : 1.0;
+    const int shades = sizeof(HEATMAP_SHADES) - 1;
+    const int colors = sizeof(HEATMAP_COLORS) / sizeof(HEATMAP_COLORS[0]);
+
+    // Band of every cell from low to high; -1 where f is not finite
+    int rows = std::min<int>(height, surface_.get_rows());
+    int columns = std::min<int>(width, surface_.get_columns());
+    std::vector<int> bands(rows * columns, -1);
+    for (int row = 0; row < rows; ++row) {
+        for (int column = 0; column < columns; ++column) {
+            double value = surface_.at(row, column);
+            if (std::isfinite(value)) {
+                bands[row * columns + column] = std::min(
+                    shades - 1,
+                    static_cast<int>((value - range.min) / span * shades));
+            }
+        }
+    }
+
+    // Contours mark cells whose band differs from the next cell right or
+    // below, which traces the level lines between bands
+    for (int row = 0; row < rows; ++row) {
+        for (int column = 0; column < columns; ++column) {
+            int band = bands[row * columns + column];
+            if (band < 0) {
+                continue;
+            }
+            char glyph = HEATMAP_SHADES[band];
+            if (show_contours_) {
+                bool edge =
+                    (column + 1 < columns &&
+                     bands[row * columns + column + 1] != band) ||
+                    (row + 1 < rows && bands[(row + 1) * columns + column] !=
+                                           band);
+                if (!edge) {
+                    continue;
+                }
+                glyph = '0' + band;
+            }
+            chtype color =
+                COLOR_PAIR(HEATMAP_COLOR_PAIR + band * colors / shades);
+            mvwaddch(window, top + row, left + column, glyph | color);
+        }
+    }
+
+    // Legend: the surface, then the shade scale from min to max
+    std::string label = parameters.display_surface();
+    char low[32] = "nan", high[32] = "nan";
+    if (!range.empty()) {
+        std::snprintf(low, sizeof(low), "%.4g", range.min);
+        std::snprintf(high, sizeof(high), "%.4g", range.max);
+    }
+    int length = label.length() + std::strlen(low) + std::strlen(high) +
+                 shades + 5;
+    wmove(window, 2, std::max(28, (width + 8 - length) / 2));
+    waddstr(window, (label + "   " + low + " ").c_str());
+    for (int band = 0; band < shades; ++band) {
+        waddch(window, (show_contours_ ? '0' + band : HEATMAP_SHADES[band]) |
+                           COLOR_PAIR(HEATMAP_COLOR_PAIR +
+                                      band * colors / shades));
     }
+    waddstr(window, (std::string(" ") + high).c_str());
+}
+
+void TUI::run_curve() {
+    TRACE_SPAN("run_curve", "evaluate");
+    TELEMETRY_TIMER(evaluate_timer, TelemetryStage::Evaluate);
+    // Arc length is measured against the graph window, and the number of
+    // samples is the evaluation budget
+    CurveSampler sampler(
+        [this](const double *t, double *x, double *y, size_t count) {
+            parameters.evaluate_curve(t, x, y, count);
+        },
+        user_max_x_ - user_min_x_, user_max_y_ - user_min_y_);
+    results_ = sampler.sample(parameters.get_curve_start(),
+                              parameters.get_curve_end(),
+                              parameters.get_num_samples());
+    function_results_.clear();
+
+    // A curve is not on any grid, so the next function run starts afresh
+    results_grid_ = SampleGrid();
+    results_revision_ = 0;
+    reused_samples_ = 0;
+    TELEMETRY_STOP(evaluate_timer);
+
+    TELEMETRY_SAMPLES(results_.size(), 0, results_.count_nan(),
+                      results_.count_inf());
+    TELEMETRY_MEMORY(results_.memory_bytes());
+}
+
+bool TUI::toggle_telemetry() {
+#ifdef CALCULATOR_TELEMETRY
+    show_telemetry_ = !show_telemetry_;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void TUI::toggle_trace(std::string &message) {
+#ifdef CALCULATOR_TELEMETRY
+    Tracer &tracer = Tracer::instance();
+    if (!tracer.is_enabled()) {
+        tracer.start();
+        message = "Tracing started, press 'R' again to save the trace";
+        return;
+    }
+    tracer.stop();
+    std::string full_filepath = prompt_output_path(".json");
+    try {
+        size_t spans = tracer.write(full_filepath);
+        message = "Trace with " + std::to_string(spans) + " spans written to " +
+                  full_filepath.substr(full_filepath.find_last_of("/") + 1);
+    } catch (const std::exception &e) {
+        message = e.what();
+    }
+#else
+    message = "Tracing is disabled in this build (CALCULATOR_TELEMETRY=OFF)";
+#endif
+}
+
+void TUI::display_profile(std::string &message) {
+    const CompiledExpression &expression = parameters.get_compiled_expression();
+    if (expression.empty()) {
+        message = "Enter a function before profiling";
+        return;
+    }
+
+    // Profiling times every instruction of every batch, so it runs on one
+    // thread over a fresh copy of the grid rather than reusing results
+    SampleGrid grid(parameters.get_start(), parameters.get_end(),
+                    parameters.get_num_samples());
+    std::vector<double> xs(grid.size());
+    for (size_t i = 0; i < xs.size(); ++i) {
+        xs[i] = grid.x_at(i);
+    }
+    std::vector<double> ys(xs.size());
+    ExpressionProfile profile(expression);
+    expression.evaluate_profiled(xs.data(), ys.data(), xs.size(), profile);
+
+    int max_y, max_x;
+    getmaxyx(stdscr, max_y, max_x);
+    int width = max_x - 4;
+    std::vector<std::string> lines = profile.report(width - 4);
+    int height = std::min(static_cast<int>(lines.size()) + 6, max_y - 2);
+
+    WINDOW *profile_window =
+        newwin(height, width, (max_y - height) / 2, (max_x - width) / 2);
+    box(profile_window, 0, 0);
+    std::string title = " Profile: " + parameters.display_expression() + " ";
+    if (static_cast<int>(title.length()) < width - 2) {
+        mvwprintw(profile_window, 0, (width - title.length()) / 2, "%s",
+                  title.c_str());
+    }
+    int rows = std::min(static_cast<int>(lines.size()), height - 4);
+    for (int i = 0; i < rows; ++i) {
+        mvwprintw(profile_window, i + 1, 2, "%s", lines[i].c_str());
+    }
+    mvwprintw(profile_window, height - 2, 2, "Press any key to continue...");
+    wrefresh(profile_window);
+    wgetch(profile_window);
+    delwin(profile_window);
+    touchwin(stdscr);
+    wnoutrefresh(stdscr);
+
+    message = "Profiled " + std::to_string(profile.get_samples()) +
+              " samples of " + parameters.display_expression();
+}
+
+void TUI::find_features(std::string &message) {
+    if (parameters.get_plot_mode() != PlotMode::Function) {
+        message = "Roots and extrema are found for functions ('M' on the "
+                  "Input Function screen)";
+        return;
+    }
+    run_calculation();
+
+    // Refinement evaluates single points; the slope comes from the exact
+    // derivative of the compiled expression
+    const CompiledExpression &f1 = parameters.get_compiled_function(0);
+    FeatureFinder finder(
+        results_, [&f1](double x) { return f1.evaluate(x); },
+        [&f1](double x) {
+            double y, dy, d2y;
+            f1.evaluate_derivatives(&x, &y, &dy, &d2y, 1);
+            return dy;
+        });
+    finder.find_roots();
+    finder.find_extrema();
+    for (size_t f = 1; f < parameters.get_function_count(); ++f) {
+        const CompiledExpression &other = parameters.get_compiled_function(f);
+        finder.find_intersections(
+            function_results_[f - 1],
+            [&other](double x) { return other.evaluate(x); }, f);
+    }
+    features_ = finder.get_features();
+    features_grid_ = results_grid_;
+    features_revision_ = results_revision_;
+
+    int max_y, max_x;
+    getmaxyx(stdscr, max_y, max_x);
+    int width = max_x - 4;
+    std::vector<std::string> lines = finder.report(width - 4);
+    int height = std::min(static_cast<int>(lines.size()) + 6, max_y - 2);
+
+    WINDOW *feature_window =
+        newwin(height, width, (max_y - height) / 2, (max_x - width) / 2);
+    box(feature_window, 0, 0);
+    std::string title = " Features: " + parameters.display_expression() + " ";
+    if (static_cast<int>(title.length()) < width - 2) {
+        mvwprintw(feature_window, 0, (width - title.length()) / 2, "%s",
+                  title.c_str());
+    }
+    int rows = std::min(static_cast<int>(lines.size()), height - 4);
+    for (int i = 0; i < rows; ++i) {
+        mvwprintw(feature_window, i + 1, 2, "%s", lines[i].c_str());
+    }
+    if (rows < static_cast<int>(lines.size())) {
+        mvwprintw(feature_window, rows, 2, "... and %d more",
+                  static_cast<int>(lines.size()) - rows + 1);
+    }
+    mvwprintw(feature_window, height - 2, 2,
+              "Press any key to continue (marked in the graph view)...");
+    wrefresh(feature_window);
+    wgetch(feature_window);
+    delwin(feature_window);
+    touchwin(stdscr);
+    wnoutrefresh(stdscr);
+
+    message = lines.front();
+}
+
+bool TUI::features_current() const {
+    return features_revision_ == results_revision_ &&
+           features_grid_.size() == results_grid_.size() &&
+           features_grid_.get_start() == results_grid_.get_start() &&
+           features_grid_.get_end() == results_grid_.get_end();
+}
+
+void TUI::draw_telemetry(WINDOW *window, int row, int column) const {
+    Telemetry &telemetry = Telemetry::instance();
+    StageTiming parse = telemetry.get_timing(TelemetryStage::Parse);
+    StageTiming evaluate = telemetry.get_timing(TelemetryStage::Evaluate);
+    StageTiming render = telemetry.get_timing(TelemetryStage::Render);
+    StageTiming output = telemetry.get_timing(TelemetryStage::Export);
+    double rate = evaluate.last_seconds > 0
+                      ? telemetry.get_evaluated() / evaluate.last_seconds
+                      : 0.0;
+
+    mvwprintw(window, row, column, "parse    %8.3f ms  render %8.3f ms",
+              parse.last_seconds * 1e3, render.last_seconds * 1e3);
+    mvwprintw(window, row + 1, column, "evaluate %8.3f ms  export %8.3f ms",
+              evaluate.last_seconds * 1e3, output.last_seconds * 1e3);
+    mvwprintw(window, row + 2, column,
+              "%.2f M samples/s, %zu reused, %zu NaN, %zu inf", rate / 1e6,
+              telemetry.get_reused(), telemetry.get_nan(),
+              telemetry.get_inf());
+    mvwprintw(window, row + 3, column, "results %.2f MB, peak %.2f MB",
+              telemetry.get_memory() / 1e6,
+              telemetry.get_peak_memory() / 1e6);
 }
 
 void TUI::display_graph() {
+    TRACE_SPAN_NAMED(render_span, "display_graph", "render");
+    TELEMETRY_TIMER(render_timer, TelemetryStage::Render);
     int terminal_max_x, terminal_max_y;
     getmaxyx(stdscr, terminal_max_y, terminal_max_x);
 
@@ -871,26 +2434,66 @@ void TUI::display_graph() {
     if (graph_min_y > graph_max_y)
         std::swap(graph_min_y, graph_max_y);
 
-    // Avoid division by zero in scaling
-    double x_range =
-        (graph_max_x - graph_min_x) != 0 ? (graph_max_x - graph_min_x) : 1;
-    double y_range =
-        (graph_max_y - graph_min_y) != 0 ? (graph_max_y - graph_min_y) : 1;
-
-    // Scale the results to fit within the inner box dimensions
-    auto scale_x = [&](double x) {
-        return inner_start_x +
-               static_cast<int>(((x - graph_min_x) / x_range) * inner_width);
-    };
-    auto scale_y = [&](double y) {
-        return inner_start_y +
-               static_cast<int>(((y - graph_min_y) / y_range) * inner_height);
-    };
+    // A surface fills the whole plot area instead of the raster and axes,
+    // and an animation draws its own frames into the empty raster
+    bool surface = parameters.get_plot_mode() == PlotMode::Surface;
+    bool animation = parameters.get_plot_mode() == PlotMode::Animation;
+    bool function = parameters.get_plot_mode() == PlotMode::Function;
+
+    // Functions are fitted from the statistics of the run, every function
+    // within its outlier fences, unless the range was set with 'W'
+    bool has_stats =
+        function && window_stats_.size() == function_results_.size() + 1;
+    if (has_stats &&
+        (stats_min_x_ != user_min_x_ || stats_max_x_ != user_max_x_)) {
+        gather_window_stats();
+    }
+    bool fitted = false;
+    if (has_stats && fit_range_) {
+        ValueRange fit;
+        for (const SampleStats &function_stats : window_stats_) {
+            ValueRange range = function_stats.fit_range();
+            fit.min = std::min(fit.min, range.min);
+            fit.max = std::max(fit.max, range.max);
+        }
+        if (!fit.empty()) {
+            graph_min_y = fit.min;
+            graph_max_y = fit.max;
+            fitted = true;
+        }
+    }
+    int derivatives =
+        function && derivative_results_.size() == 2 &&
+                derivative_results_[0].size() == results_.size()
+            ? derivative_order_
+            : 0;
+
+    // The comparison run goes underneath, then f1's derivatives and the
+    // functions from last to first so f1 stays on top where they overlap
+    GraphRaster raster(inner_width, inner_height, graph_min_x, graph_max_x,
+                       graph_min_y, graph_max_y);
+    if (!surface && !animation) {
+        raster.plot(comparison_, 'o');
+        for (int order = derivatives; order > 0; --order) {
+            raster.plot(derivative_results_[order - 1],
+                        DERIVATIVE_GLYPHS[order - 1]);
+        }
+        for (size_t f = function_results_.size(); f > 0; --f) {
+            raster.plot(function_results_[f - 1], FUNCTION_GLYPHS[f]);
+        }
+        if (results_.is_uniform()) {
+            raster.plot(results_, FUNCTION_GLYPHS[0]);
+        } else {
+            raster.plot_lines(results_, FUNCTION_GLYPHS[0]); // A curve
+        }
+    }
 
     // Determine positions for the axes
-    int y_axis_pos = (graph_min_x <= 0 && graph_max_x >= 0) ? scale_x(0) : -1;
-    int x_axis_pos = (graph_min_y <= 0 && graph_max_y >= 0)
-                         ? inner_height - scale_y(0) + inner_start_y
+    int y_axis_pos = (!surface && graph_min_x <= 0 && graph_max_x >= 0)
+                         ? inner_start_x + raster.column_of(0)
+                         : -1;
+    int x_axis_pos = (!surface && graph_min_y <= 0 && graph_max_y >= 0)
+                         ? inner_start_y + raster.row_of(0)
                          : -1;
 
     // Draw X and Y axes if they exist within the range
@@ -908,52 +2511,253 @@ void TUI::display_graph() {
         }
     }
 
-    // Plot the points, skipping NaN values
-    for (const auto &[x, y] : results_) {
-        if (std::isnan(y))
-            continue; // Skip NaN values
+    // Plot the occupied cells; many samples usually share one cell
+    for (int row = 1; row < inner_height; ++row) {
+        for (int column = 1; column < inner_width; ++column) {
+            char glyph = raster.at(row, column);
+            if (glyph == 0) {
+                continue;
+            }
+            const char *function = std::strchr(FUNCTION_GLYPHS, glyph);
+            const char *derivative = std::strchr(DERIVATIVE_GLYPHS, glyph);
+            chtype color = function != nullptr
+                               ? COLOR_PAIR(FUNCTION_COLOR_PAIR +
+                                            (function - FUNCTION_GLYPHS))
+                           : derivative != nullptr
+                               ? COLOR_PAIR(DERIVATIVE_COLOR_PAIR +
+                                            (derivative - DERIVATIVE_GLYPHS))
+                               : 0;
+            mvwaddch(graph_window, inner_start_y + row,
+                     inner_start_x + column, glyph | color);
+        }
+    }
 
-        // Ensure the points are within the user-defined domain and range
-        if (x < graph_min_x || x > graph_max_x || y < graph_min_y ||
-            y > graph_max_y) {
+    // Found points go over the plot, in the color of the function they
+    // belong to or cross
+    bool features = function && features_current() && !features_.empty();
+    for (size_t k = 0; features && k < features_.size(); ++k) {
+        const Feature &feature = features_[k];
+        int row = raster.row_of(feature.y);
+        int column = raster.column_of(feature.x);
+        if (row < 1 || row >= inner_height || column < 1 ||
+            column >= inner_width) {
             continue;
         }
+        mvwaddch(graph_window, inner_start_y + row, inner_start_x + column,
+                 FEATURE_GLYPHS[static_cast<int>(feature.kind)] | A_BOLD |
+                     COLOR_PAIR(FUNCTION_COLOR_PAIR + feature.other));
+    }
 
-        int scaled_x = scale_x(x);
-        int scaled_y = inner_start_y + inner_height - scale_y(y);
+    if (!comparison_.empty()) {
+        mvwprintw(graph_window, 1,
+                  (graph_width + 4 - comparison_label_.length()) / 2, "%s",
+                  comparison_label_.c_str());
+    }
 
-        // Ensure points are within graph boundaries
-        if (scaled_x > inner_start_x &&
-            scaled_x < inner_start_x + inner_width &&
-            scaled_y > inner_start_y &&
-            scaled_y < inner_start_y + inner_height) {
-            mvwaddch(graph_window, scaled_y, scaled_x, '*');
-        }
+    if (surface) {
+        draw_surface(graph_window, inner_start_y + 1, inner_start_x + 1,
+                     inner_width - 1, inner_height - 1);
     }
 
-    mvwprintw(graph_window, 2,
-              (graph_width + 4 - parameters.display_expression().length()) / 2,
-              parameters.display_expression().c_str());
+    // Legend of every function and derivative in its own color, centered
+    // as one line but kept clear of the range on the left
+    std::vector<std::pair<std::string, short>> legend;
+    size_t legend_length = 0;
+    for (size_t f = 0; !surface && f < function_results_.size() + 1; ++f) {
+        legend.emplace_back(std::string(1, FUNCTION_GLYPHS[f]) + " " +
+                                (results_.is_uniform() && !animation
+                                     ? parameters.display_function(f)
+                                     : parameters.display_curve()),
+                            FUNCTION_COLOR_PAIR + f);
+    }
+    for (int order = 1; order <= derivatives; ++order) {
+        legend.emplace_back(std::string(1, DERIVATIVE_GLYPHS[order - 1]) +
+                                " f" + std::string(order, '\'') + "(" +
+                                parameters.get_variable() + ")",
+                            DERIVATIVE_COLOR_PAIR + order - 1);
+    }
+    if (features) {
+        legend.emplace_back("O v ^ X roots, extrema, crossings", 0);
+    }
+    for (const auto &[label, pair] : legend) {
+        legend_length += label.length() + (legend_length > 0 ? 3 : 0);
+    }
+    char range_label[64];
+    if (fitted) {
+        std::snprintf(range_label, sizeof(range_label),
+                      "Range: [%.4g, %.4g] fitted", graph_min_y, graph_max_y);
+    } else {
+        std::snprintf(range_label, sizeof(range_label), "Range: [%d, %d]",
+                      user_min_y_, user_max_y_);
+    }
+    int legend_x = std::max<int>(
+        std::max<size_t>(28, std::strlen(range_label) + 5),
+        (graph_width + 4 - legend_length) / 2);
+    wmove(graph_window, 2, legend_x);
+    for (size_t f = 0; f < legend.size(); ++f) {
+        if (f > 0) {
+            waddstr(graph_window, "   ");
+        }
+        wattron(graph_window, COLOR_PAIR(legend[f].second));
+        waddnstr(graph_window, legend[f].first.c_str(),
+                 std::max(0, graph_width + 2 - getcurx(graph_window)));
+        wattroff(graph_window, COLOR_PAIR(legend[f].second));
+    }
 
     // Display domain and range information at the top, outside the inner box
     mvwprintw(graph_window, 1, 2, "Domain: [%d, %d]", user_min_x_, user_max_x_);
-    mvwprintw(graph_window, 2, 2, "Range: [%d, %d]", user_min_y_, user_max_y_);
+    if (function) {
+        wprintw(graph_window, ", %s%s",
+                results_.get_precision() == Precision::Float32 ? "float32"
+                                                               : "float64",
+                results_tier_ == MathTier::Fast ? ", fast math" : "");
+    }
+    // The fit of every function together: its pieces, the worst error and
+    // the speedup over evaluating the expressions
+    if (function && results_surrogate_) {
+        size_t pieces = 0, exact_pieces = 0;
+        double error = 0.0, exact_ns = 0.0, surrogate_ns = 0.0;
+        for (const ChebyshevSurrogate &surrogate : surrogates_) {
+            const SurrogateFit &fit = surrogate.get_fit();
+            pieces += fit.pieces;
+            exact_pieces += fit.exact_pieces;
+            error = std::max(error, fit.max_error);
+            exact_ns += fit.exact_ns;
+            surrogate_ns += fit.surrogate_ns;
+        }
+        wprintw(graph_window, ", Chebyshev fit: %zu pieces (%zu exact), "
+                              "error %.1g, %.1fx",
+                pieces, exact_pieces, error,
+                surrogate_ns > 0.0 ? exact_ns / surrogate_ns : 0.0);
+    }
+    int domain_end = getcurx(graph_window);
+    mvwprintw(graph_window, 2, 2, "%s", range_label);
+
+    // f1's statistics over the window, on the right where they fit
+    if (has_stats && window_stats_[0].get_count() > 0) {
+        const SampleStats &f1 = window_stats_[0];
+        char summary[192];
+        std::snprintf(summary, sizeof(summary),
+                      "f1 in view: min %.4g  max %.4g  mean %.4g  "
+                      "p1 %.4g  p99 %.4g  %zu finite, %zu NaN, %zu inf",
+                      f1.get_min(), f1.get_max(), f1.get_mean(),
+                      f1.percentile(0.01), f1.percentile(0.99),
+                      f1.get_finite(), f1.get_nan(), f1.get_inf());
+        int summary_x =
+            graph_width + 2 - static_cast<int>(std::strlen(summary));
+        int taken = comparison_.empty()
+                        ? domain_end + 2
+                        : (graph_width + 4 + comparison_label_.length()) / 2 +
+                              2;
+        if (summary_x >= taken) {
+            mvwprintw(graph_window, 1, summary_x, "%s", summary);
+        }
+    }
 
-    // Display command instructions at the bottom, outside the inner box
-    mvwprintw(graph_window, graph_height + 2, 2,
-              "Press 'B' to go back or 'W' to change the window settings");
+    // Display command instructions at the bottom, outside the inner box,
+    // each hint after the one before and cut off at the frame
+    int footer_x = 2;
+    auto add_hint = [&](const char *hint) {
+        if (footer_x < graph_width + 2) {
+            mvwaddnstr(graph_window, graph_height + 2, footer_x, hint,
+                       graph_width + 2 - footer_x);
+            footer_x = getcurx(graph_window) + 4;
+        }
+    };
+    add_hint("Press 'B' to go back, 'W' for the window or 'F' to fit Y");
+    if (!comparison_.empty()) {
+        add_hint("Press 'C' to clear the comparison ('o')");
+    }
+    if (surface) {
+        add_hint(show_contours_ ? "Press 'V' for the heatmap"
+                                : "Press 'V' for contour lines");
+    }
+    int pause_x = footer_x;
+    if (animation) {
+        add_hint(animation_paused_ ? "Press 'P' to resume"
+                                   : "Press 'P' to pause ");
+    }
+    if (function) {
+        add_hint(derivative_order_ == 0   ? "Press 'D' to show f'"
+                 : derivative_order_ == 1 ? "Press 'D' to show f''"
+                                          : "Press 'D' to hide derivatives");
+    }
+    TELEMETRY_STOP(render_timer);
+
+    // The overlay sits in the plot's top-right corner, over the points
+    if (show_telemetry_) {
+        draw_telemetry(graph_window, inner_start_y + 1,
+                       std::max(inner_start_x + 1,
+                                inner_start_x + inner_width - 46));
+    }
 
     wnoutrefresh(graph_window);
     doupdate();
+    TRACE_END(render_span);
 
-    // Wait for user input to return
+    // Wait for user input to return; an animation plays until a key
     int ch;
-    while ((ch = wgetch(graph_window)) != 'b' && ch != 'B') {
+    while ((ch = animation ? animate_graph(
+                                 raster, inner_start_y, inner_start_x,
+                                 x_axis_pos != -1 ? x_axis_pos - inner_start_y
+                                                  : -1,
+                                 y_axis_pos != -1 ? y_axis_pos - inner_start_x
+                                                  : -1,
+                                 footer_x)
+                           : wgetch(graph_window)) != 'b' &&
+           ch != 'B') {
+        if ((ch == 'd' || ch == 'D') && function) {
+            // Off -> f' -> f' and f'' -> off
+            derivative_order_ = (derivative_order_ + 1) % 3;
+            if (derivative_order_ > 0) {
+                run_derivatives();
+            }
+            delwin(graph_window);
+            display_graph();
+            return; // Redraw the graph with the derivatives
+        }
+        if ((ch == 'p' || ch == 'P') && animation) {
+            animation_paused_ = !animation_paused_;
+            if (pause_x < graph_width + 2) {
+                mvwaddnstr(graph_window, graph_height + 2, pause_x,
+                           animation_paused_ ? "Press 'P' to resume"
+                                             : "Press 'P' to pause ",
+                           graph_width + 2 - pause_x);
+            }
+            continue;
+        }
         if (ch == 'w' || ch == 'W') {
             adjust_graph_domain_range();
+            if (surface) {
+                run_surface(); // The grid follows the window
+            }
             display_graph();
             return; // Redraw the graph with the new domain/range
         }
+        if ((ch == 'f' || ch == 'F') && function && !fit_range_) {
+            fit_range_ = true;
+            delwin(graph_window);
+            display_graph();
+            return; // Redraw the graph with the fitted range
+        }
+        if ((ch == 'v' || ch == 'V') && surface) {
+            show_contours_ = !show_contours_;
+            delwin(graph_window);
+            display_graph();
+            return; // Redraw the surface in the other view
+        }
+        if ((ch == 'c' || ch == 'C') && !comparison_.empty()) {
+            comparison_.clear();
+            delwin(graph_window);
+            display_graph();
+            return; // Redraw the graph without the comparison run
+        }
+        if (ch == 't' || ch == 'T') {
+            toggle_telemetry();
+            delwin(graph_window);
+            display_graph();
+            return; // Redraw the graph with or without the overlay
+        }
         // Wait for 'B' to go back
     }
 
@@ -1044,6 +2848,9 @@ void TUI::adjust_graph_domain_range() {
     user_max_x_ = max_x_value;
     user_min_y_ = min_y;
     user_max_y_ = max_y_value;
+    if (parameters.get_plot_mode() == PlotMode::Function) {
+        fit_range_ = false; // Until 'F' fits it again
+    }
 
     werase(status_window);
     wnoutrefresh(status_window);
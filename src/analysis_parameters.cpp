@@ -1,6 +1,10 @@
 #include "analysis_parameters.hpp"
 #include "ast.hpp"
+#include "telemetry.hpp"
 #include "tokenizer.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cmath>
 #include <filesystem>
 #include <format>
 #include <iomanip>
@@ -12,7 +16,8 @@
 
 // Constructor definition
 AnalysisParameters::AnalysisParameters(int start, int end, int num_samples)
-    : variable_('x'), old_variable_('x'), start_(start), end_(end) {
+    : variable_('x'), old_variable_('x'), start_(start), end_(end),
+      export_precision_(0), stream_samples_(10000000) {
 
     // Initialize reserved characters
     reserved_chars = {
@@ -32,6 +37,10 @@ AnalysisParameters::AnalysisParameters(int start, int end, int num_samples)
     set_output_directory_path(std::filesystem::current_path().string());
     set_expression(
         "sin(x)"); // This initializes the AST with the default expression
+    set_parametric("8*cos(3*x)", "4*sin(2*x)");
+    set_polar("4*cos(2*x)");
+    set_surface("sin(x)*cos(y)");
+    set_animation("sin(x-t)");
 }
 
 // Getter for start_
@@ -69,11 +78,100 @@ const std::string AnalysisParameters::get_expression() const {
     return expression_;
 }
 
+// Getter for export_precision_
+const int AnalysisParameters::get_export_precision() const {
+    return export_precision_;
+}
+
+// Getter for stream_samples_
+const long long AnalysisParameters::get_stream_samples() const {
+    return stream_samples_;
+}
+
 // Getter for reserved_chars
 const std::set<char> AnalysisParameters::get_reserved_chars() const {
     return reserved_chars;
 }
 
+// Getter for expression_revision_
+const unsigned long AnalysisParameters::get_expression_revision() const {
+    return expression_revision_;
+}
+
+// Getter for compiled_
+const CompiledExpression &AnalysisParameters::get_compiled_expression() const {
+    return compiled_;
+}
+
+// Getter for the number of plotted functions
+const size_t AnalysisParameters::get_function_count() const {
+    return functions_.size() + 1;
+}
+
+// Getter for function index, where 0 is expression_
+const std::string AnalysisParameters::get_function(size_t index) const {
+    return index == 0 ? expression_ : functions_.at(index - 1);
+}
+
+// Getter for the compiled form of function index
+const CompiledExpression &
+AnalysisParameters::get_compiled_function(size_t index) const {
+    return index == 0 ? compiled_ : compiled_functions_.at(index - 1);
+}
+
+// Getter for fused_
+const FusedExpressions &AnalysisParameters::get_fused_functions() const {
+    return fused_;
+}
+
+// Getter for plot_mode_
+const PlotMode AnalysisParameters::get_plot_mode() const { return plot_mode_; }
+
+// Getter for curve_x_
+const std::string AnalysisParameters::get_curve_x() const { return curve_x_; }
+
+// Getter for curve_y_
+const std::string AnalysisParameters::get_curve_y() const { return curve_y_; }
+
+// Getter for polar_
+const std::string AnalysisParameters::get_polar() const { return polar_; }
+
+// Getter for curve_start_
+const double AnalysisParameters::get_curve_start() const {
+    return curve_start_;
+}
+
+// Getter for curve_end_
+const double AnalysisParameters::get_curve_end() const { return curve_end_; }
+
+// Getter for the second variable of a surface, y unless that is variable_
+const char AnalysisParameters::get_second_variable() const {
+    return variable_ != 'y' ? 'y' : 'x';
+}
+
+// Getter for surface_
+const std::string AnalysisParameters::get_surface() const { return surface_; }
+
+// Getter for compiled_surface_
+const CompiledExpression &AnalysisParameters::get_compiled_surface() const {
+    return compiled_surface_;
+}
+
+// Getter for the time variable of an animation, t unless that is variable_
+const char AnalysisParameters::get_time_variable() const {
+    return variable_ != 't' ? 't' : 'x';
+}
+
+// Getter for animation_
+const std::string AnalysisParameters::get_animation() const {
+    return animation_;
+}
+
+// Getter for compiled_animation_
+const CompiledExpression &AnalysisParameters::get_compiled_animation() const {
+    return compiled_animation_;
+}
+
 // Display the domain as a string
 std::string AnalysisParameters::display_domain() const {
     return std::format("Domain: [{}, {}]", start_, end_);
@@ -124,6 +222,63 @@ std::string AnalysisParameters::display_expression() const {
     return std::format("f({}) = {}", variable_, expression_);
 }
 
+// Display function index as a string, numbered from f1 after the first
+std::string AnalysisParameters::display_function(size_t index) const {
+    if (index == 0) {
+        return display_expression();
+    }
+    return std::format("f{}({}) = {}", index + 1, variable_,
+                       get_function(index));
+}
+
+// Display the expressions of the current plot mode as a string
+std::string AnalysisParameters::display_curve() const {
+    switch (plot_mode_) {
+    case PlotMode::Parametric:
+        return std::format("x({}) = {}, y({}) = {}", variable_, curve_x_,
+                           variable_, curve_y_);
+    case PlotMode::Polar:
+        return std::format("r({}) = {}", variable_, polar_);
+    case PlotMode::Surface:
+        return display_surface();
+    case PlotMode::Animation:
+        return display_animation();
+    default:
+        return display_expression();
+    }
+}
+
+// Display the parameter range of the curve modes as a string
+std::string AnalysisParameters::display_curve_range() const {
+    return std::format("Parameter range: [{}, {}]", curve_start_, curve_end_);
+}
+
+// Display the surface as a string
+std::string AnalysisParameters::display_surface() const {
+    return std::format("f({}, {}) = {}", variable_, get_second_variable(),
+                       surface_);
+}
+
+// Display the animation as a string
+std::string AnalysisParameters::display_animation() const {
+    return std::format("f({}, {}) = {}", variable_, get_time_variable(),
+                       animation_);
+}
+
+// Display the export precision as a string
+std::string AnalysisParameters::display_export_precision() const {
+    if (export_precision_ == 0) {
+        return "Export precision: shortest round-trip";
+    }
+    return std::format("Export precision: {} significant digits",
+                       export_precision_);
+}
+
+// Display the number of samples used for streamed exports
+std::string AnalysisParameters::display_stream_samples() const {
+    return std::format("Streamed export samples: {}", stream_samples_);
+}
+
 // Setter for start_
 void AnalysisParameters::set_start(int new_start) {
     start_ = new_start;
@@ -144,6 +299,19 @@ void AnalysisParameters::set_end(int new_end) {
     update_step();
 }
 
+// Setter for start_ and end_ together; the pair is checked before either
+// changes, so a move that passes through an invalid domain end by end is
+// still accepted, and a rejected one leaves the domain as it was
+void AnalysisParameters::set_domain(int new_start, int new_end) {
+    if (!is_valid_domain(new_start, new_end)) {
+        throw std::invalid_argument(
+            "Invalid Parameters: Start must be less than end.");
+    }
+    start_ = new_start;
+    end_ = new_end;
+    update_step();
+}
+
 // Setter for num_samples_
 void AnalysisParameters::set_num_samples(int new_samples) {
     num_samples_ = new_samples;
@@ -180,6 +348,7 @@ void AnalysisParameters::set_output_directory_path(std::string new_dir) {
 
 // Setter for expression_
 void AnalysisParameters::set_expression(const std::string &new_expression) {
+    TELEMETRY_SCOPE(TelemetryStage::Parse);
     // Check if the expression is valid before setting it
     if (!is_valid_expression(new_expression)) {
         throw std::invalid_argument(
@@ -195,15 +364,131 @@ void AnalysisParameters::set_expression(const std::string &new_expression) {
         if (!ast_) {
             throw std::runtime_error("Failed to initialize AST.");
         }
+        TRACE_SPAN("compile", "parse"); // Flattens and folds constants
+        compiled_ = CompiledExpression(*ast_);
+        fuse_functions();
+        ++expression_revision_;
     } catch (const std::exception &e) {
         throw std::invalid_argument(std::string("Failed to initialize AST: ") +
                                     e.what());
     }
 }
 
+// Adds a function to plot after the expression
+void AnalysisParameters::add_function(const std::string &new_function) {
+    TELEMETRY_SCOPE(TelemetryStage::Parse);
+    if (get_function_count() >= MAX_FUNCTIONS) {
+        throw std::invalid_argument("Invalid Parameters: At most " +
+                                    std::to_string(MAX_FUNCTIONS) +
+                                    " functions can be plotted.");
+    }
+    compiled_functions_.push_back(compile_function(new_function));
+    functions_.push_back(new_function);
+    fuse_functions();
+    ++expression_revision_;
+}
+
+// Removes function index; the expression itself (index 0) cannot be removed
+void AnalysisParameters::remove_function(size_t index) {
+    if (index == 0 || index >= get_function_count()) {
+        throw std::invalid_argument(std::format(
+            "Invalid Parameters: Function must be between 2 and {}.",
+            get_function_count()));
+    }
+    functions_.erase(functions_.begin() + (index - 1));
+    compiled_functions_.erase(compiled_functions_.begin() + (index - 1));
+    fuse_functions();
+    ++expression_revision_;
+}
+
+// Differentiates function index in the variable; other variables are held
+// constant
+std::string AnalysisParameters::differentiate_function(size_t index) {
+    if (index >= get_function_count()) {
+        throw std::invalid_argument(std::format(
+            "Invalid Parameters: Function must be between 1 and {}.",
+            get_function_count()));
+    }
+    std::unique_ptr<ASTNode> ast =
+        generate_ast_from_expression(get_function(index), *this);
+    return differentiate_ast(*ast, variable_)->to_string();
+}
+
+// Setter for plot_mode_
+void AnalysisParameters::set_plot_mode(PlotMode new_mode) {
+    plot_mode_ = new_mode;
+}
+
+// Setter for the parametric curve; both components compile into one tape
+void AnalysisParameters::set_parametric(const std::string &new_x,
+                                        const std::string &new_y) {
+    TELEMETRY_SCOPE(TelemetryStage::Parse);
+    CompiledExpression x = compile_function(new_x);
+    CompiledExpression y = compile_function(new_y);
+    parametric_ = FusedExpressions({&x, &y});
+    curve_x_ = new_x;
+    curve_y_ = new_y;
+}
+
+// Setter for the polar curve
+void AnalysisParameters::set_polar(const std::string &new_r) {
+    TELEMETRY_SCOPE(TelemetryStage::Parse);
+    compiled_polar_ = compile_function(new_r);
+    polar_ = new_r;
+}
+
+// Setter for curve_start_ and curve_end_
+void AnalysisParameters::set_curve_range(double new_start, double new_end) {
+    if (!std::isfinite(new_start) || !std::isfinite(new_end) ||
+        new_start >= new_end) {
+        throw std::invalid_argument(
+            "Invalid Parameters: Parameter start must be less than end.");
+    }
+    curve_start_ = new_start;
+    curve_end_ = new_end;
+}
+
+// Setter for surface_, which may use the second variable as well
+void AnalysisParameters::set_surface(const std::string &new_surface) {
+    TELEMETRY_SCOPE(TelemetryStage::Parse);
+    compiled_surface_ =
+        compile_two_variables(new_surface, get_second_variable());
+    surface_ = new_surface;
+}
+
+// Setter for animation_, which may use the time variable as well
+void AnalysisParameters::set_animation(const std::string &new_animation) {
+    TELEMETRY_SCOPE(TelemetryStage::Parse);
+    compiled_animation_ =
+        compile_two_variables(new_animation, get_time_variable());
+    animation_ = new_animation;
+}
+
+// Setter for export_precision_
+void AnalysisParameters::set_export_precision(int new_precision) {
+    export_precision_ = new_precision;
+    if (!is_valid_export_precision()) {
+        throw std::invalid_argument(
+            "Invalid Parameters: Precision must be between 0 and 17.");
+    }
+}
+
+// Setter for stream_samples_
+void AnalysisParameters::set_stream_samples(long long new_samples) {
+    stream_samples_ = new_samples;
+    if (!is_valid_stream_samples()) {
+        throw std::invalid_argument("Invalid Parameters: Streamed samples "
+                                    "must be between 100 and 1e10");
+    }
+}
+
 // Check if the current domain parameters are valid
 bool AnalysisParameters::is_valid_domain() const {
-    return start_ < end_ && end_ - start_ >= 10;
+    return is_valid_domain(start_, end_);
+}
+
+bool AnalysisParameters::is_valid_domain(int start, int end) {
+    return start < end && end - start >= 10;
 }
 
 // Check if current sample size parameters are valid
@@ -220,6 +505,23 @@ bool AnalysisParameters::is_valid_output_path() const {
     return false;
 }
 
+// Check if export precision is 0 (shortest) or a digit count a double holds
+bool AnalysisParameters::is_valid_export_precision() const {
+    return export_precision_ >= 0 && export_precision_ <= MAX_EXPORT_PRECISION;
+}
+
+// Check if streamed sample count is within the supported range
+bool AnalysisParameters::is_valid_stream_samples() const {
+    return stream_samples_ >= MIN_SAMPLES &&
+           stream_samples_ <= MAX_STREAM_SAMPLES;
+}
+
+// Checks if name is an independent variable of the expression being parsed
+bool AnalysisParameters::is_independent_variable(char name) const {
+    return name == variable_ ||
+           (second_variable_ != 0 && name == second_variable_);
+}
+
 // Checks if variable is not reserved
 bool AnalysisParameters::is_valid_variable() const {
     return !reserved_chars.contains(variable_);
@@ -238,7 +540,7 @@ bool AnalysisParameters::is_valid_expression(
         const auto &token = tokens[i];
         // Check if the token is a variable or constant
         if (std::regex_match(token, std::regex(R"([a-zA-Z])"))) {
-            if (token != std::string(1, variable_) &&
+            if (!is_independent_variable(token[0]) &&
                 !constants.contains(token)) {
                 return false;
             }
@@ -264,7 +566,7 @@ bool AnalysisParameters::is_valid_expression(
                     }
                 } else if (std::regex_match(inner_token,
                                             std::regex(R"([a-zA-Z])"))) {
-                    if (inner_token != std::string(1, variable_) &&
+                    if (!is_independent_variable(inner_token[0]) &&
                         !constants.contains(inner_token)) {
                         return false;
                     }
@@ -272,12 +574,17 @@ bool AnalysisParameters::is_valid_expression(
                     valid_argument = true;
                 } else if (std::regex_match(
                                inner_token,
-                               std::regex(
-                                   R"(\b(?:sin|cos|tan|log|ln|sqrt)\b)"))) {
+                               std::regex(R"(\b(?:sin|cos|tan|log|ln|sqrt|)"
+                                          R"(arcsin|arccos|arctan)\b)"))) {
                     valid_argument = true;
                 } else if (std::regex_match(inner_token,
                                             std::regex(R"([\+\-\*/\^\d\.])"))) {
                     valid_argument = true;
+                } else if (std::regex_match(
+                               inner_token,
+                               std::regex(R"(\d+(?:\.\d*)?|\.\d+)"))) {
+                    // Numbers of several digits, as derivatives print them
+                    valid_argument = true;
                 } else {
                     return false;
                 }
@@ -315,8 +622,46 @@ void AnalysisParameters::update_step() {
 
 // Update expression based on new variable
 void AnalysisParameters::update_expression() {
+    TELEMETRY_SCOPE(TelemetryStage::Parse);
+    std::string updated_expression = rename_variable(expression_);
+    std::vector<std::string> updated_functions;
+    for (const std::string &function : functions_) {
+        updated_functions.push_back(rename_variable(function));
+    }
+    std::string updated_x = rename_variable(curve_x_);
+    std::string updated_y = rename_variable(curve_y_);
+    std::string updated_polar = rename_variable(polar_);
+
+    std::string updated_surface = rename_variables(
+        surface_, old_variable_ != 'y' ? 'y' : 'x', get_second_variable());
+    std::string updated_animation = rename_variables(
+        animation_, old_variable_ != 't' ? 't' : 'x', get_time_variable());
+
+    expression_ = updated_expression;
+    ast_ = generate_ast_from_expression(expression_, *this); // Regenerate AST
+    {
+        TRACE_SPAN("compile", "parse");
+        compiled_ = CompiledExpression(*ast_);
+    }
+    functions_ = updated_functions;
+    compiled_functions_.clear();
+    for (const std::string &function : functions_) {
+        compiled_functions_.push_back(compile_function(function));
+    }
+    fuse_functions();
+    ++expression_revision_;
+
+    set_parametric(updated_x, updated_y);
+    set_polar(updated_polar);
+    set_surface(updated_surface);
+    set_animation(updated_animation);
+}
+
+// Replaces old_variable_ with variable_ in expression
+std::string
+AnalysisParameters::rename_variable(const std::string &expression) const {
     Tokenizer tokenizer;
-    std::vector<std::string> tokens = tokenizer.tokenize(expression_);
+    std::vector<std::string> tokens = tokenizer.tokenize(expression);
 
     if (tokens.empty()) {
         throw std::runtime_error("No tokens found in the expression.");
@@ -330,9 +675,67 @@ void AnalysisParameters::update_expression() {
         throw std::invalid_argument("Invalid Parameters: Expression is not "
                                     "valid with the new variable.");
     }
+    return updated_expression;
+}
 
-    expression_ = updated_expression;
-    ast_ = generate_ast_from_expression(expression_, *this); // Regenerate AST
+// Renames both variables of a surface or animation. The second variable
+// changes too when the variable takes its name, so both are renamed at once
+// through a placeholder.
+std::string AnalysisParameters::rename_variables(const std::string &expression,
+                                                 char old_second,
+                                                 char new_second) const {
+    Tokenizer tokenizer;
+    std::vector<std::string> tokens = tokenizer.tokenize(expression);
+    tokenizer.replace_variable(tokens, old_second, '\1');
+    tokenizer.replace_variable(tokens, old_variable_, variable_);
+    tokenizer.replace_variable(tokens, '\1', new_second);
+    return tokenizer.reconstruct_expression(tokens);
+}
+
+// Compiles a function that may use second as well as the variable
+CompiledExpression
+AnalysisParameters::compile_two_variables(const std::string &function,
+                                          char second) {
+    second_variable_ = second;
+    try {
+        CompiledExpression compiled = compile_function(function);
+        second_variable_ = 0;
+        return compiled;
+    } catch (...) {
+        second_variable_ = 0;
+        throw;
+    }
+}
+
+// Parses and compiles a function other than the expression
+CompiledExpression
+AnalysisParameters::compile_function(const std::string &function) {
+    if (!is_valid_expression(function)) {
+        throw std::invalid_argument(
+            "Invalid expression. Ensure correct variable and syntax.");
+    }
+    // The AST is only needed to compile; the tape does not refer to it
+    std::unique_ptr<ASTNode> ast;
+    try {
+        ast = generate_ast_from_expression(function, *this);
+    } catch (const std::exception &e) {
+        throw std::invalid_argument(std::string("Failed to initialize AST: ") +
+                                    e.what());
+    }
+    if (!ast) {
+        throw std::invalid_argument("Failed to initialize AST.");
+    }
+    TRACE_SPAN("compile", "parse");
+    return CompiledExpression(*ast);
+}
+
+// Merges every function into one tape that shares common subexpressions
+void AnalysisParameters::fuse_functions() {
+    std::vector<const CompiledExpression *> functions = {&compiled_};
+    for (const CompiledExpression &function : compiled_functions_) {
+        functions.push_back(&function);
+    }
+    fused_ = FusedExpressions(functions);
 }
 
 // Evaluates current expression
@@ -344,6 +747,59 @@ double AnalysisParameters::evaluate_expression(double variable_value) {
     return ast_->evaluate(); // Evaluate using the stored AST
 }
 
+// Evaluates current expression for a batch of variable values
+void AnalysisParameters::evaluate_batch(const double *values, double *results,
+                                        size_t count) const {
+    compiled_.evaluate(values, results, count);
+}
+
+// Evaluates the expression and its first two derivatives in one pass
+void AnalysisParameters::evaluate_derivatives(const double *values,
+                                              double *results,
+                                              double *first, double *second,
+                                              size_t count) const {
+    compiled_.evaluate_derivatives(values, results, first, second, count);
+}
+
+// Evaluates every function for a batch of variable values in one pass
+void AnalysisParameters::evaluate_functions(const double *values,
+                                            double *const *results,
+                                            size_t count,
+                                            MathTier tier) const {
+    fused_.evaluate(values, results, count, tier);
+}
+
+void AnalysisParameters::evaluate_functions(const float *values,
+                                            float *const *results,
+                                            size_t count,
+                                            MathTier tier) const {
+    fused_.evaluate(values, results, count, tier);
+}
+
+// Evaluates the current curve for a batch of parameter values
+void AnalysisParameters::evaluate_curve(const double *values, double *x,
+                                        double *y, size_t count) const {
+    switch (plot_mode_) {
+    case PlotMode::Parametric: {
+        double *const outputs[] = {x, y};
+        parametric_.evaluate(values, outputs, count);
+        break;
+    }
+    case PlotMode::Polar:
+        compiled_polar_.evaluate(values, x, count);
+        for (size_t i = 0; i < count; ++i) {
+            double r = x[i];
+            x[i] = r * std::cos(values[i]);
+            y[i] = r * std::sin(values[i]);
+        }
+        break;
+    default:
+        compiled_.evaluate(values, y, count);
+        std::copy(values, values + count, x);
+        break;
+    }
+}
+
 // Updates the map with the current value of the variable
 void AnalysisParameters::set_variable_value(char var, double value) {
     variable_values[var] = value;
@@ -1,19 +1,90 @@
 #include "ast.hpp"
 #include "analysis_parameters.hpp"
+#include "compiled_expression.hpp"
 #include "parser.hpp"
 #include "tokenizer.hpp"
+#include "trace.hpp"
+#include <charconv>
 #include <cmath>
 #include <stdexcept>
 
+namespace {
+
+// Atoms: numbers, variables and function calls
+const int ATOM_PRECEDENCE = 5;
+const int NEGATION_PRECEDENCE = 3;
+
+const NumberNode *as_number(const std::unique_ptr<ASTNode> &node) {
+    return dynamic_cast<const NumberNode *>(node.get());
+}
+
+bool is_number(const std::unique_ptr<ASTNode> &node, double value) {
+    const NumberNode *number = as_number(node);
+    return number != nullptr && number->evaluate() == value;
+}
+
+std::unique_ptr<ASTNode> number(double value) {
+    return std::make_unique<NumberNode>(value);
+}
+
+std::unique_ptr<ASTNode> binary(char op, std::unique_ptr<ASTNode> left,
+                                std::unique_ptr<ASTNode> right) {
+    return std::make_unique<BinaryOpNode>(op, std::move(left),
+                                          std::move(right));
+}
+
+std::unique_ptr<ASTNode> function(const std::string &func,
+                                  std::unique_ptr<ASTNode> argument) {
+    return std::make_unique<FunctionNode>(func, std::move(argument));
+}
+
+std::string parenthesize(const ASTNode &node, bool needed) {
+    return needed ? "(" + node.to_string() + ")" : node.to_string();
+}
+
+} // namespace
+
+int ASTNode::precedence() const { return ATOM_PRECEDENCE; }
+
 // NumberNode Implementation
 NumberNode::NumberNode(double val) : value(val) {}
 
 double NumberNode::evaluate() const { return value; }
 
-bool NumberNode::contains_variable(char variable) const {
+bool NumberNode::contains_variable(char) const {
     return false; // Numbers do not contain variables
 }
 
+int NumberNode::compile(CompiledExpression &program) const {
+    return program.add_constant(value);
+}
+
+std::unique_ptr<ASTNode> NumberNode::clone() const { return number(value); }
+
+std::unique_ptr<ASTNode> NumberNode::differentiate(char) const {
+    return number(0.0);
+}
+
+std::unique_ptr<ASTNode> NumberNode::simplify() const { return clone(); }
+
+std::string NumberNode::to_string() const {
+    if (std::fabs(value) == M_PI) {
+        return value < 0 ? "-pi" : "pi";
+    }
+    if (std::fabs(value) == M_E) {
+        return value < 0 ? "-e" : "e";
+    }
+    // The parser reads plain decimals only, so no exponent notation
+    char buffer[512];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value,
+                                std::chars_format::fixed);
+    return std::string(buffer, result.ptr);
+}
+
+int NumberNode::precedence() const {
+    return value < 0 ? NEGATION_PRECEDENCE : ATOM_PRECEDENCE;
+}
+
 // VariableNode Implementation
 VariableNode::VariableNode(char var, AnalysisParameters &params)
     : name(var), parameters(params) {}
@@ -48,6 +119,30 @@ bool VariableNode::contains_variable(char variable) const {
                              // specified variable
 }
 
+int VariableNode::compile(CompiledExpression &program) const {
+    // Only the independent variable changes between samples
+    if (name == parameters.get_variable()) {
+        return program.add_variable(name);
+    }
+    if (parameters.is_independent_variable(name)) {
+        return program.add_second_variable(name); // y or t
+    }
+    return program.add_constant(evaluate(), std::string(1, name));
+}
+
+std::unique_ptr<ASTNode> VariableNode::clone() const {
+    return std::make_unique<VariableNode>(name, parameters);
+}
+
+// Other variables (y, t) are held constant: a partial derivative
+std::unique_ptr<ASTNode> VariableNode::differentiate(char variable) const {
+    return number(name == variable ? 1.0 : 0.0);
+}
+
+std::unique_ptr<ASTNode> VariableNode::simplify() const { return clone(); }
+
+std::string VariableNode::to_string() const { return std::string(1, name); }
+
 // BinaryOpNode Implementation
 BinaryOpNode::BinaryOpNode(char oper, std::unique_ptr<ASTNode> l,
                            std::unique_ptr<ASTNode> r)
@@ -77,6 +172,292 @@ bool BinaryOpNode::contains_variable(char variable) const {
            right->contains_variable(variable);
 }
 
+int BinaryOpNode::compile(CompiledExpression &program) const {
+    int left_slot = left->compile(program);
+    int right_slot = right->compile(program);
+    return program.add_binary(op, left_slot, right_slot);
+}
+
+std::unique_ptr<ASTNode> BinaryOpNode::clone() const {
+    return binary(op, left->clone(), right->clone());
+}
+
+std::unique_ptr<ASTNode> BinaryOpNode::differentiate(char variable) const {
+    if (!contains_variable(variable)) {
+        return number(0.0);
+    }
+    switch (op) {
+    case '+':
+    case '-':
+        return binary(op, left->differentiate(variable),
+                      right->differentiate(variable));
+    case '*': // u'v + uv'
+        return binary('+',
+                      binary('*', left->differentiate(variable),
+                             right->clone()),
+                      binary('*', left->clone(),
+                             right->differentiate(variable)));
+    case '/': // (u'v - uv') / v^2
+        return binary(
+            '/',
+            binary('-',
+                   binary('*', left->differentiate(variable), right->clone()),
+                   binary('*', left->clone(), right->differentiate(variable))),
+            binary('^', right->clone(), number(2.0)));
+    case '^':
+        if (!right->contains_variable(variable)) { // v u^(v-1) u'
+            return binary(
+                '*',
+                binary('*', right->clone(),
+                       binary('^', left->clone(),
+                              binary('-', right->clone(), number(1.0)))),
+                left->differentiate(variable));
+        }
+        if (!left->contains_variable(variable)) { // u^v ln(u) v'
+            return binary('*',
+                          binary('*', clone(), function("ln", left->clone())),
+                          right->differentiate(variable));
+        }
+        // u^v (v' ln(u) + v u' / u)
+        return binary(
+            '*', clone(),
+            binary('+',
+                   binary('*', right->differentiate(variable),
+                          function("ln", left->clone())),
+                   binary('/',
+                          binary('*', right->clone(),
+                                 left->differentiate(variable)),
+                          left->clone())));
+    default:
+        throw std::runtime_error("Unknown operator");
+    }
+}
+
+std::unique_ptr<ASTNode> BinaryOpNode::simplify() const {
+    return make(op, left->simplify(), right->simplify());
+}
+
+std::unique_ptr<ASTNode> BinaryOpNode::make(char oper,
+                                            std::unique_ptr<ASTNode> l,
+                                            std::unique_ptr<ASTNode> r) {
+    const NumberNode *left_number = as_number(l);
+    const NumberNode *right_number = as_number(r);
+    if (left_number != nullptr && right_number != nullptr) {
+        // Folding would lose 1/0 and friends as text, so keep those
+        double value = BinaryOpNode(oper, l->clone(), r->clone()).evaluate();
+        if (std::isfinite(value)) {
+            return number(value);
+        }
+    }
+    auto *left_binary = dynamic_cast<BinaryOpNode *>(l.get());
+    auto *right_binary = dynamic_cast<BinaryOpNode *>(r.get());
+    bool left_negated = left_binary != nullptr && left_binary->is_negation();
+    bool right_negated =
+        right_binary != nullptr && right_binary->is_negation();
+
+    switch (oper) {
+    case '+':
+        if (is_number(l, 0.0)) {
+            return r;
+        }
+        if (is_number(r, 0.0)) {
+            return l;
+        }
+        if (l->to_string() == r->to_string()) {
+            return make('*', number(2.0), std::move(l));
+        }
+        if (right_negated) { // a + -b = a - b
+            return make('-', std::move(l), std::move(right_binary->right));
+        }
+        if (starts_negative(r)) { // a + -2*b = a - 2*b
+            return make('-', std::move(l), negate(std::move(r)));
+        }
+        break;
+    case '-':
+        if (is_number(r, 0.0)) {
+            return l;
+        }
+        if (is_number(l, 0.0)) {
+            return negate(std::move(r));
+        }
+        if (l->to_string() == r->to_string()) {
+            return number(0.0);
+        }
+        if (right_negated) { // a - -b = a + b
+            return make('+', std::move(l), std::move(right_binary->right));
+        }
+        if (starts_negative(r)) { // a - -2*b = a + 2*b
+            return make('+', std::move(l), negate(std::move(r)));
+        }
+        break;
+    case '*':
+        if (is_number(l, 0.0) || is_number(r, 0.0)) {
+            return number(0.0);
+        }
+        if (is_number(l, 1.0)) {
+            return r;
+        }
+        if (is_number(r, 1.0)) {
+            return l;
+        }
+        if (is_number(l, -1.0)) {
+            return negate(std::move(r));
+        }
+        if (is_number(r, -1.0)) {
+            return negate(std::move(l));
+        }
+        if (left_negated) {
+            return negate(
+                make('*', std::move(left_binary->right), std::move(r)));
+        }
+        if (right_negated) {
+            return negate(
+                make('*', std::move(l), std::move(right_binary->right)));
+        }
+        if (right_number != nullptr) { // Constant factor first: 2*x
+            return make('*', std::move(r), std::move(l));
+        }
+        if (right_binary != nullptr && right_binary->op == '/' &&
+            is_number(right_binary->left, 1.0)) { // a*(1/b) = a/b
+            return make('/', std::move(l), std::move(right_binary->right));
+        }
+        if (left_binary != nullptr && left_binary->op == '/' &&
+            is_number(left_binary->left, 1.0)) { // (1/a)*b = b/a
+            return make('/', std::move(r), std::move(left_binary->right));
+        }
+        if (right_binary != nullptr && right_binary->op == '*' &&
+            as_number(right_binary->left) != nullptr) {
+            // 2*(3*x) = 6*x, x*(2*y) = 2*(x*y)
+            return left_number != nullptr
+                       ? make('*',
+                              make('*', std::move(l),
+                                   std::move(right_binary->left)),
+                              std::move(right_binary->right))
+                       : make('*', std::move(right_binary->left),
+                              make('*', std::move(l),
+                                   std::move(right_binary->right)));
+        }
+        if (l->to_string() == r->to_string()) {
+            return make('^', std::move(l), number(2.0));
+        }
+        break;
+    case '/':
+        if (is_number(l, 0.0)) {
+            return number(0.0);
+        }
+        if (is_number(r, 1.0)) {
+            return l;
+        }
+        if (is_number(r, -1.0)) {
+            return negate(std::move(l));
+        }
+        if (l->to_string() == r->to_string()) {
+            return number(1.0);
+        }
+        if (left_negated) {
+            return negate(
+                make('/', std::move(left_binary->right), std::move(r)));
+        }
+        if (right_negated) {
+            return negate(
+                make('/', std::move(l), std::move(right_binary->right)));
+        }
+        break;
+    case '^':
+        if (is_number(r, 0.0) || is_number(l, 1.0)) {
+            return number(1.0);
+        }
+        if (is_number(r, 1.0)) {
+            return l;
+        }
+        if (left_binary != nullptr && left_binary->op == '^' &&
+            right_number != nullptr) {
+            // (x^2)^3 = x^6; only integer powers, as (x^2)^0.5 is |x|
+            const NumberNode *inner = as_number(left_binary->right);
+            double outer = right_number->evaluate();
+            if (inner != nullptr && outer == std::round(outer) &&
+                inner->evaluate() == std::round(inner->evaluate())) {
+                return make('^', std::move(left_binary->left),
+                            number(inner->evaluate() * outer));
+            }
+        }
+        break;
+    }
+    return binary(oper, std::move(l), std::move(r));
+}
+
+std::unique_ptr<ASTNode>
+BinaryOpNode::negate(std::unique_ptr<ASTNode> operand) {
+    if (const NumberNode *operand_number = as_number(operand)) {
+        return number(-operand_number->evaluate());
+    }
+    auto *operand_binary = dynamic_cast<BinaryOpNode *>(operand.get());
+    if (operand_binary != nullptr && operand_binary->is_negation()) {
+        return std::move(operand_binary->right);
+    }
+    if (operand_binary != nullptr && operand_binary->op == '*' &&
+        as_number(operand_binary->left) != nullptr) { // -(2*x) = -2*x
+        return make('*', negate(std::move(operand_binary->left)),
+                    std::move(operand_binary->right));
+    }
+    if (operand_binary != nullptr && operand_binary->op == '/' &&
+        starts_negative(operand_binary->left)) { // -(-2*x/y) = 2*x/y
+        return make('/', negate(std::move(operand_binary->left)),
+                    std::move(operand_binary->right));
+    }
+    return binary('-', number(0.0), std::move(operand));
+}
+
+bool BinaryOpNode::is_negation() const {
+    return op == '-' && is_number(left, 0.0);
+}
+
+bool BinaryOpNode::starts_negative(const std::unique_ptr<ASTNode> &node) {
+    if (const NumberNode *node_number = as_number(node)) {
+        return node_number->evaluate() < 0;
+    }
+    auto *node_binary = dynamic_cast<const BinaryOpNode *>(node.get());
+    if (node_binary == nullptr) {
+        return false;
+    }
+    const NumberNode *factor = as_number(node_binary->left);
+    return (node_binary->op == '*' && factor != nullptr &&
+            factor->evaluate() < 0) ||
+           (node_binary->op == '/' && starts_negative(node_binary->left));
+}
+
+std::string BinaryOpNode::to_string() const {
+    if (is_negation()) {
+        return "-" + parenthesize(*right, right->precedence() <=
+                                              NEGATION_PRECEDENCE);
+    }
+    int own = precedence();
+    // ^ groups left to right in the parser; bracket both sides anyway so
+    // a^b^c is never left to the reader
+    bool left_parens = op == '^' ? left->precedence() <= own
+                                 : left->precedence() < own;
+    bool right_parens = right->precedence() <= own ||
+                        right->precedence() == NEGATION_PRECEDENCE;
+    return parenthesize(*left, left_parens) + std::string(1, op) +
+           parenthesize(*right, right_parens);
+}
+
+int BinaryOpNode::precedence() const {
+    if (is_negation()) {
+        return NEGATION_PRECEDENCE;
+    }
+    switch (op) {
+    case '+':
+    case '-':
+        return 1;
+    case '*':
+    case '/':
+        return 2;
+    default:
+        return 4; // ^
+    }
+}
+
 // FunctionNode Implementation
 FunctionNode::FunctionNode(const std::string &f, std::unique_ptr<ASTNode> arg)
     : func(f), argument(std::move(arg)) {}
@@ -108,13 +489,77 @@ bool FunctionNode::contains_variable(char variable) const {
     return argument->contains_variable(variable);
 }
 
+int FunctionNode::compile(CompiledExpression &program) const {
+    return program.add_function(func, argument->compile(program));
+}
+
+std::unique_ptr<ASTNode> FunctionNode::clone() const {
+    return function(func, argument->clone());
+}
+
+std::unique_ptr<ASTNode> FunctionNode::differentiate(char variable) const {
+    if (!contains_variable(variable)) {
+        return number(0.0);
+    }
+    const std::unique_ptr<ASTNode> &a = argument;
+    std::unique_ptr<ASTNode> outer;
+    if (func == "sin") {
+        outer = function("cos", a->clone());
+    } else if (func == "cos") {
+        outer = binary('-', number(0.0), function("sin", a->clone()));
+    } else if (func == "tan") { // 1 / cos(a)^2
+        outer = binary('/', number(1.0),
+                       binary('^', function("cos", a->clone()), number(2.0)));
+    } else if (func == "arcsin" || func == "arccos") { // +-1 / sqrt(1 - a^2)
+        outer = binary(
+            '/', number(func == "arcsin" ? 1.0 : -1.0),
+            function("sqrt", binary('-', number(1.0),
+                                    binary('^', a->clone(), number(2.0)))));
+    } else if (func == "arctan") { // 1 / (1 + a^2)
+        outer = binary('/', number(1.0),
+                       binary('+', number(1.0),
+                              binary('^', a->clone(), number(2.0))));
+    } else if (func == "log") { // 1 / (ln(10) a), ln(10) folded
+        outer = binary('/', number(1.0),
+                       binary('*', number(std::log(10.0)), a->clone()));
+    } else if (func == "ln") {
+        outer = binary('/', number(1.0), a->clone());
+    } else if (func == "sqrt") { // 1 / (2 sqrt(a))
+        outer = binary('/', number(1.0), binary('*', number(2.0), clone()));
+    } else {
+        throw std::runtime_error("Unknown function");
+    }
+    return binary('*', std::move(outer), a->differentiate(variable));
+}
+
+std::unique_ptr<ASTNode> FunctionNode::simplify() const {
+    auto simplified = argument->simplify();
+    bool constant = as_number(simplified) != nullptr;
+    auto node = function(func, std::move(simplified));
+    // cos(0), ln(1), sqrt(4): fold only when the value stays readable
+    if (constant) {
+        double value = node->evaluate();
+        if (std::isfinite(value) && value == std::round(value)) {
+            return number(value);
+        }
+    }
+    return node;
+}
+
+std::string FunctionNode::to_string() const {
+    return func + "(" + argument->to_string() + ")";
+}
+
 // Function to generate AST from expression
 std::unique_ptr<ASTNode>
 generate_ast_from_expression(const std::string &expression,
                              AnalysisParameters &params) {
+    TRACE_SPAN_NAMED(tokenize_span, "tokenize", "parse");
     Tokenizer tokenizer;
     auto tokens = tokenizer.tokenize(expression);
+    TRACE_END(tokenize_span);
 
+    TRACE_SPAN("parse", "parse");
     Parser parser(tokens, params); // Pass AnalysisParameters to the parser
     return parser.parse();         // This returns the root node of the AST
 }
@@ -123,3 +568,8 @@ generate_ast_from_expression(const std::string &expression,
 double evaluate_expression(const std::unique_ptr<ASTNode> &ast) {
     return ast->evaluate();
 }
+
+std::unique_ptr<ASTNode> differentiate_ast(const ASTNode &ast, char variable) {
+    TRACE_SPAN("differentiate", "parse");
+    return ast.differentiate(variable)->simplify();
+}
@@ -0,0 +1,405 @@
+#include "batch_cli.hpp"
+#include "eval_server.hpp"
+#include "expression_profile.hpp"
+#include "pipe_filter.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <csignal>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+std::atomic<bool> stop_requested(false);
+
+void request_stop(int) { stop_requested = true; }
+
+long long parse_count(const std::string &value) {
+    // Accepts plain integers as well as 1e6-style counts
+    size_t pos;
+    double count = std::stod(value, &pos);
+    // Range first: the cast is undefined for inf and for counts past
+    // long long
+    if (pos != value.length() || !std::isfinite(count) || count < 0 ||
+        count > AnalysisParameters::MAX_STREAM_SAMPLES ||
+        count != std::floor(count)) {
+        throw std::invalid_argument("Invalid sample count '" + value + "'.");
+    }
+    return static_cast<long long>(count);
+}
+
+int parse_int(const std::string &value) {
+    size_t pos;
+    int result = std::stoi(value, &pos);
+    if (pos != value.length()) {
+        throw std::invalid_argument("Invalid integer '" + value + "'.");
+    }
+    return result;
+}
+
+ExportFormat parse_format(const std::string &value) {
+    if (value == "txt" || value == "text") {
+        return ExportFormat::Text;
+    }
+    if (value == "bin" || value == "binary") {
+        return ExportFormat::Binary;
+    }
+    if (value == "gor" || value == "archive") {
+        return ExportFormat::Archive;
+    }
+    throw std::invalid_argument("Unknown format '" + value +
+                                "', expected txt, bin or gor.");
+}
+
+} // namespace
+
+BatchCLI::BatchCLI(int argc, char **argv)
+    : arguments_(argv + 1, argv + argc),
+      workers_(std::thread::hardware_concurrency()), quiet_(false),
+      profile_(false), help_(false) {}
+
+void BatchCLI::print_usage(std::ostream &out) {
+    out << "Usage: calculator [options]\n"
+           "Without options the interactive TUI is started.\n"
+           "\n"
+           "  --expr EXPR        expression to evaluate\n"
+           "  --var V            independent variable (default x)\n"
+           "  --domain A:B       integer domain (default -100:100)\n"
+           "  --samples N        intervals to sample, e.g. 1e6 "
+           "(default 10000)\n"
+           "  --out PATH         output file; the format's extension is "
+           "added\n"
+           "                     when PATH has none (default output)\n"
+           "  --format F         txt, bin or gor (default txt)\n"
+           "  --precision P      significant digits for txt, 0 = shortest\n"
+           "  --jobs FILE        run every job listed in FILE\n"
+           "  --pipe F           read x values from stdin and write y to\n"
+           "                     stdout; F is txt, bin or IN:OUT, e.g. "
+           "txt:bin\n"
+           "  --serve SOCKET     serve evaluation requests on a Unix "
+           "socket\n"
+           "  --workers N        connections served at once with --serve\n"
+           "  --trace FILE       write a Chrome trace of the run to FILE\n"
+           "  --quiet            do not print a summary per job\n"
+           "  --profile          print where each job's evaluation time "
+           "goes\n"
+           "  --help             show this message\n"
+           "\n"
+           "Each non-empty line of a job file that does not start with '#'\n"
+           "is one job: optional name=value overrides (expr is not one of\n"
+           "them) followed by the expression, e.g.\n"
+           "  out=wave samples=1e6 format=bin sin(x) * cos(x / 3)\n";
+}
+
+void BatchCLI::apply_option(BatchJob &job, const std::string &name,
+                            const std::string &value) const {
+    if (name == "expr") {
+        job.expression = value;
+    } else if (name == "var") {
+        if (value.length() != 1) {
+            throw std::invalid_argument("Variable must be a single character.");
+        }
+        job.variable = value[0];
+    } else if (name == "domain") {
+        size_t colon = value.find(':', 1);
+        if (colon == std::string::npos) {
+            throw std::invalid_argument("Domain must be given as START:END.");
+        }
+        job.start = parse_int(value.substr(0, colon));
+        job.end = parse_int(value.substr(colon + 1));
+    } else if (name == "samples") {
+        job.samples = parse_count(value);
+    } else if (name == "out") {
+        job.output = value;
+    } else if (name == "format") {
+        job.format = parse_format(value);
+    } else if (name == "precision") {
+        job.precision = parse_int(value);
+    } else {
+        throw std::invalid_argument("Unknown option '" + name + "'.");
+    }
+}
+
+void BatchCLI::parse_arguments() {
+    for (size_t i = 0; i < arguments_.size(); ++i) {
+        const std::string &argument = arguments_[i];
+        if (argument == "--help" || argument == "-h") {
+            help_ = true;
+            continue;
+        }
+        if (argument == "--quiet") {
+            quiet_ = true;
+            continue;
+        }
+        if (argument == "--profile") {
+            profile_ = true;
+            continue;
+        }
+        if (argument.rfind("--", 0) != 0) {
+            throw std::invalid_argument("Unexpected argument '" + argument +
+                                        "'.");
+        }
+        if (i + 1 >= arguments_.size()) {
+            throw std::invalid_argument("Missing value for '" + argument +
+                                        "'.");
+        }
+        const std::string name = argument.substr(2);
+        const std::string &value = arguments_[++i];
+        if (name == "jobs") {
+            job_file_ = value;
+        } else if (name == "pipe") {
+            PipeFormat input, output;
+            parse_pipe_formats(value, input, output); // Validate early
+            pipe_formats_ = value;
+        } else if (name == "trace") {
+#ifndef CALCULATOR_TELEMETRY
+            throw std::invalid_argument("--trace needs a build with "
+                                        "CALCULATOR_TELEMETRY=ON.");
+#endif
+            trace_path_ = value;
+        } else if (name == "serve") {
+            socket_path_ = value;
+        } else if (name == "workers") {
+            int workers = parse_int(value);
+            if (workers < 1) {
+                throw std::invalid_argument("Workers must be at least 1.");
+            }
+            workers_ = workers;
+        } else {
+            apply_option(defaults_, name, value);
+        }
+    }
+}
+
+std::vector<BatchJob> BatchCLI::load_job_file(const std::string &path) const {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Cannot open job file '" + path + "'.");
+    }
+
+    std::vector<BatchJob> jobs;
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        ++line_number;
+        std::istringstream stream(line);
+        std::string word;
+        BatchJob job = defaults_;
+        job.expression.clear();
+        bool has_output = false;
+        while (stream >> word) {
+            size_t equals = word.find('=');
+            if (!job.expression.empty() || equals == std::string::npos) {
+                job.expression += (job.expression.empty() ? "" : " ") + word;
+                continue;
+            }
+            std::string name = word.substr(0, equals);
+            has_output = has_output || name == "out";
+            if (name == "expr") {
+                throw std::invalid_argument(
+                    "Line " + std::to_string(line_number) +
+                    ": write the expression after the options.");
+            }
+            apply_option(job, name, word.substr(equals + 1));
+        }
+        if (job.expression.empty() || job.expression[0] == '#') {
+            continue;
+        }
+        if (!has_output) {
+            // Keep jobs from overwriting each other's default output
+            job.output = defaults_.output + "_" + std::to_string(jobs.size());
+        }
+        jobs.push_back(job);
+    }
+    return jobs;
+}
+
+void BatchCLI::run_job(const BatchJob &job, AnalysisParameters &params) const {
+    params.set_domain(job.start, job.end);
+    if (job.variable != params.get_variable()) {
+        params.set_variable(job.variable);
+    }
+    params.set_export_precision(job.precision);
+    params.set_stream_samples(job.samples);
+    params.set_expression(job.expression); // Compiled once per job
+
+    std::filesystem::path path(job.output);
+    if (!path.has_extension()) {
+        path += extension_for(job.format);
+    }
+
+    auto sink = make_chunk_sink(job.format, path, params, job.samples);
+    StreamExporter streamer(params);
+    ExportStats stats = streamer.run(job.samples, *sink);
+
+    if (!quiet_) {
+        std::cout << path.string() << ": " << params.display_expression()
+                  << ", " << stats.rows << " rows, " << stats.bytes / 1e6
+                  << " MB in " << stats.seconds * 1e3 << " ms ("
+                  << stats.megabytes_per_second() << " MB/s)\n";
+    }
+    if (profile_) {
+        print_profile(job, params);
+    }
+}
+
+void BatchCLI::print_profile(const BatchJob &job,
+                             const AnalysisParameters &params) const {
+    // Timing every instruction is slow, so a large job is profiled on an
+    // evenly spaced subset of its grid
+    constexpr long long MAX_PROFILED_SAMPLES = 1 << 20;
+    size_t count = static_cast<size_t>(
+        std::min(job.samples, MAX_PROFILED_SAMPLES) + 1);
+    double step = static_cast<double>(job.end - job.start) / (count - 1);
+    std::vector<double> xs(count);
+    for (size_t i = 0; i < count; ++i) {
+        xs[i] = job.start + i * step;
+    }
+    std::vector<double> ys(count);
+
+    const CompiledExpression &expression = params.get_compiled_expression();
+    ExpressionProfile profile(expression);
+    expression.evaluate_profiled(xs.data(), ys.data(), count, profile);
+
+    std::cout << "profile: " << params.display_expression() << "\n";
+    for (const std::string &line : profile.report(100)) {
+        std::cout << "  " << line << "\n";
+    }
+}
+
+void BatchCLI::run_pipe(AnalysisParameters &params) const {
+    if (defaults_.variable != params.get_variable()) {
+        params.set_variable(defaults_.variable);
+    }
+    params.set_expression(defaults_.expression);
+
+    PipeFormat input, output;
+    parse_pipe_formats(pipe_formats_, input, output);
+    PipeFilter filter(params.get_compiled_expression(), input, output,
+                      defaults_.precision);
+    ExportStats stats = filter.run(STDIN_FILENO, STDOUT_FILENO);
+
+    // stdout carries the data, so the summary goes to stderr
+    if (!quiet_) {
+        std::cerr << "pipe: " << params.display_expression() << ", "
+                  << stats.rows << " values, " << stats.bytes / 1e6
+                  << " MB in " << stats.seconds * 1e3 << " ms ("
+                  << stats.megabytes_per_second() << " MB/s)\n";
+    }
+}
+
+void BatchCLI::run_server() const {
+    EvaluationServer server(socket_path_, workers_);
+    std::signal(SIGINT, request_stop);
+    std::signal(SIGTERM, request_stop);
+    if (!quiet_) {
+        std::cerr << "serving on " << socket_path_ << " with " << workers_
+                  << " workers\n";
+    }
+    server.run(stop_requested);
+
+    if (!quiet_) {
+        const ExpressionCache &cache = server.get_cache();
+        std::cerr << "served " << server.get_requests() << " requests, "
+                  << cache.get_hits() << " cache hits, "
+                  << cache.get_misses() << " misses\n";
+    }
+}
+
+int BatchCLI::run() {
+    std::vector<BatchJob> jobs;
+    try {
+        parse_arguments();
+        if (help_) {
+            print_usage(std::cout);
+            return 0;
+        }
+        if (!socket_path_.empty()) {
+            if (!pipe_formats_.empty() || !job_file_.empty()) {
+                throw std::invalid_argument("--serve cannot be combined "
+                                            "with --pipe or --jobs.");
+            }
+        } else if (!pipe_formats_.empty()) {
+            if (defaults_.expression.empty() || !job_file_.empty()) {
+                throw std::invalid_argument("--pipe needs --expr and no "
+                                            "--jobs.");
+            }
+        } else if (!job_file_.empty()) {
+            jobs = load_job_file(job_file_);
+        } else if (!defaults_.expression.empty()) {
+            jobs.push_back(defaults_);
+        } else {
+            throw std::invalid_argument("Nothing to do: give --expr or "
+                                        "--jobs.");
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "calculator: " << e.what() << "\n\n";
+        print_usage(std::cerr);
+        return 2;
+    }
+
+#ifdef CALCULATOR_TELEMETRY
+    if (!trace_path_.empty()) {
+        TRACE_THREAD_NAME("main");
+        Tracer::instance().start();
+    }
+#endif
+    int status = execute(jobs);
+#ifdef CALCULATOR_TELEMETRY
+    if (!trace_path_.empty()) {
+        Tracer::instance().stop();
+        try {
+            size_t spans = Tracer::instance().write(trace_path_);
+            if (!quiet_) {
+                std::cerr << "trace: " << spans << " spans written to "
+                          << trace_path_ << "\n";
+            }
+        } catch (const std::exception &e) {
+            std::cerr << "calculator: " << e.what() << "\n";
+            status = 1;
+        }
+    }
+#endif
+    return status;
+}
+
+int BatchCLI::execute(const std::vector<BatchJob> &jobs) const {
+    // One parameter set is reused so only the expression is re-parsed
+    AnalysisParameters params(-100, 100, 10000);
+    if (!socket_path_.empty()) {
+        try {
+            run_server();
+            return 0;
+        } catch (const std::exception &e) {
+            std::cerr << "calculator: " << e.what() << "\n";
+            return 1;
+        }
+    }
+    if (!pipe_formats_.empty()) {
+        try {
+            run_pipe(params);
+            return 0;
+        } catch (const std::exception &e) {
+            std::cerr << "calculator: " << e.what() << "\n";
+            return 1;
+        }
+    }
+    int failures = 0;
+    for (const BatchJob &job : jobs) {
+        try {
+            TRACE_SPAN("job", "batch");
+            run_job(job, params);
+        } catch (const std::exception &e) {
+            std::cerr << "calculator: " << job.expression << ": " << e.what()
+                      << "\n";
+            ++failures;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
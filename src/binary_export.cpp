@@ -0,0 +1,336 @@
+#include "binary_export.hpp"
+#include "telemetry.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+std::uint64_t align_up(std::uint64_t offset) {
+    const std::uint64_t alignment = BinaryRunHeader::COLUMN_ALIGNMENT;
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+// BinaryExporter Implementation
+BinaryExporter::BinaryExporter(const std::filesystem::path &path,
+                               const BinaryRunInfo &info)
+    : fd_(-1), info_(info), header_{} {
+    const std::uint64_t width = info.float32 ? sizeof(float) : sizeof(double);
+
+    std::memcpy(header_.magic, BinaryRunHeader::MAGIC, sizeof(header_.magic));
+    header_.version =
+        info.grid ? BinaryRunHeader::GRID_VERSION : BinaryRunHeader::VERSION;
+    header_.flags = (info.float32 ? BinaryRunHeader::FLOAT32_COLUMNS : 0) |
+                    (info.explicit_x ? BinaryRunHeader::EXPLICIT_X : 0) |
+                    (info.grid ? BinaryRunHeader::GRID : 0);
+    header_.sample_count = info.sample_count;
+    header_.start = info.start;
+    header_.end = info.end;
+    header_.step = info.step;
+    header_.expression_length =
+        static_cast<std::uint32_t>(info.expression.size());
+    header_.variable = info.variable;
+
+    std::uint64_t offset =
+        align_up(sizeof(BinaryRunHeader) + info.expression.size());
+    if (info.explicit_x) {
+        header_.x_offset = offset;
+        offset = align_up(offset + info.sample_count * width);
+    } else if (info.grid) {
+        header_.x_offset = offset;
+        offset = align_up(offset + sizeof(BinaryGridHeader));
+    }
+    header_.y_offset = offset;
+    file_size_ = offset + info.sample_count * width;
+
+    fd_ = open_output_file(path);
+    try {
+        if (::ftruncate(fd_, static_cast<off_t>(file_size_)) != 0) {
+            throw std::runtime_error("Error sizing output file: " +
+                                     std::string(std::strerror(errno)));
+        }
+        pwrite_fully(fd_, &header_, sizeof(header_), 0);
+        pwrite_fully(fd_, info.expression.data(), info.expression.size(),
+                     sizeof(header_));
+        if (info.grid) {
+            pwrite_fully(fd_, &*info.grid, sizeof(BinaryGridHeader),
+                         header_.x_offset);
+        }
+    } catch (...) {
+        ::close(fd_);
+        throw;
+    }
+}
+
+BinaryExporter::~BinaryExporter() { close(); }
+
+void BinaryExporter::write_column(const double *values, size_t count,
+                                  std::uint64_t offset) {
+    if (!info_.float32) {
+        pwrite_fully(fd_, values, count * sizeof(double), offset);
+        return;
+    }
+    std::vector<float> narrowed(values, values + count);
+    pwrite_fully(fd_, narrowed.data(), count * sizeof(float), offset);
+}
+
+void BinaryExporter::write_chunk(size_t first_index,
+                                 const SampleSeries &chunk) {
+    if (first_index + chunk.size() > info_.sample_count) {
+        throw std::out_of_range("Chunk extends past the end of the run.");
+    }
+    const std::uint64_t width =
+        info_.float32 ? sizeof(float) : sizeof(double);
+
+    if (info_.explicit_x) {
+        std::vector<double> materialized;
+        const double *x = chunk.x_data();
+        if (!x) {
+            materialized.resize(chunk.size());
+            for (size_t i = 0; i < chunk.size(); ++i) {
+                materialized[i] = chunk.x(i);
+            }
+            x = materialized.data();
+        }
+        write_column(x, chunk.size(), header_.x_offset + first_index * width);
+    }
+    write_column(chunk.y_data(), chunk.size(),
+                 header_.y_offset + first_index * width);
+}
+
+void BinaryExporter::close() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+size_t BinaryExporter::file_size() const { return file_size_; }
+
+ExportStats BinaryExporter::write(const std::filesystem::path &path,
+                                  const SampleSeries &series,
+                                  const std::string &expression,
+                                  char variable, bool float32) {
+    TELEMETRY_SCOPE(TelemetryStage::Export);
+    auto started = std::chrono::steady_clock::now();
+
+    BinaryRunInfo info;
+    info.expression = expression;
+    info.variable = variable;
+    info.sample_count = series.size();
+    info.explicit_x = !series.is_uniform();
+    info.float32 = float32;
+    if (!series.empty()) {
+        info.start = series.x(0);
+        info.end = series.x(series.size() - 1);
+        info.step = series.get_step();
+    }
+
+    BinaryExporter exporter(path, info);
+    exporter.write_chunk(0, series);
+    exporter.close();
+
+    ExportStats stats;
+    stats.rows = series.size();
+    stats.bytes = exporter.file_size();
+    stats.seconds = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - started)
+                        .count();
+    return stats;
+}
+
+ExportStats BinaryExporter::write_grid(const std::filesystem::path &path,
+                                       const SurfaceGrid &grid,
+                                       const std::string &expression,
+                                       char variable, bool float32) {
+    TELEMETRY_SCOPE(TelemetryStage::Export);
+    auto started = std::chrono::steady_clock::now();
+
+    BinaryRunInfo info;
+    info.expression = expression;
+    info.variable = variable;
+    info.sample_count = grid.size();
+    info.float32 = float32;
+    info.start = grid.get_min_x();
+    info.end = grid.get_max_x();
+    info.grid = BinaryGridHeader{grid.get_columns(), grid.get_rows(),
+                                 grid.get_min_x(),   grid.get_max_x(),
+                                 grid.get_min_y(),   grid.get_max_y()};
+
+    BinaryExporter exporter(path, info);
+    exporter.write_column(grid.data(), grid.size(), exporter.header_.y_offset);
+    exporter.close();
+
+    ExportStats stats;
+    stats.rows = grid.size();
+    stats.bytes = exporter.file_size();
+    stats.seconds = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - started)
+                        .count();
+    return stats;
+}
+
+// BinaryChunkSink Implementation
+BinaryChunkSink::BinaryChunkSink(const std::filesystem::path &path,
+                                 const BinaryRunInfo &info)
+    : exporter_(path, info), next_index_(0) {}
+
+void BinaryChunkSink::write_chunk(const SampleSeries &chunk) {
+    exporter_.write_chunk(next_index_, chunk);
+    next_index_ += chunk.size();
+}
+
+void BinaryChunkSink::finish() { exporter_.close(); }
+
+size_t BinaryChunkSink::bytes_written() const {
+    return exporter_.file_size();
+}
+
+// MappedRun Implementation
+MappedRun::MappedRun(const std::filesystem::path &path)
+    : data_(nullptr), length_(0), header_(nullptr) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Error opening run file: " +
+                                 std::string(std::strerror(errno)));
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0 ||
+        static_cast<size_t>(info.st_size) < sizeof(BinaryRunHeader)) {
+        ::close(fd);
+        throw std::runtime_error("Not a binary run file.");
+    }
+    length_ = static_cast<size_t>(info.st_size);
+    void *mapping = ::mmap(nullptr, length_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Error mapping run file: " +
+                                 std::string(std::strerror(errno)));
+    }
+    data_ = static_cast<const unsigned char *>(mapping);
+    header_ = reinterpret_cast<const BinaryRunHeader *>(data_);
+
+    // Validate everything the accessors rely on, so they need no checks
+    const std::uint64_t width = is_float32() ? sizeof(float) : sizeof(double);
+    const std::uint64_t column_bytes = header_->sample_count * width;
+    bool valid =
+        std::memcmp(header_->magic, BinaryRunHeader::MAGIC,
+                    sizeof(header_->magic)) == 0 &&
+        (header_->flags & ~BinaryRunHeader::KNOWN_FLAGS) == 0 &&
+        header_->version == (is_grid() ? BinaryRunHeader::GRID_VERSION
+                                       : BinaryRunHeader::VERSION) &&
+        !(is_grid() && (header_->flags & BinaryRunHeader::EXPLICIT_X)) &&
+        sizeof(BinaryRunHeader) + header_->expression_length <= length_ &&
+        header_->sample_count <= length_ / width &&
+        header_->y_offset % BinaryRunHeader::COLUMN_ALIGNMENT == 0 &&
+        header_->y_offset <= length_ &&
+        column_bytes <= length_ - header_->y_offset;
+    if (valid && is_grid()) {
+        valid = header_->x_offset % BinaryRunHeader::COLUMN_ALIGNMENT == 0 &&
+                header_->x_offset <= length_ &&
+                sizeof(BinaryGridHeader) <= length_ - header_->x_offset &&
+                get_grid().columns * get_grid().rows ==
+                    header_->sample_count;
+    } else if (valid && !is_uniform()) {
+        valid = header_->x_offset % BinaryRunHeader::COLUMN_ALIGNMENT == 0 &&
+                header_->x_offset <= length_ &&
+                column_bytes <= length_ - header_->x_offset;
+    }
+    if (!valid) {
+        ::munmap(const_cast<unsigned char *>(data_), length_);
+        throw std::runtime_error("Not a binary run file.");
+    }
+
+    expression_.assign(
+        reinterpret_cast<const char *>(data_ + sizeof(BinaryRunHeader)),
+        header_->expression_length);
+}
+
+MappedRun::~MappedRun() {
+    if (data_) {
+        ::munmap(const_cast<unsigned char *>(data_), length_);
+    }
+}
+
+const std::string &MappedRun::get_expression() const { return expression_; }
+
+char MappedRun::get_variable() const { return header_->variable; }
+
+double MappedRun::get_start() const { return header_->start; }
+
+double MappedRun::get_end() const { return header_->end; }
+
+double MappedRun::get_step() const { return header_->step; }
+
+size_t MappedRun::size() const { return header_->sample_count; }
+
+bool MappedRun::is_float32() const {
+    return header_->flags & BinaryRunHeader::FLOAT32_COLUMNS;
+}
+
+bool MappedRun::is_uniform() const {
+    return !(header_->flags &
+             (BinaryRunHeader::EXPLICIT_X | BinaryRunHeader::GRID));
+}
+
+bool MappedRun::is_grid() const {
+    return header_->flags & BinaryRunHeader::GRID;
+}
+
+BinaryGridHeader MappedRun::get_grid() const {
+    BinaryGridHeader grid;
+    std::memcpy(&grid, data_ + header_->x_offset, sizeof(grid));
+    return grid;
+}
+
+double MappedRun::x(size_t index) const {
+    if (is_grid()) {
+        throw std::runtime_error("Run is a surface grid, not a series.");
+    }
+    if (is_uniform()) {
+        return header_->start + static_cast<double>(index) * header_->step;
+    }
+    const unsigned char *column = data_ + header_->x_offset;
+    return is_float32() ? reinterpret_cast<const float *>(column)[index]
+                        : reinterpret_cast<const double *>(column)[index];
+}
+
+double MappedRun::y(size_t index) const {
+    const unsigned char *column = data_ + header_->y_offset;
+    return is_float32() ? reinterpret_cast<const float *>(column)[index]
+                        : reinterpret_cast<const double *>(column)[index];
+}
+
+SampleSeries MappedRun::to_series() const {
+    if (is_grid()) {
+        throw std::runtime_error("Run is a surface grid, not a series.");
+    }
+    if (is_uniform()) {
+        SampleSeries series(header_->start, header_->step, size());
+        double *y_values = series.y_data();
+        if (is_float32()) {
+            const float *column =
+                reinterpret_cast<const float *>(data_ + header_->y_offset);
+            std::copy(column, column + size(), y_values);
+        } else {
+            std::memcpy(y_values, data_ + header_->y_offset,
+                        size() * sizeof(double));
+        }
+        return series;
+    }
+    SampleSeries series;
+    series.reserve(size());
+    for (size_t i = 0; i < size(); ++i) {
+        series.append(x(i), y(i));
+    }
+    return series;
+}
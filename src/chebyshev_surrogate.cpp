@@ -0,0 +1,360 @@
+#include "chebyshev_surrogate.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <numbers>
+#include <utility>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const size_t NODES = ChebyshevSurrogate::NODES;
+const size_t CHECKS = ChebyshevSurrogate::CHECKS;
+const size_t POINTS = NODES + CHECKS; // Evaluated per piece
+
+// Points on [-1, 1], descending: the Chebyshev points of the first kind,
+// then the extrema of T_NODES, which lie halfway between them in angle.
+// basis[j][k] is T_j at node k.
+struct Tables {
+        double points[POINTS];
+        double basis[NODES][NODES];
+};
+
+const Tables &tables() {
+    static const Tables tables = [] {
+        Tables t;
+        for (size_t k = 0; k < NODES; ++k) {
+            t.points[k] = std::cos(std::numbers::pi * (2 * k + 1) /
+                                   (2 * NODES));
+            for (size_t j = 0; j < NODES; ++j) {
+                t.basis[j][k] = std::cos(std::numbers::pi * j * (2 * k + 1) /
+                                         (2 * NODES));
+            }
+        }
+        for (size_t k = 0; k < CHECKS; ++k) {
+            t.points[NODES + k] =
+                std::cos(std::numbers::pi * (k + 1) / NODES);
+        }
+        return t;
+    }();
+    return tables;
+}
+
+struct Piece {
+        double a;
+        double b;
+};
+
+// A piece's interpolant and how well it matched f
+struct Outcome {
+        double coefficients[NODES] = {};
+        double error = 0.0; // Over max(1, |f|)
+        bool finite = true;
+        bool undefined = false; // f is not finite at any point
+};
+
+// Sum of c_j T_j(t) by Clenshaw's recurrence
+inline double clenshaw(const double *c, double t) {
+    double b1 = 0.0, b2 = 0.0;
+    for (size_t j = NODES - 1; j > 0; --j) {
+        double b0 = c[j] + 2.0 * t * b1 - b2;
+        b2 = b1;
+        b1 = b0;
+    }
+    return c[0] + t * b1 - b2;
+}
+
+// Lanes per block of clenshaw_run; a fixed count the compiler can unroll
+// into vector instructions at -O2
+const size_t BLOCK = 64;
+
+template <typename T, typename Step>
+inline void clenshaw_lanes(const double *c, const T *x, T *y, size_t lanes,
+                           double centre, double scale, Step step) {
+    double t[BLOCK], b1[BLOCK], b2[BLOCK];
+    step(lanes, [&](size_t k) {
+        t[k] = (static_cast<double>(x[k]) - centre) * scale;
+        b1[k] = c[NODES - 1];
+        b2[k] = 0.0;
+    });
+    for (size_t j = NODES - 2; j > 0; --j) {
+        step(lanes, [&](size_t k) {
+            double b0 = c[j] + 2.0 * t[k] * b1[k] - b2[k];
+            b2[k] = b1[k];
+            b1[k] = b0;
+        });
+    }
+    step(lanes, [&](size_t k) {
+        y[k] = static_cast<T>(c[0] + t[k] * b1[k] - b2[k]);
+    });
+}
+
+// clenshaw for count points of the piece [a, b], a block of them at a
+// time. Interleaving the points hides the latency of the recurrence, and a
+// full block is a loop of fixed length, which the compiler vectorizes.
+template <typename T>
+void clenshaw_run(const double *c, double a, double b, const T *x, T *y,
+                  size_t count) {
+    double centre = 0.5 * (a + b), scale = 2.0 / (b - a);
+    size_t begin = 0;
+    for (; begin + BLOCK <= count; begin += BLOCK) {
+        clenshaw_lanes(c, x + begin, y + begin, BLOCK, centre, scale,
+                       [](size_t, auto lane) {
+                           for (size_t k = 0; k < BLOCK; ++k) {
+                               lane(k);
+                           }
+                       });
+    }
+    clenshaw_lanes(c, x + begin, y + begin, count - begin, centre, scale,
+                   [](size_t lanes, auto lane) {
+                       for (size_t k = 0; k < lanes; ++k) {
+                           lane(k);
+                       }
+                   });
+}
+
+// The interpolant from the values f takes at a piece's POINTS points
+Outcome interpolate(const double *f) {
+    const Tables &t = tables();
+    Outcome outcome;
+    size_t finite = 0;
+    double magnitude = 1.0;
+    for (size_t k = 0; k < POINTS; ++k) {
+        if (std::isfinite(f[k])) {
+            ++finite;
+            magnitude = std::max(magnitude, std::fabs(f[k]));
+        }
+    }
+    if (finite < POINTS) {
+        outcome.finite = false;
+        outcome.undefined = finite == 0;
+        return outcome;
+    }
+    for (size_t j = 0; j < NODES; ++j) {
+        double sum = 0.0;
+        for (size_t k = 0; k < NODES; ++k) {
+            sum += f[k] * t.basis[j][k];
+        }
+        outcome.coefficients[j] = (j == 0 ? 1.0 : 2.0) * sum / NODES;
+    }
+    // A smooth f has coefficients decaying fast, so the last two bound
+    // what was left out; the check points catch what they miss
+    double error = std::fabs(outcome.coefficients[NODES - 1]) +
+                   std::fabs(outcome.coefficients[NODES - 2]);
+    for (size_t k = NODES; k < POINTS; ++k) {
+        error = std::max(error, std::fabs(clenshaw(outcome.coefficients,
+                                                   t.points[k]) -
+                                          f[k]));
+    }
+    outcome.error = error / magnitude;
+    return outcome;
+}
+
+double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+} // namespace
+
+double SurrogateFit::speedup() const {
+    return surrogate_ns > 0.0 ? exact_ns / surrogate_ns : 0.0;
+}
+
+ChebyshevSurrogate::ChebyshevSurrogate(Evaluator evaluator)
+    : evaluator_(std::move(evaluator)) {}
+
+const SurrogateFit &ChebyshevSurrogate::fit(double a, double b,
+                                            double tolerance) {
+    TRACE_SPAN("fit surrogate", "analysis");
+    Clock::time_point started = Clock::now();
+    fit_ = SurrogateFit();
+    breaks_.clear();
+    coefficients_.clear();
+    exact_.clear();
+    if (a > b) {
+        std::swap(a, b);
+    }
+    start_ = a;
+    end_ = b;
+    // Rounding alone leaves an error of a few ulps in every piece
+    tolerance = std::max(tolerance, 64.0 * DBL_EPSILON);
+
+    std::vector<Piece> open(INITIAL_PIECES);
+    double width = (b - a) / INITIAL_PIECES;
+    for (size_t i = 0; i < INITIAL_PIECES; ++i) {
+        open[i] = {a + i * width,
+                   i + 1 == INITIAL_PIECES ? b : a + (i + 1) * width};
+    }
+
+    std::vector<std::pair<Piece, Outcome>> kept;
+    std::vector<Outcome> outcomes;
+    for (int round = 0; !open.empty(); ++round) {
+        TRACE_SPAN_ITEMS("surrogate round", "analysis", open.size());
+        outcomes.assign(open.size(), Outcome());
+
+        // One batch call per range of pieces, all points of each
+        ThreadPool::shared().parallel_for(
+            open.size(), CHUNK_PIECES, [&](size_t begin, size_t end) {
+                const Tables &t = tables();
+                std::vector<double> xs((end - begin) * POINTS);
+                std::vector<double> ys(xs.size());
+                for (size_t i = begin; i < end; ++i) {
+                    double centre = 0.5 * (open[i].a + open[i].b);
+                    double half = 0.5 * (open[i].b - open[i].a);
+                    for (size_t k = 0; k < POINTS; ++k) {
+                        xs[(i - begin) * POINTS + k] =
+                            centre + half * t.points[k];
+                    }
+                }
+                evaluator_(xs.data(), ys.data(), xs.size());
+                for (size_t i = begin; i < end; ++i) {
+                    outcomes[i] =
+                        interpolate(ys.data() + (i - begin) * POINTS);
+                }
+            });
+        fit_.evaluations += open.size() * POINTS;
+
+        bool last_round =
+            round + 1 >= MAX_ROUNDS || open.size() * 2 > MAX_PIECES;
+        std::vector<Piece> split;
+        for (size_t i = 0; i < open.size(); ++i) {
+            const Piece &piece = open[i];
+            Outcome &outcome = outcomes[i];
+            bool narrow = piece.b - piece.a <= MIN_WIDTH * (b - a);
+            bool resolved = outcome.finite && outcome.error <= tolerance;
+            // Where f is undefined throughout, no split will help
+            if (!resolved && !narrow && !last_round && !outcome.undefined) {
+                double centre = 0.5 * (piece.a + piece.b);
+                split.push_back({piece.a, centre});
+                split.push_back({centre, piece.b});
+                continue;
+            }
+            if (!resolved) {
+                outcome.finite = false; // Marks it exact below
+            }
+            kept.emplace_back(piece, outcome);
+        }
+        open = std::move(split);
+    }
+
+    // Pieces finish in any order; in order of x they tile [a, b]
+    std::sort(kept.begin(), kept.end(), [](const auto &x, const auto &y) {
+        return x.first.a < y.first.a;
+    });
+    breaks_.reserve(kept.size() + 1);
+    coefficients_.reserve(kept.size() * NODES);
+    exact_.reserve(kept.size());
+    for (const auto &[piece, outcome] : kept) {
+        breaks_.push_back(piece.a);
+        exact_.push_back(!outcome.finite);
+        coefficients_.insert(coefficients_.end(), outcome.coefficients,
+                             outcome.coefficients + NODES);
+        if (outcome.finite) {
+            fit_.max_error = std::max(fit_.max_error, outcome.error);
+        } else {
+            ++fit_.exact_pieces;
+        }
+    }
+    breaks_.push_back(b);
+    fit_.pieces = kept.size();
+    fit_.seconds = seconds_since(started);
+
+    measure_speed(a, b);
+    return fit_;
+}
+
+// Each is timed over the same points a few times on this thread, keeping
+// the fastest, so the pool and the first touch of the memory do not count
+void ChebyshevSurrogate::measure_speed(double a, double b) {
+    std::vector<double> xs(PROBE_POINTS), ys(PROBE_POINTS);
+    for (size_t i = 0; i < PROBE_POINTS; ++i) {
+        xs[i] = a + (b - a) * i / (PROBE_POINTS - 1);
+    }
+    double exact = std::numeric_limits<double>::infinity();
+    double surrogate = exact;
+    for (int repetition = 0; repetition < 3; ++repetition) {
+        Clock::time_point started = Clock::now();
+        evaluator_(xs.data(), ys.data(), xs.size());
+        exact = std::min(exact, seconds_since(started));
+        started = Clock::now();
+        evaluate(xs.data(), ys.data(), xs.size());
+        surrogate = std::min(surrogate, seconds_since(started));
+    }
+    fit_.exact_ns = exact * 1e9 / PROBE_POINTS;
+    fit_.surrogate_ns = surrogate * 1e9 / PROBE_POINTS;
+}
+
+void ChebyshevSurrogate::evaluate(const double *x, double *y,
+                                  size_t count) const {
+    evaluate_values(x, y, count);
+}
+
+void ChebyshevSurrogate::evaluate(const float *x, float *y,
+                                  size_t count) const {
+    evaluate_values(x, y, count);
+}
+
+// Points are taken in runs that fall on one piece, found by search only
+// when a point leaves the previous piece, so ascending points mostly just
+// extend the run. The points that need f are gathered and evaluated in one
+// batch call at the end.
+template <typename T>
+void ChebyshevSurrogate::evaluate_values(const T *x, T *y,
+                                         size_t count) const {
+    std::vector<size_t> exact;
+    std::vector<double> exact_x;
+    size_t pieces = exact_.size();
+    size_t piece = 0;
+    for (size_t i = 0; i < count;) {
+        double v = static_cast<double>(x[i]);
+        if (pieces == 0 || !(v >= start_ && v <= end_)) {
+            exact.push_back(i);
+            exact_x.push_back(v);
+            ++i;
+            continue;
+        }
+        double a = breaks_[piece], b = breaks_[piece + 1];
+        if (v < a || v > b) {
+            piece = std::upper_bound(breaks_.begin(), breaks_.end(), v) -
+                    breaks_.begin();
+            piece = std::clamp<size_t>(piece, 1, pieces) - 1;
+            a = breaks_[piece];
+            b = breaks_[piece + 1];
+        }
+        size_t end = i + 1;
+        while (end < count && static_cast<double>(x[end]) >= a &&
+               static_cast<double>(x[end]) <= b) {
+            ++end;
+        }
+        if (exact_[piece]) {
+            for (; i < end; ++i) {
+                exact.push_back(i);
+                exact_x.push_back(static_cast<double>(x[i]));
+            }
+            continue;
+        }
+        clenshaw_run(coefficients_.data() + piece * NODES, a, b, x + i, y + i,
+                     end - i);
+        i = end;
+    }
+    if (exact.empty()) {
+        return;
+    }
+    std::vector<double> exact_y(exact.size());
+    evaluator_(exact_x.data(), exact_y.data(), exact_x.size());
+    for (size_t k = 0; k < exact.size(); ++k) {
+        y[exact[k]] = static_cast<T>(exact_y[k]);
+    }
+}
+
+bool ChebyshevSurrogate::covers(double a, double b) const {
+    return !exact_.empty() && a >= start_ && b <= end_;
+}
+
+// Getter for fit_
+const SurrogateFit &ChebyshevSurrogate::get_fit() const { return fit_; }
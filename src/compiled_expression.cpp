@@ -0,0 +1,516 @@
+#include "compiled_expression.hpp"
+#include "ast.hpp"
+#include "expression_profile.hpp"
+#include "fast_math.hpp"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace {
+
+// Binding strength of a slot's outermost operation, for labels
+const int ATOM_PRECEDENCE = 4;
+
+int precedence_of(char op) {
+    switch (op) {
+    case '^':
+        return 3;
+    case '*':
+    case '/':
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+std::string format_constant(double value) {
+    char buffer[32];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    return std::string(buffer, result.ptr);
+}
+
+std::uint64_t read_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0; // No cycle counter; only the ns timings are meaningful
+#endif
+}
+
+// Derivative lanes of one instruction, after its value lanes: out, a and b
+// each point at three runs of lanes holding the value, first and second
+// derivative. The second variable is constant in x.
+void apply_derivatives(const Instruction &instruction, double *out,
+                       const double *a, const double *b, size_t count,
+                       size_t lanes) {
+    const double *w = out;
+    double *dw = out + lanes, *d2w = out + 2 * lanes;
+    const double *u = a, *du = a + lanes, *d2u = a + 2 * lanes;
+    const double *v = b, *dv = b + lanes, *d2v = b + 2 * lanes;
+    switch (instruction.op) {
+    case OpCode::Constant:
+    case OpCode::SecondVariable:
+        std::fill(dw, dw + count, 0.0);
+        std::fill(d2w, d2w + count, 0.0);
+        return;
+    case OpCode::Variable:
+        std::fill(dw, dw + count, 1.0);
+        std::fill(d2w, d2w + count, 0.0);
+        return;
+    case OpCode::Add:
+        for (size_t j = 0; j < count; ++j) {
+            dw[j] = du[j] + dv[j];
+            d2w[j] = d2u[j] + d2v[j];
+        }
+        return;
+    case OpCode::Subtract:
+        for (size_t j = 0; j < count; ++j) {
+            dw[j] = du[j] - dv[j];
+            d2w[j] = d2u[j] - d2v[j];
+        }
+        return;
+    case OpCode::Multiply:
+        for (size_t j = 0; j < count; ++j) {
+            dw[j] = du[j] * v[j] + u[j] * dv[j];
+            d2w[j] = d2u[j] * v[j] + 2 * du[j] * dv[j] + u[j] * d2v[j];
+        }
+        return;
+    case OpCode::Divide:
+        for (size_t j = 0; j < count; ++j) {
+            dw[j] = (du[j] - w[j] * dv[j]) / v[j];
+            d2w[j] = (d2u[j] - 2 * dw[j] * dv[j] - w[j] * d2v[j]) / v[j];
+        }
+        return;
+    case OpCode::Power:
+        for (size_t j = 0; j < count; ++j) {
+            if (dv[j] == 0.0 && d2v[j] == 0.0) {
+                // Constant exponent: the power rule, which unlike the
+                // logarithm below also holds for negative bases
+                double p = v[j];
+                double g1, g2;
+                if (p == 2.0) { // Squares are common and need no pow
+                    g1 = 2 * u[j];
+                    g2 = 2;
+                } else {
+                    g1 = p == 0.0 ? 0.0 : p * std::pow(u[j], p - 1);
+                    g2 = p == 0.0 || p == 1.0
+                             ? 0.0
+                             : p * (p - 1) * std::pow(u[j], p - 2);
+                }
+                dw[j] = g1 * du[j];
+                d2w[j] = g2 * du[j] * du[j] + g1 * d2u[j];
+                continue;
+            }
+            // u^v = exp(v ln u)
+            double ln_u = std::log(u[j]);
+            double l1 = dv[j] * ln_u + v[j] * du[j] / u[j];
+            double l2 = d2v[j] * ln_u + 2 * dv[j] * du[j] / u[j] +
+                        v[j] * (d2u[j] / u[j] - du[j] * du[j] / (u[j] * u[j]));
+            dw[j] = w[j] * l1;
+            d2w[j] = w[j] * (l2 + l1 * l1);
+        }
+        return;
+    default:
+        break;
+    }
+
+    // Functions of one argument: (g(u))' = g'(u) u' and
+    // (g(u))'' = g''(u) u'^2 + g'(u) u''
+    for (size_t j = 0; j < count; ++j) {
+        double x = u[j], g1, g2;
+        switch (instruction.op) {
+        case OpCode::Sin:
+            g1 = std::cos(x);
+            g2 = -w[j];
+            break;
+        case OpCode::Cos:
+            g1 = -std::sin(x);
+            g2 = -w[j];
+            break;
+        case OpCode::Tan:
+            g1 = 1 + w[j] * w[j];
+            g2 = 2 * w[j] * g1;
+            break;
+        case OpCode::Arcsin:
+            g1 = 1 / std::sqrt(1 - x * x);
+            g2 = x * g1 * g1 * g1;
+            break;
+        case OpCode::Arccos:
+            g1 = -1 / std::sqrt(1 - x * x);
+            g2 = x * g1 * g1 * g1;
+            break;
+        case OpCode::Arctan:
+            g1 = 1 / (1 + x * x);
+            g2 = -2 * x * g1 * g1;
+            break;
+        case OpCode::Log:
+            g1 = 1 / (x * std::log(10.0));
+            g2 = -g1 / x;
+            break;
+        case OpCode::Ln:
+            g1 = 1 / x;
+            g2 = -g1 * g1;
+            break;
+        case OpCode::Sqrt:
+            g1 = 0.5 / w[j];
+            g2 = -0.5 * g1 / x;
+            break;
+        default:
+            throw std::runtime_error("Operation has no derivative");
+        }
+        dw[j] = g1 * du[j];
+        d2w[j] = g2 * du[j] * du[j] + g1 * d2u[j];
+    }
+}
+
+// Each case is a tight loop so the arithmetic ones vectorize; with float
+// lanes a vector register holds twice as many of them
+template <typename T>
+void apply_lanes(const Instruction &instruction, const T *x, T *out,
+                 const T *a, const T *b, size_t count, const T *second,
+                 MathTier tier) {
+    switch (instruction.op) {
+    case OpCode::Constant:
+        std::fill(out, out + count, static_cast<T>(instruction.value));
+        break;
+    case OpCode::Variable:
+        std::copy(x, x + count, out);
+        break;
+    case OpCode::SecondVariable:
+        if (second == nullptr) {
+            throw std::runtime_error("Expression needs a second variable.");
+        }
+        std::copy(second, second + count, out);
+        break;
+    case OpCode::Add:
+        for (size_t j = 0; j < count; ++j)
+            out[j] = a[j] + b[j];
+        break;
+    case OpCode::Subtract:
+        for (size_t j = 0; j < count; ++j)
+            out[j] = a[j] - b[j];
+        break;
+    case OpCode::Multiply:
+        for (size_t j = 0; j < count; ++j)
+            out[j] = a[j] * b[j];
+        break;
+    case OpCode::Divide:
+        for (size_t j = 0; j < count; ++j)
+            out[j] = a[j] / b[j];
+        break;
+    default:
+        if (tier == MathTier::Fast &&
+            apply_fast_operation(instruction.op, a, b, out, count)) {
+            break;
+        }
+        for (size_t j = 0; j < count; ++j)
+            out[j] = apply_operation(instruction.op, a[j],
+                                     instruction.right >= 0 ? b[j] : T(0));
+        break;
+    }
+}
+
+// The <cmath> overloads pick the float functions for float operands
+template <typename T> T apply_scalar(OpCode op, T left, T right) {
+    switch (op) {
+    case OpCode::Add:
+        return left + right;
+    case OpCode::Subtract:
+        return left - right;
+    case OpCode::Multiply:
+        return left * right;
+    case OpCode::Divide:
+        return left / right;
+    case OpCode::Power:
+        return std::pow(left, right);
+    case OpCode::Sin:
+        return std::sin(left);
+    case OpCode::Cos:
+        return std::cos(left);
+    case OpCode::Tan:
+        return std::tan(left);
+    case OpCode::Arcsin:
+        return std::asin(left);
+    case OpCode::Arccos:
+        return std::acos(left);
+    case OpCode::Arctan:
+        return std::atan(left);
+    case OpCode::Log:
+        return std::log10(left);
+    case OpCode::Ln:
+        return std::log(left);
+    case OpCode::Sqrt:
+        return std::sqrt(left);
+    default:
+        throw std::runtime_error("Operation has no operands");
+    }
+}
+
+} // namespace
+
+void apply_instruction(const Instruction &instruction, const double *x,
+                       double *out, const double *a, const double *b,
+                       size_t count, const double *second, MathTier tier) {
+    apply_lanes(instruction, x, out, a, b, count, second, tier);
+}
+
+void apply_instruction(const Instruction &instruction, const float *x,
+                       float *out, const float *a, const float *b,
+                       size_t count, const float *second, MathTier tier) {
+    apply_lanes(instruction, x, out, a, b, count, second, tier);
+}
+
+double apply_operation(OpCode op, double left, double right) {
+    return apply_scalar(op, left, right);
+}
+
+float apply_operation(OpCode op, float left, float right) {
+    return apply_scalar(op, left, right);
+}
+
+CompiledExpression::CompiledExpression() {}
+
+CompiledExpression::CompiledExpression(const ASTNode &root) {
+    root.compile(*this);
+}
+
+int CompiledExpression::push(const Instruction &instruction,
+                             const std::string &label, int precedence) {
+    instructions_.push_back(instruction);
+    labels_.push_back(label);
+    precedence_.push_back(precedence);
+    return static_cast<int>(instructions_.size()) - 1;
+}
+
+int CompiledExpression::add_constant(double value, const std::string &label) {
+    Instruction instruction{OpCode::Constant};
+    instruction.value = value;
+    return push(instruction, label.empty() ? format_constant(value) : label,
+                ATOM_PRECEDENCE);
+}
+
+int CompiledExpression::add_variable(char name) {
+    return push(Instruction{OpCode::Variable}, std::string(1, name),
+                ATOM_PRECEDENCE);
+}
+
+int CompiledExpression::add_second_variable(char name) {
+    return push(Instruction{OpCode::SecondVariable}, std::string(1, name),
+                ATOM_PRECEDENCE);
+}
+
+int CompiledExpression::add_binary(char op, int left, int right) {
+    OpCode code;
+    switch (op) {
+    case '+':
+        code = OpCode::Add;
+        break;
+    case '-':
+        code = OpCode::Subtract;
+        break;
+    case '*':
+        code = OpCode::Multiply;
+        break;
+    case '/':
+        code = OpCode::Divide;
+        break;
+    case '^':
+        code = OpCode::Power;
+        break;
+    default:
+        throw std::runtime_error("Unknown operator");
+    }
+
+    // Parenthesize operands that bind less tightly than op; ^ groups to the
+    // right, - and / to the left
+    int precedence = precedence_of(op);
+    bool left_parens = precedence_[left] < precedence ||
+                       (op == '^' && precedence_[left] == precedence);
+    bool right_parens = precedence_[right] < precedence ||
+                        (op != '^' && op != '+' && op != '*' &&
+                         precedence_[right] == precedence);
+    std::string label =
+        (left_parens ? "(" + labels_[left] + ")" : labels_[left]) + op +
+        (right_parens ? "(" + labels_[right] + ")" : labels_[right]);
+
+    const Instruction &l = instructions_[left];
+    const Instruction &r = instructions_[right];
+    if (l.op == OpCode::Constant && r.op == OpCode::Constant &&
+        left == static_cast<int>(size()) - 2 &&
+        right == static_cast<int>(size()) - 1) {
+        // Both operands were just pushed as constants; replace them
+        double value = apply_operation(code, l.value, r.value);
+        pop_slots(2);
+        int slot = add_constant(value, label);
+        precedence_[slot] = precedence;
+        return slot;
+    }
+    Instruction instruction{code};
+    instruction.left = left;
+    instruction.right = right;
+    return push(instruction, label, precedence);
+}
+
+void CompiledExpression::pop_slots(size_t count) {
+    instructions_.resize(instructions_.size() - count);
+    labels_.resize(labels_.size() - count);
+    precedence_.resize(precedence_.size() - count);
+}
+
+int CompiledExpression::add_function(const std::string &name, int argument) {
+    static const std::pair<const char *, OpCode> functions[] = {
+        {"sin", OpCode::Sin},       {"cos", OpCode::Cos},
+        {"tan", OpCode::Tan},       {"arcsin", OpCode::Arcsin},
+        {"arccos", OpCode::Arccos}, {"arctan", OpCode::Arctan},
+        {"log", OpCode::Log},       {"ln", OpCode::Ln},
+        {"sqrt", OpCode::Sqrt}};
+
+    for (const auto &[function_name, code] : functions) {
+        if (name != function_name) {
+            continue;
+        }
+        std::string label = name + "(" + labels_[argument] + ")";
+        const Instruction &arg = instructions_[argument];
+        if (arg.op == OpCode::Constant &&
+            argument == static_cast<int>(size()) - 1) {
+            double value = apply_operation(code, arg.value, 0.0);
+            pop_slots(1);
+            return add_constant(value, label);
+        }
+        Instruction instruction{code};
+        instruction.left = argument;
+        return push(instruction, label, ATOM_PRECEDENCE);
+    }
+    throw std::runtime_error("Unknown function");
+}
+
+bool CompiledExpression::empty() const { return instructions_.empty(); }
+
+size_t CompiledExpression::size() const { return instructions_.size(); }
+
+const std::vector<Instruction> &
+CompiledExpression::get_instructions() const {
+    return instructions_;
+}
+
+const std::string &CompiledExpression::get_label(int slot) const {
+    return labels_[slot];
+}
+
+double CompiledExpression::evaluate(double x) const {
+    double y;
+    evaluate(&x, &y, 1);
+    return y;
+}
+
+void CompiledExpression::evaluate(const double *x, double *y, size_t count,
+                                  MathTier tier) const {
+    evaluate_lanes<double>(x, nullptr, y, count, tier);
+}
+
+void CompiledExpression::evaluate(const double *x, const double *second,
+                                  double *out, size_t count) const {
+    evaluate_lanes(x, second, out, count, MathTier::Exact);
+}
+
+void CompiledExpression::evaluate(const float *x, float *y, size_t count,
+                                  MathTier tier) const {
+    evaluate_lanes<float>(x, nullptr, y, count, tier);
+}
+
+template <typename T>
+void CompiledExpression::evaluate_lanes(const T *x, const T *second, T *out,
+                                        size_t count, MathTier tier) const {
+    if (instructions_.empty()) {
+        throw std::runtime_error("Expression is not compiled.");
+    }
+    // Every slot gets a BATCH_SIZE lane buffer, reused across calls
+    thread_local std::vector<T> scratch;
+    scratch.resize(instructions_.size() * BATCH_SIZE);
+    for (size_t begin = 0; begin < count; begin += BATCH_SIZE) {
+        evaluate_block(x + begin, second ? second + begin : nullptr,
+                       out + begin, std::min(BATCH_SIZE, count - begin),
+                       scratch.data(), tier);
+    }
+}
+
+template <typename T>
+void CompiledExpression::evaluate_block(const T *x, const T *second, T *y,
+                                        size_t count, T *scratch,
+                                        MathTier tier) const {
+    for (size_t i = 0; i < instructions_.size(); ++i) {
+        const Instruction &instruction = instructions_[i];
+        apply_instruction(instruction, x, scratch + i * BATCH_SIZE,
+                          scratch + instruction.left * BATCH_SIZE,
+                          scratch + instruction.right * BATCH_SIZE, count,
+                          second, tier);
+    }
+    const T *result = scratch + (instructions_.size() - 1) * BATCH_SIZE;
+    std::copy(result, result + count, y);
+}
+
+void CompiledExpression::evaluate_derivatives(const double *x, double *y,
+                                              double *dy, double *d2y,
+                                              size_t count) const {
+    if (instructions_.empty()) {
+        throw std::runtime_error("Expression is not compiled.");
+    }
+    // Three lane buffers per slot: value, first and second derivative
+    const size_t stride = 3 * BATCH_SIZE;
+    thread_local std::vector<double> scratch;
+    scratch.resize(instructions_.size() * stride);
+    for (size_t begin = 0; begin < count; begin += BATCH_SIZE) {
+        size_t lanes = std::min(BATCH_SIZE, count - begin);
+        for (size_t i = 0; i < instructions_.size(); ++i) {
+            const Instruction &instruction = instructions_[i];
+            double *out = scratch.data() + i * stride;
+            const double *a = scratch.data() + instruction.left * stride;
+            const double *b = scratch.data() + instruction.right * stride;
+            apply_instruction(instruction, x + begin, out, a, b, lanes);
+            apply_derivatives(instruction, out, a, b, lanes, BATCH_SIZE);
+        }
+        const double *result =
+            scratch.data() + (instructions_.size() - 1) * stride;
+        std::copy(result, result + lanes, y + begin);
+        std::copy(result + BATCH_SIZE, result + BATCH_SIZE + lanes,
+                  dy + begin);
+        std::copy(result + 2 * BATCH_SIZE, result + 2 * BATCH_SIZE + lanes,
+                  d2y + begin);
+    }
+}
+
+void CompiledExpression::evaluate_profiled(const double *x, double *y,
+                                           size_t count,
+                                           ExpressionProfile &profile) const {
+    if (instructions_.empty()) {
+        throw std::runtime_error("Expression is not compiled.");
+    }
+    std::vector<double> scratch(instructions_.size() * BATCH_SIZE);
+    for (size_t begin = 0; begin < count; begin += BATCH_SIZE) {
+        size_t lanes = std::min(BATCH_SIZE, count - begin);
+        for (size_t i = 0; i < instructions_.size(); ++i) {
+            const Instruction &instruction = instructions_[i];
+            auto started = std::chrono::steady_clock::now();
+            std::uint64_t cycles = read_cycles();
+            apply_instruction(instruction, x + begin,
+                              scratch.data() + i * BATCH_SIZE,
+                              scratch.data() + instruction.left * BATCH_SIZE,
+                              scratch.data() + instruction.right * BATCH_SIZE,
+                              lanes);
+            cycles = read_cycles() - cycles;
+            profile.add(i, lanes,
+                        std::chrono::duration<double, std::nano>(
+                            std::chrono::steady_clock::now() - started)
+                            .count(),
+                        cycles);
+        }
+        const double *result =
+            scratch.data() + (instructions_.size() - 1) * BATCH_SIZE;
+        std::copy(result, result + lanes, y + begin);
+    }
+}
@@ -0,0 +1,381 @@
+#include "compressed_archive.hpp"
+#include "export_writer.hpp"
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace {
+
+// Zigzag maps small signed deltas to small unsigned codes
+std::uint64_t zigzag(std::int64_t value) {
+    return (static_cast<std::uint64_t>(value) << 1) ^
+           static_cast<std::uint64_t>(value >> 63);
+}
+
+std::int64_t unzigzag(std::uint64_t code) {
+    return static_cast<std::int64_t>(code >> 1) ^
+           -static_cast<std::int64_t>(code & 1);
+}
+
+// Delta-of-delta buckets: a prefix of 1s selects the payload width
+const int DOD_WIDTHS[] = {7, 9, 12, 64};
+
+void write_delta_of_delta(BitWriter &writer, std::int64_t dod) {
+    std::uint64_t code = zigzag(dod);
+    if (code == 0) {
+        writer.write_bit(false);
+        return;
+    }
+    for (int bucket = 0; bucket < 4; ++bucket) {
+        int width = DOD_WIDTHS[bucket];
+        if (width == 64 || code < (std::uint64_t(1) << width)) {
+            // bucket + 1 ones, then a terminating zero except for the last
+            writer.write(bucket < 3 ? ((std::uint64_t(1) << (bucket + 2)) - 2)
+                                    : 0xF,
+                         bucket < 3 ? bucket + 2 : 4);
+            writer.write(code, width);
+            return;
+        }
+    }
+}
+
+std::int64_t read_delta_of_delta(BitReader &reader) {
+    int bucket = 0;
+    while (bucket < 4 && reader.read_bit()) {
+        ++bucket;
+    }
+    if (bucket == 0) {
+        return 0;
+    }
+    return unzigzag(reader.read(DOD_WIDTHS[bucket - 1]));
+}
+
+// Gorilla XOR predictor state for one column
+struct XorState {
+        std::uint64_t previous = 0;
+        int leading = -1; // No window yet
+        int trailing = 0;
+};
+
+void write_xor(BitWriter &writer, XorState &state, std::uint64_t bits) {
+    std::uint64_t difference = bits ^ state.previous;
+    state.previous = bits;
+    if (difference == 0) {
+        writer.write_bit(false);
+        return;
+    }
+    writer.write_bit(true);
+    int leading = std::min(std::countl_zero(difference), 31);
+    int trailing = std::countr_zero(difference);
+    if (state.leading >= 0 && leading >= state.leading &&
+        trailing >= state.trailing) {
+        // Meaningful bits fit in the previous window
+        writer.write_bit(false);
+        writer.write(difference >> state.trailing,
+                     64 - state.leading - state.trailing);
+        return;
+    }
+    int significant = 64 - leading - trailing;
+    writer.write_bit(true);
+    writer.write(leading, 5);
+    writer.write(significant & 63, 6); // 64 is stored as 0
+    writer.write(difference >> trailing, significant);
+    state.leading = leading;
+    state.trailing = trailing;
+}
+
+std::uint64_t read_xor(BitReader &reader, XorState &state) {
+    if (reader.read_bit()) {
+        if (reader.read_bit()) {
+            state.leading = static_cast<int>(reader.read(5));
+            int significant = static_cast<int>(reader.read(6));
+            significant = significant == 0 ? 64 : significant;
+            state.trailing = 64 - state.leading - significant;
+        }
+        int significant = 64 - state.leading - state.trailing;
+        state.previous ^= reader.read(significant) << state.trailing;
+    }
+    return state.previous;
+}
+
+void read_exact_from(int fd, void *data, size_t size) {
+    char *bytes = static_cast<char *>(data);
+    while (size > 0) {
+        ssize_t count = ::read(fd, bytes, size);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            throw std::runtime_error("Archive is truncated.");
+        }
+        bytes += count;
+        size -= count;
+    }
+}
+
+} // namespace
+
+// BitWriter Implementation
+void BitWriter::write(std::uint64_t value, int bits) {
+    if (bits > 56) {
+        write(value >> 32, bits - 32);
+        write(value & 0xFFFFFFFFu, 32);
+        return;
+    }
+    if (bits < 64) {
+        value &= (std::uint64_t(1) << bits) - 1;
+    }
+    pending_ = (pending_ << bits) | value;
+    pending_bits_ += bits;
+    while (pending_bits_ >= 8) {
+        pending_bits_ -= 8;
+        bytes_.push_back(static_cast<std::uint8_t>(pending_ >> pending_bits_));
+    }
+    pending_ &= (std::uint64_t(1) << pending_bits_) - 1;
+}
+
+void BitWriter::write_bit(bool bit) { write(bit ? 1 : 0, 1); }
+
+std::vector<std::uint8_t> &BitWriter::finish() {
+    if (pending_bits_ > 0) {
+        bytes_.push_back(
+            static_cast<std::uint8_t>(pending_ << (8 - pending_bits_)));
+        pending_ = 0;
+        pending_bits_ = 0;
+    }
+    return bytes_;
+}
+
+// BitReader Implementation
+BitReader::BitReader(const std::uint8_t *data, size_t size)
+    : data_(data), size_(size), bit_position_(0) {}
+
+std::uint64_t BitReader::read(int bits) {
+    if (bits > 56) {
+        std::uint64_t high = read(bits - 32);
+        return (high << 32) | read(32);
+    }
+    if (bit_position_ + bits > size_ * 8) {
+        throw std::runtime_error("Archive block is truncated.");
+    }
+    // Load the eight bytes starting at the current byte, big-endian
+    size_t byte = bit_position_ / 8;
+    std::uint64_t window = 0;
+    for (size_t i = 0; i < 8; ++i) {
+        window = (window << 8) | (byte + i < size_ ? data_[byte + i] : 0);
+    }
+    window <<= bit_position_ % 8;
+    bit_position_ += bits;
+    return bits == 0 ? 0 : window >> (64 - bits);
+}
+
+bool BitReader::read_bit() { return read(1) != 0; }
+
+// ArchiveEncoder Implementation
+ArchiveEncoder::ArchiveEncoder(const std::filesystem::path &path,
+                               const std::string &expression, char variable,
+                               bool explicit_x, double start, double step)
+    : fd_(open_output_file(path)), header_{}, bytes_(0) {
+    std::memcpy(header_.magic, ArchiveHeader::MAGIC, sizeof(header_.magic));
+    header_.version = ArchiveHeader::VERSION;
+    header_.flags = explicit_x ? ArchiveHeader::EXPLICIT_X : 0;
+    header_.start = start;
+    header_.step = step;
+    header_.expression_length = static_cast<std::uint32_t>(expression.size());
+    header_.variable = variable;
+
+    // The header is rewritten with the final counts by finish()
+    pwrite_fully(fd_, &header_, sizeof(header_), 0);
+    pwrite_fully(fd_, expression.data(), expression.size(), sizeof(header_));
+    bytes_ = sizeof(header_) + expression.size();
+}
+
+ArchiveEncoder::~ArchiveEncoder() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+void ArchiveEncoder::write_chunk(const SampleSeries &chunk) {
+    for (size_t begin = 0; begin < chunk.size();
+         begin += ArchiveHeader::BLOCK_SAMPLES) {
+        encode_block(chunk, begin,
+                     std::min(chunk.size(),
+                              begin + ArchiveHeader::BLOCK_SAMPLES));
+    }
+}
+
+void ArchiveEncoder::encode_block(const SampleSeries &chunk, size_t begin,
+                                  size_t end) {
+    const bool explicit_x = header_.flags & ArchiveHeader::EXPLICIT_X;
+    BitWriter writer;
+    XorState y_state;
+    // Deltas of the bit patterns wrap around in unsigned arithmetic; a
+    // curve crossing zero jumps by about 2^63, which would overflow int64
+    std::uint64_t previous_x = 0;
+    std::uint64_t previous_delta = 0;
+
+    for (size_t i = begin; i < end; ++i) {
+        if (explicit_x) {
+            std::uint64_t x_bits = std::bit_cast<std::uint64_t>(chunk.x(i));
+            if (i == begin) {
+                writer.write(x_bits, 64);
+            } else {
+                std::uint64_t delta = x_bits - previous_x;
+                write_delta_of_delta(
+                    writer, static_cast<std::int64_t>(delta - previous_delta));
+                previous_delta = delta;
+            }
+            previous_x = x_bits;
+        }
+        std::uint64_t y_bits = std::bit_cast<std::uint64_t>(chunk.y(i));
+        if (i == begin) {
+            writer.write(y_bits, 64);
+            y_state.previous = y_bits;
+        } else {
+            write_xor(writer, y_state, y_bits);
+        }
+    }
+
+    std::vector<std::uint8_t> &bytes = writer.finish();
+    std::uint32_t block_header[2] = {static_cast<std::uint32_t>(end - begin),
+                                     static_cast<std::uint32_t>(bytes.size())};
+    pwrite_fully(fd_, block_header, sizeof(block_header), bytes_);
+    pwrite_fully(fd_, bytes.data(), bytes.size(),
+                 bytes_ + sizeof(block_header));
+    bytes_ += sizeof(block_header) + bytes.size();
+    header_.sample_count += end - begin;
+    header_.block_count += 1;
+}
+
+void ArchiveEncoder::finish() {
+    pwrite_fully(fd_, &header_, sizeof(header_), 0);
+    ::close(fd_);
+    fd_ = -1;
+}
+
+size_t ArchiveEncoder::bytes_written() const { return bytes_; }
+
+size_t ArchiveEncoder::raw_bytes() const {
+    const bool explicit_x = header_.flags & ArchiveHeader::EXPLICIT_X;
+    return header_.sample_count * sizeof(double) * (explicit_x ? 2 : 1);
+}
+
+// ArchiveDecoder Implementation
+ArchiveDecoder::ArchiveDecoder(const std::filesystem::path &path)
+    : fd_(::open(path.c_str(), O_RDONLY)), header_{}, blocks_read_(0),
+      samples_read_(0) {
+    if (fd_ < 0) {
+        throw std::runtime_error("Error opening archive: " +
+                                 std::string(std::strerror(errno)));
+    }
+    try {
+        read_exact(&header_, sizeof(header_));
+        if (std::memcmp(header_.magic, ArchiveHeader::MAGIC,
+                        sizeof(header_.magic)) != 0 ||
+            header_.version != ArchiveHeader::VERSION) {
+            throw std::runtime_error("Not a compressed archive.");
+        }
+        expression_.resize(header_.expression_length);
+        read_exact(expression_.data(), expression_.size());
+    } catch (...) {
+        ::close(fd_);
+        throw;
+    }
+}
+
+ArchiveDecoder::~ArchiveDecoder() { ::close(fd_); }
+
+void ArchiveDecoder::read_exact(void *data, size_t size) {
+    read_exact_from(fd_, data, size);
+}
+
+const std::string &ArchiveDecoder::get_expression() const {
+    return expression_;
+}
+
+char ArchiveDecoder::get_variable() const { return header_.variable; }
+
+size_t ArchiveDecoder::size() const { return header_.sample_count; }
+
+bool ArchiveDecoder::next_chunk(SampleSeries &chunk) {
+    if (blocks_read_ == header_.block_count) {
+        return false;
+    }
+    std::uint32_t block_header[2];
+    read_exact(block_header, sizeof(block_header));
+    const size_t count = block_header[0];
+    if (count == 0 || count > ArchiveHeader::BLOCK_SAMPLES) {
+        throw std::runtime_error("Archive block is corrupt.");
+    }
+    buffer_.resize(block_header[1]);
+    read_exact(buffer_.data(), buffer_.size());
+
+    const bool explicit_x = header_.flags & ArchiveHeader::EXPLICIT_X;
+    SampleSeries decoded;
+    if (explicit_x) {
+        decoded.reserve(count);
+    } else {
+        chunk.assign_uniform(header_.start + samples_read_ * header_.step,
+                             header_.step, count);
+    }
+
+    BitReader reader(buffer_.data(), buffer_.size());
+    XorState y_state;
+    std::uint64_t x_bits = 0;
+    std::uint64_t delta = 0; // Wrapping, as the encoder's
+    for (size_t i = 0; i < count; ++i) {
+        if (explicit_x) {
+            if (i == 0) {
+                x_bits = reader.read(64);
+            } else {
+                delta += static_cast<std::uint64_t>(
+                    read_delta_of_delta(reader));
+                x_bits += delta;
+            }
+        }
+        if (i == 0) {
+            y_state.previous = reader.read(64);
+        } else {
+            read_xor(reader, y_state);
+        }
+        double y = std::bit_cast<double>(y_state.previous);
+        if (explicit_x) {
+            decoded.append(std::bit_cast<double>(x_bits), y);
+        } else {
+            chunk.set_y(i, y);
+        }
+    }
+    if (explicit_x) {
+        chunk = std::move(decoded);
+    }
+
+    ++blocks_read_;
+    samples_read_ += count;
+    return true;
+}
+
+SampleSeries ArchiveDecoder::read_all() {
+    SampleSeries all;
+    SampleSeries chunk;
+    bool first = true;
+    while (next_chunk(chunk)) {
+        if (first && chunk.is_uniform()) {
+            all = SampleSeries(chunk.get_start(), chunk.get_step(), 0);
+            all.reserve(size());
+        }
+        first = false;
+        for (size_t i = 0; i < chunk.size(); ++i) {
+            if (all.is_uniform()) {
+                all.append(chunk.y(i));
+            } else {
+                all.append(chunk.x(i), chunk.y(i));
+            }
+        }
+    }
+    return all;
+}
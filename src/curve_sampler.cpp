@@ -0,0 +1,91 @@
+#include "curve_sampler.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+CurveSampler::CurveSampler(Evaluator evaluator, double x_scale,
+                           double y_scale)
+    : evaluator_(std::move(evaluator)),
+      x_scale_(x_scale > 0 ? x_scale : 1.0),
+      y_scale_(y_scale > 0 ? y_scale : 1.0) {}
+
+void CurveSampler::evaluate(const std::vector<double> &t,
+                            std::vector<double> &x,
+                            std::vector<double> &y) const {
+    x.resize(t.size());
+    y.resize(t.size());
+    ThreadPool::shared().parallel_for(
+        t.size(), 4096, [&](size_t begin, size_t end) {
+            TRACE_SPAN_ITEMS("evaluate curve chunk", "evaluate", end - begin);
+            evaluator_(t.data() + begin, x.data() + begin, y.data() + begin,
+                       end - begin);
+        });
+}
+
+SampleSeries CurveSampler::sample(double t_start, double t_end,
+                                  size_t budget) const {
+    if (!(t_start < t_end) || !std::isfinite(t_start) ||
+        !std::isfinite(t_end)) {
+        throw std::invalid_argument(
+            "Invalid Parameters: Parameter start must be less than end.");
+    }
+    budget = std::max(budget, MIN_BUDGET);
+
+    // Uniform pilot pass, endpoints included
+    size_t pilot = std::max<size_t>(2, budget / PILOT_DIVISOR);
+    std::vector<double> t(pilot), x, y;
+    double step = (t_end - t_start) / (pilot - 1);
+    for (size_t i = 0; i < pilot; ++i) {
+        t[i] = t_start + i * step;
+    }
+    t.back() = t_end;
+    evaluate(t, x, y);
+
+    // Cumulative arc length over the pilot; an interval touching a
+    // non-finite point has no measurable length and gets no extra samples
+    std::vector<double> length(pilot, 0.0);
+    for (size_t i = 1; i < pilot; ++i) {
+        double dx = (x[i] - x[i - 1]) / x_scale_;
+        double dy = (y[i] - y[i - 1]) / y_scale_;
+        double segment = std::hypot(dx, dy);
+        length[i] = length[i - 1] + (std::isfinite(segment) ? segment : 0.0);
+    }
+
+    // The rest of the budget at equal arc-length steps, each placed inside
+    // its pilot interval by linear interpolation of t
+    size_t refine = budget - pilot;
+    std::vector<double> extra_t;
+    if (length.back() > 0.0) {
+        extra_t.reserve(refine);
+        size_t interval = 1;
+        for (size_t k = 0; k < refine; ++k) {
+            double target = (k + 0.5) * length.back() / refine;
+            while (interval < pilot - 1 && length[interval] < target) {
+                ++interval;
+            }
+            double span = length[interval] - length[interval - 1];
+            double fraction =
+                span > 0.0 ? (target - length[interval - 1]) / span : 0.5;
+            extra_t.push_back(t[interval - 1] + fraction * step);
+        }
+    }
+    std::vector<double> extra_x, extra_y;
+    evaluate(extra_t, extra_x, extra_y);
+
+    // Both passes are already sorted by t, so they merge in one sweep
+    SampleSeries series;
+    series.reserve(pilot + extra_t.size());
+    size_t i = 0, j = 0;
+    while (i < pilot || j < extra_t.size()) {
+        if (j == extra_t.size() || (i < pilot && t[i] <= extra_t[j])) {
+            series.append(x[i], y[i]);
+            ++i;
+        } else {
+            series.append(extra_x[j], extra_y[j]);
+            ++j;
+        }
+    }
+    return series;
+}
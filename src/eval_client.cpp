@@ -0,0 +1,124 @@
+#include "eval_client.hpp"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+EvaluationResult::EvaluationResult() : count_(0) {}
+
+EvaluationResult::EvaluationResult(std::vector<double> values)
+    : values_(std::move(values)), count_(values_.size()) {}
+
+EvaluationResult::EvaluationResult(SharedBuffer shared, size_t count)
+    : shared_(std::move(shared)), count_(count) {}
+
+const double *EvaluationResult::data() const {
+    return shared_.data() != nullptr
+               ? static_cast<const double *>(shared_.data())
+               : values_.data();
+}
+
+size_t EvaluationResult::size() const { return count_; }
+
+double EvaluationResult::operator[](size_t i) const { return data()[i]; }
+
+EvaluationClient::EvaluationClient(const std::string &socket_path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.length() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("Socket path is too long.");
+    }
+    std::strcpy(address.sun_path, socket_path.c_str());
+
+    socket_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (socket_ < 0 ||
+        ::connect(socket_, reinterpret_cast<sockaddr *>(&address),
+                  sizeof(address)) != 0) {
+        std::string error = std::strerror(errno);
+        if (socket_ >= 0) {
+            ::close(socket_);
+        }
+        throw std::runtime_error("Cannot connect to " + socket_path + ": " +
+                                 error);
+    }
+}
+
+EvaluationClient::~EvaluationClient() { ::close(socket_); }
+
+EvaluationResult
+EvaluationClient::evaluate_domain(const std::string &expression,
+                                  char variable, double start, double end,
+                                  std::uint64_t intervals) {
+    EvalRequestHeader request{};
+    std::memcpy(request.magic, "TCRQ", 4);
+    request.kind = EvalRequestHeader::DOMAIN;
+    request.count = intervals;
+    request.start = start;
+    request.end = end;
+    request.variable = variable;
+    return exchange(request, expression, nullptr);
+}
+
+EvaluationResult
+EvaluationClient::evaluate_values(const std::string &expression,
+                                  char variable, const double *xs,
+                                  size_t count) {
+    EvalRequestHeader request{};
+    std::memcpy(request.magic, "TCRQ", 4);
+    request.kind = EvalRequestHeader::VALUES;
+    request.count = count;
+    request.variable = variable;
+    return exchange(request, expression, xs);
+}
+
+EvaluationResult EvaluationClient::exchange(EvalRequestHeader &request,
+                                            const std::string &expression,
+                                            const double *xs) {
+    if (expression.length() > MAX_EXPRESSION_LENGTH) {
+        throw std::invalid_argument("Expression is too long.");
+    }
+    request.expression_length = static_cast<std::uint32_t>(expression.length());
+
+    // Large x arrays are copied once into shared memory instead of being
+    // pushed through the socket
+    const size_t bytes = xs != nullptr ? request.count * sizeof(double) : 0;
+    SharedBuffer outgoing;
+    if (bytes >= SHARED_PAYLOAD_BYTES) {
+        outgoing = SharedBuffer::create(bytes);
+        std::memcpy(outgoing.data(), xs, bytes);
+        request.flags |= EvalRequestHeader::VALUES_IN_MEMFD;
+    }
+    send_message(socket_, &request, sizeof(request), outgoing.fd());
+    send_message(socket_, expression.data(), expression.length());
+    if (bytes > 0 && outgoing.fd() < 0) {
+        send_message(socket_, xs, bytes);
+    }
+
+    EvalResponseHeader response;
+    int fd;
+    if (!receive_message(socket_, &response, sizeof(response), fd) ||
+        std::memcmp(response.magic, "TCRS", 4) != 0) {
+        throw std::runtime_error("Invalid response from server.");
+    }
+    SharedBuffer shared;
+    if (fd >= 0) {
+        shared = SharedBuffer::map(fd, response.count * sizeof(double));
+    }
+    int unused;
+    if (response.status != EvalResponseHeader::OK) {
+        std::string message(response.message_length, '\0');
+        receive_message(socket_, message.data(), message.size(), unused);
+        throw std::runtime_error(message);
+    }
+    if (response.flags & EvalResponseHeader::RESULTS_IN_MEMFD) {
+        return EvaluationResult(std::move(shared), response.count);
+    }
+    std::vector<double> values(response.count);
+    if (!values.empty()) {
+        receive_message(socket_, values.data(),
+                        values.size() * sizeof(double), unused);
+    }
+    return EvaluationResult(std::move(values));
+}
@@ -0,0 +1,175 @@
+#include "eval_protocol.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+std::runtime_error socket_error(const char *what) {
+    return std::runtime_error(std::string(what) + ": " +
+                              std::strerror(errno));
+}
+
+} // namespace
+
+void send_message(int socket, const void *data, size_t size, int fd) {
+    const char *bytes = static_cast<const char *>(data);
+    while (size > 0) {
+        iovec part{const_cast<char *>(bytes), size};
+        msghdr message{};
+        message.msg_iov = &part;
+        message.msg_iovlen = 1;
+
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+        if (fd >= 0) {
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+            cmsghdr *header = CMSG_FIRSTHDR(&message);
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type = SCM_RIGHTS;
+            header->cmsg_len = CMSG_LEN(sizeof(int));
+            std::memcpy(CMSG_DATA(header), &fd, sizeof(int));
+        }
+
+        // MSG_NOSIGNAL turns a vanished peer into an error, not SIGPIPE
+        ssize_t sent = ::sendmsg(socket, &message, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw socket_error("Error sending message");
+        }
+        fd = -1; // Only attached once
+        bytes += sent;
+        size -= sent;
+    }
+}
+
+bool receive_message(int socket, void *data, size_t size, int &fd) {
+    fd = -1;
+    char *bytes = static_cast<char *>(data);
+    size_t received = 0;
+    while (received < size) {
+        iovec part{bytes + received, size - received};
+        msghdr message{};
+        message.msg_iov = &part;
+        message.msg_iovlen = 1;
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        ssize_t count = ::recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw socket_error("Error receiving message");
+        }
+        if (count == 0) {
+            if (received == 0) {
+                return false;
+            }
+            throw std::runtime_error("Connection closed mid-message.");
+        }
+        for (cmsghdr *header = CMSG_FIRSTHDR(&message); header != nullptr;
+             header = CMSG_NXTHDR(&message, header)) {
+            if (header->cmsg_level == SOL_SOCKET &&
+                header->cmsg_type == SCM_RIGHTS) {
+                std::memcpy(&fd, CMSG_DATA(header), sizeof(int));
+            }
+        }
+        received += count;
+    }
+    return true;
+}
+
+SharedBuffer::SharedBuffer() : fd_(-1), data_(nullptr), size_(0) {}
+
+SharedBuffer::~SharedBuffer() { release(); }
+
+SharedBuffer::SharedBuffer(SharedBuffer &&other) noexcept
+    : fd_(other.fd_), data_(other.data_), size_(other.size_) {
+    other.fd_ = -1;
+    other.data_ = nullptr;
+    other.size_ = 0;
+}
+
+SharedBuffer &SharedBuffer::operator=(SharedBuffer &&other) noexcept {
+    if (this != &other) {
+        release();
+        fd_ = other.fd_;
+        data_ = other.data_;
+        size_ = other.size_;
+        other.fd_ = -1;
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+void SharedBuffer::release() {
+    if (data_ != nullptr) {
+        ::munmap(data_, size_);
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+    fd_ = -1;
+    data_ = nullptr;
+    size_ = 0;
+}
+
+SharedBuffer SharedBuffer::create(size_t size) {
+    int fd = ::memfd_create("calculator", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        throw socket_error("Error creating shared buffer");
+    }
+    if (::ftruncate(fd, size) != 0) {
+        ::close(fd);
+        throw socket_error("Error sizing shared buffer");
+    }
+    // Fix the size, so the receiver's mapping cannot lose its pages
+    if (::fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) != 0) {
+        ::close(fd);
+        throw socket_error("Error sealing shared buffer");
+    }
+    return map(fd, size);
+}
+
+SharedBuffer SharedBuffer::map(int fd, size_t size) {
+    SharedBuffer buffer;
+    buffer.fd_ = fd;
+    // The sender chooses the size, so check it against the real file
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < size) {
+        throw std::runtime_error("Shared buffer is smaller than announced.");
+    }
+    if (size > 0) {
+        // A sender that could still shrink the file could make our next
+        // access to the mapping raise SIGBUS
+        int seals = ::fcntl(fd, F_GET_SEALS);
+        if (seals < 0 || !(seals & F_SEAL_SHRINK)) {
+            throw std::runtime_error("Shared buffer is not sealed.");
+        }
+        void *data =
+            ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) {
+            throw socket_error("Error mapping shared buffer");
+        }
+        buffer.data_ = data;
+        buffer.size_ = size;
+    }
+    return buffer;
+}
+
+void *SharedBuffer::data() const { return data_; }
+
+size_t SharedBuffer::size() const { return size_; }
+
+int SharedBuffer::fd() const { return fd_; }
@@ -0,0 +1,264 @@
+#include "eval_server.hpp"
+#include "analysis_parameters.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// How often blocked loops look at the stop flag
+const int POLL_INTERVAL_MS = 200;
+
+} // namespace
+
+ExpressionCache::ExpressionCache(size_t capacity)
+    : capacity_(std::max<size_t>(1, capacity)), hits_(0), misses_(0) {}
+
+std::shared_ptr<const CompiledExpression>
+ExpressionCache::get(const std::string &expression, char variable) {
+    std::string key = std::string(1, variable) + ":" + expression;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        if (it != entries_.end()) {
+            ++hits_;
+            return it->second;
+        }
+    }
+
+    // Parse with a private parameter set; the compiled form does not refer
+    // back to it
+    ++misses_;
+    AnalysisParameters params(-100, 100, AnalysisParameters::MIN_SAMPLES);
+    if (variable != params.get_variable()) {
+        params.set_variable(variable);
+    }
+    params.set_expression(expression);
+    auto compiled =
+        std::make_shared<const CompiledExpression>(
+            params.get_compiled_expression());
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto [it, inserted] = entries_.emplace(key, compiled);
+    if (!inserted) {
+        return it->second; // Another worker compiled it first
+    }
+    order_.push_back(key);
+    while (entries_.size() > capacity_) {
+        entries_.erase(order_.front());
+        order_.pop_front();
+    }
+    return compiled;
+}
+
+size_t ExpressionCache::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return entries_.size();
+}
+
+size_t ExpressionCache::get_hits() const { return hits_; }
+
+size_t ExpressionCache::get_misses() const { return misses_; }
+
+EvaluationServer::EvaluationServer(const std::string &socket_path,
+                                   unsigned workers)
+    : socket_path_(socket_path), listen_fd_(-1), stopping_(false),
+      requests_(0), workers_(workers) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.empty() ||
+        socket_path.length() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("Invalid Parameters: Socket path must "
+                                    "be 1-107 characters.");
+    }
+    std::strcpy(address.sun_path, socket_path.c_str());
+
+    listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        throw std::runtime_error("Error creating socket: " +
+                                 std::string(std::strerror(errno)));
+    }
+    ::unlink(socket_path.c_str()); // Left behind by an earlier server
+    if (::bind(listen_fd_, reinterpret_cast<sockaddr *>(&address),
+               sizeof(address)) != 0 ||
+        ::listen(listen_fd_, SOMAXCONN) != 0) {
+        std::string error = std::strerror(errno);
+        ::close(listen_fd_);
+        throw std::runtime_error("Error listening on " + socket_path + ": " +
+                                 error);
+    }
+}
+
+EvaluationServer::~EvaluationServer() {
+    stopping_ = true;
+    ::close(listen_fd_);
+    ::unlink(socket_path_.c_str());
+}
+
+const ExpressionCache &EvaluationServer::get_cache() const { return cache_; }
+
+size_t EvaluationServer::get_requests() const { return requests_; }
+
+void EvaluationServer::run(const std::atomic<bool> &stop) {
+    pollfd listener{listen_fd_, POLLIN, 0};
+    while (!stop) {
+        int ready = ::poll(&listener, 1, POLL_INTERVAL_MS);
+        if (ready <= 0) {
+            continue; // Timeout or signal: check the flag again
+        }
+        int client = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+            continue;
+        }
+        workers_.submit([this, client] { serve_connection(client); });
+    }
+    stopping_ = true;
+}
+
+void EvaluationServer::serve_connection(int client) {
+    pollfd connection{client, POLLIN, 0};
+    try {
+        while (!stopping_) {
+            if (::poll(&connection, 1, POLL_INTERVAL_MS) <= 0) {
+                continue;
+            }
+            if (!handle_request(client)) {
+                break;
+            }
+        }
+    } catch (const std::exception &) {
+        // A broken connection only ends that client's session
+    }
+    ::close(client);
+}
+
+void EvaluationServer::send_error(int client, const std::string &message) {
+    EvalResponseHeader response{{'T', 'C', 'R', 'S'},
+                                EvalResponseHeader::ERROR,
+                                0,
+                                static_cast<std::uint32_t>(message.length()),
+                                0};
+    send_message(client, &response, sizeof(response));
+    send_message(client, message.data(), message.length());
+}
+
+bool EvaluationServer::handle_request(int client) {
+    EvalRequestHeader request;
+    int fd;
+    if (!receive_message(client, &request, sizeof(request), fd)) {
+        return false;
+    }
+    // Holds a received descriptor so every return path closes it; it is
+    // mapped once the size is known
+    SharedBuffer incoming;
+    if (fd >= 0) {
+        incoming = SharedBuffer::map(fd, 0);
+    }
+    if (std::memcmp(request.magic, "TCRQ", 4) != 0 ||
+        request.expression_length > MAX_EXPRESSION_LENGTH) {
+        return false; // Not our protocol; resynchronizing is hopeless
+    }
+    std::string expression(request.expression_length, '\0');
+    int unused;
+    if (!expression.empty() &&
+        !receive_message(client, expression.data(), expression.size(),
+                         unused)) {
+        return false;
+    }
+    ++requests_;
+
+    const bool domain = request.kind == EvalRequestHeader::DOMAIN;
+    if (!domain && request.kind != EvalRequestHeader::VALUES) {
+        return false;
+    }
+    if (request.count > MAX_REQUEST_VALUES || (domain && request.count == 0)) {
+        if (!domain && !(request.flags & EvalRequestHeader::VALUES_IN_MEMFD)) {
+            return false; // The inline values cannot be skipped safely
+        }
+        send_error(client, "Invalid Parameters: Value count out of range.");
+        return true;
+    }
+
+    // Inputs: generated grid, inline doubles or a shared buffer
+    const size_t count = domain ? request.count + 1 : request.count;
+    const size_t bytes = count * sizeof(double);
+    std::vector<double> inline_values;
+    const double *xs = nullptr;
+    if (!domain) {
+        if (request.flags & EvalRequestHeader::VALUES_IN_MEMFD) {
+            if (incoming.fd() < 0) {
+                return false;
+            }
+            incoming = SharedBuffer::map(::dup(incoming.fd()), bytes);
+            xs = static_cast<const double *>(incoming.data());
+        } else {
+            inline_values.resize(count);
+            if (count > 0 && !receive_message(client, inline_values.data(),
+                                              bytes, unused)) {
+                return false;
+            }
+            xs = inline_values.data();
+        }
+    }
+
+    std::shared_ptr<const CompiledExpression> compiled;
+    try {
+        compiled = cache_.get(expression, request.variable);
+    } catch (const std::exception &e) {
+        send_error(client, e.what());
+        return true;
+    }
+
+    // Outputs go straight into the buffer that is sent back
+    SharedBuffer shared;
+    std::vector<double> inline_results;
+    double *ys;
+    if (bytes >= SHARED_PAYLOAD_BYTES) {
+        shared = SharedBuffer::create(bytes);
+        ys = static_cast<double *>(shared.data());
+    } else {
+        inline_results.resize(count);
+        ys = inline_results.data();
+    }
+
+    const double start = request.start;
+    const double step = domain ? (request.end - request.start) / request.count
+                               : 0.0;
+    ThreadPool::shared().parallel_for(
+        count, 1 << 14, [&](size_t begin, size_t end) {
+            if (!domain) {
+                compiled->evaluate(xs + begin, ys + begin, end - begin);
+                return;
+            }
+            double grid[CompiledExpression::BATCH_SIZE];
+            for (size_t i = begin; i < end;
+                 i += CompiledExpression::BATCH_SIZE) {
+                size_t n = std::min(CompiledExpression::BATCH_SIZE, end - i);
+                for (size_t j = 0; j < n; ++j) {
+                    grid[j] = start + (i + j) * step;
+                }
+                compiled->evaluate(grid, ys + i, n);
+            }
+        });
+
+    EvalResponseHeader response{{'T', 'C', 'R', 'S'},
+                                EvalResponseHeader::OK,
+                                0,
+                                0,
+                                count};
+    if (shared.fd() >= 0) {
+        response.flags = EvalResponseHeader::RESULTS_IN_MEMFD;
+        send_message(client, &response, sizeof(response), shared.fd());
+    } else {
+        send_message(client, &response, sizeof(response));
+        send_message(client, ys, bytes);
+    }
+    return true;
+}
@@ -0,0 +1,189 @@
+#include "export_writer.hpp"
+#include "telemetry.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include <cerrno>
+#include <charconv>
+#include <climits>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/uio.h>
+#include <unistd.h>
+
+int open_output_file(const std::filesystem::path &path) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Error opening output file: " +
+                                 std::string(std::strerror(errno)));
+    }
+    return fd;
+}
+
+void pwrite_fully(int fd, const void *data, size_t size,
+                  std::uint64_t offset) {
+    TRACE_SPAN_ITEMS("pwrite", "io", size);
+    const char *bytes = static_cast<const char *>(data);
+    while (size > 0) {
+        ssize_t written = ::pwrite(fd, bytes, size, offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("Error writing output file: " +
+                                     std::string(std::strerror(errno)));
+        }
+        bytes += written;
+        size -= written;
+        offset += written;
+    }
+}
+
+void write_fully(int fd, const void *data, size_t size) {
+    TRACE_SPAN_ITEMS("write", "io", size);
+    const char *bytes = static_cast<const char *>(data);
+    while (size > 0) {
+        ssize_t written = ::write(fd, bytes, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("Error writing output: " +
+                                     std::string(std::strerror(errno)));
+        }
+        bytes += written;
+        size -= written;
+    }
+}
+
+double ExportStats::megabytes_per_second() const {
+    return seconds > 0.0 ? bytes / seconds / 1e6 : 0.0;
+}
+
+TextExporter::TextExporter(int precision) : precision_(precision) {}
+
+char *TextExporter::format_value(char *first, char *last, double value) const {
+    std::to_chars_result result =
+        precision_ > 0 ? std::to_chars(first, last, value,
+                                       std::chars_format::general, precision_)
+                       : std::to_chars(first, last, value);
+    return result.ptr;
+}
+
+void TextExporter::format_rows(
+    const SampleSeries &series, size_t begin, size_t end, std::string &out,
+    const std::vector<const SampleSeries *> &columns) const {
+    size_t offset = out.size();
+    out.resize(offset + (end - begin) * (MAX_ROW_LENGTH +
+                                         columns.size() * MAX_ROW_LENGTH / 2));
+    char *cursor = out.data() + offset;
+    char *last = out.data() + out.size();
+
+    for (size_t i = begin; i < end; ++i) {
+        cursor = format_value(cursor, last, series.x(i));
+        *cursor++ = ' ';
+        cursor = format_value(cursor, last, series.y(i));
+        for (const SampleSeries *column : columns) {
+            *cursor++ = ' ';
+            cursor = format_value(cursor, last, column->y(i));
+        }
+        *cursor++ = '\n';
+    }
+    out.resize(cursor - out.data());
+}
+
+void TextExporter::format_values(const double *values, size_t count,
+                                 std::string &out) const {
+    size_t offset = out.size();
+    out.resize(offset + count * MAX_ROW_LENGTH / 2);
+    char *cursor = out.data() + offset;
+    char *last = out.data() + out.size();
+
+    for (size_t i = 0; i < count; ++i) {
+        cursor = format_value(cursor, last, values[i]);
+        *cursor++ = '\n';
+    }
+    out.resize(cursor - out.data());
+}
+
+std::vector<std::string> TextExporter::format_blocks(
+    const SampleSeries &series,
+    const std::vector<const SampleSeries *> &columns) const {
+    const size_t rows_per_block = 1 << 14;
+    size_t num_blocks = (series.size() + rows_per_block - 1) / rows_per_block;
+    std::vector<std::string> blocks(num_blocks);
+    ThreadPool::shared().parallel_for(
+        num_blocks, 1, [&](size_t first_block, size_t last_block) {
+            for (size_t b = first_block; b < last_block; ++b) {
+                size_t begin = b * rows_per_block;
+                size_t end = std::min(series.size(), begin + rows_per_block);
+                TRACE_SPAN_ITEMS("format block", "export", end - begin);
+                format_rows(series, begin, end, blocks[b], columns);
+            }
+        });
+    return blocks;
+}
+
+size_t TextExporter::write_blocks(int fd, std::vector<std::string> &blocks) {
+    TRACE_SPAN("writev", "io");
+    size_t bytes = 0;
+    std::vector<iovec> pending;
+    for (std::string &block : blocks) {
+        pending.push_back({block.data(), block.size()});
+        bytes += block.size();
+    }
+    size_t next = 0;
+    while (next < pending.size()) {
+        int count = static_cast<int>(std::min<size_t>(pending.size() - next,
+                                                       IOV_MAX));
+        ssize_t written = ::writev(fd, &pending[next], count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("Error writing output file: " +
+                                     std::string(std::strerror(errno)));
+        }
+        // Skip the buffers that went out completely, trim a partial one
+        while (next < pending.size() &&
+               static_cast<size_t>(written) >= pending[next].iov_len) {
+            written -= pending[next].iov_len;
+            ++next;
+        }
+        if (written > 0) {
+            pending[next].iov_base =
+                static_cast<char *>(pending[next].iov_base) + written;
+            pending[next].iov_len -= written;
+        }
+    }
+    return bytes;
+}
+
+ExportStats
+TextExporter::write(const std::filesystem::path &path,
+                    const SampleSeries &series,
+                    const std::vector<const SampleSeries *> &columns) const {
+    TELEMETRY_SCOPE(TelemetryStage::Export);
+    auto started = std::chrono::steady_clock::now();
+
+    // Each block is formatted into its own buffer, then the buffers are
+    // written in order
+    std::vector<std::string> blocks = format_blocks(series, columns);
+
+    int fd = open_output_file(path);
+    ExportStats stats;
+    stats.rows = series.size();
+    try {
+        stats.bytes = write_blocks(fd, blocks);
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+
+    stats.seconds = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - started)
+                        .count();
+    return stats;
+}
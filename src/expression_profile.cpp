@@ -0,0 +1,74 @@
+#include "expression_profile.hpp"
+#include <cstdio>
+
+ExpressionProfile::ExpressionProfile(const CompiledExpression &expression)
+    : expression_(expression), calls_(expression.size(), 0),
+      ns_(expression.size(), 0.0), cycles_(expression.size(), 0) {}
+
+void ExpressionProfile::add(size_t slot, size_t calls, double ns,
+                            std::uint64_t cycles) {
+    calls_[slot] += calls;
+    ns_[slot] += ns;
+    cycles_[slot] += cycles;
+}
+
+size_t ExpressionProfile::get_samples() const {
+    return calls_.empty() ? 0 : calls_.back();
+}
+
+double ExpressionProfile::get_total_ns() const {
+    double total = 0.0;
+    for (double ns : ns_) {
+        total += ns;
+    }
+    return total;
+}
+
+void ExpressionProfile::collect(int slot, int depth,
+                                std::vector<SubtermCost> &out) const {
+    const Instruction &instruction = expression_.get_instructions()[slot];
+    size_t index = out.size();
+    out.push_back(SubtermCost{expression_.get_label(slot), depth,
+                              calls_[slot], ns_[slot], ns_[slot],
+                              cycles_[slot]});
+    for (int operand : {instruction.left, instruction.right}) {
+        if (operand < 0) {
+            continue;
+        }
+        size_t child = out.size();
+        collect(operand, depth + 1, out);
+        out[index].total_ns += out[child].total_ns;
+    }
+}
+
+std::vector<SubtermCost> ExpressionProfile::breakdown() const {
+    std::vector<SubtermCost> subterms;
+    if (!calls_.empty()) {
+        collect(static_cast<int>(calls_.size()) - 1, 0, subterms);
+    }
+    return subterms;
+}
+
+std::vector<std::string> ExpressionProfile::report(size_t width) const {
+    std::vector<std::string> lines;
+    double total = get_total_ns();
+    size_t samples = get_samples();
+    char buffer[128];
+    std::snprintf(buffer, sizeof(buffer),
+                  "%zu samples, %.2f ns per sample", samples,
+                  samples > 0 ? total / samples : 0.0);
+    lines.push_back(buffer);
+    lines.push_back(" total    self  subterm");
+    for (const SubtermCost &subterm : breakdown()) {
+        std::snprintf(buffer, sizeof(buffer), "%5.1f%%  %5.1f%%  ",
+                      total > 0 ? 100.0 * subterm.total_ns / total : 0.0,
+                      total > 0 ? 100.0 * subterm.self_ns / total : 0.0);
+        std::string line = buffer + std::string(2 * subterm.depth, ' ') +
+                           subterm.label;
+        if (line.length() > width) {
+            line = line.substr(0, width > 3 ? width - 3 : 0) + "...";
+        }
+        lines.push_back(line);
+    }
+    return lines;
+}
@@ -0,0 +1,401 @@
+#include "fast_math.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace {
+
+const double PI = 3.14159265358979323846;
+const double HALF_PI = 1.57079632679489661923;
+const double TWO_OVER_PI = 0.636619772367581343076;
+const double INV_LN10 = 0.434294481903251827651;
+const double LOG2_E = 1.44269504088896340736;
+const double SQRT2 = 1.41421356237309504880;
+const double SQRT3 = 1.73205080756887729353;
+const double TAN_PI_12 = 0.267949192431122705;
+
+// pi/2 and ln 2 split into a head with trailing zero bits, so multiples
+// of the head by the reduction's integer are exact, and the rest
+const double HALF_PI_HEAD = 1.57079632673412561417e+00;
+const double HALF_PI_TAIL = 6.07710050650619224932e-11;
+const double LN2_HEAD = 6.93147180369123816490e-01;
+const double LN2_TAIL = 1.90821492927058770002e-10;
+
+// Adding this rounds a double below 2^51 to an integer, which then sits
+// in the low bits of the sum
+const double ROUNDER = 0x1.8p52;
+
+// Beyond this the reduction's integer no longer fits the head's zero bits
+const double TRIG_LIMIT = 5e5;
+// exp(708) is close to the largest double
+const double EXP_LIMIT = 708.0;
+// Integer exponents up to this are multiplied out
+const double POWER_LIMIT = 16.0;
+
+// Selections are made with masks of all ones or zeros built by integer
+// operations: the compiler vectorizes those, but not a condition on a
+// floating-point comparison, which may trap
+inline double select(uint64_t mask, double a, double b) {
+    return std::bit_cast<double>((std::bit_cast<uint64_t>(a) & mask) |
+                                 (std::bit_cast<uint64_t>(b) & ~mask));
+}
+
+// All ones where bit 0 of n is set
+inline uint64_t odd_mask(uint64_t n) { return 0 - (n & 1); }
+
+// All ones where x > limit, for x and limit not negative; such doubles
+// order as their bit patterns
+inline uint64_t above_mask(double x, double limit) {
+    return 0 - ((std::bit_cast<uint64_t>(limit) - std::bit_cast<uint64_t>(x)) >>
+                63);
+}
+
+// -x where bit 1 of n is set
+inline double negate_if(uint64_t n, double x) {
+    return std::bit_cast<double>(std::bit_cast<uint64_t>(x) ^ ((n & 2) << 62));
+}
+
+// Reduces x to r in [-pi/4, pi/4] with x = r + quadrant * pi/2
+inline double reduce_half_pi(double x, uint64_t &quadrant) {
+    double shifted = x * TWO_OVER_PI + ROUNDER;
+    quadrant = std::bit_cast<uint64_t>(shifted);
+    double k = shifted - ROUNDER;
+    return (x - k * HALF_PI_HEAD) - k * HALF_PI_TAIL;
+}
+
+// Minimax polynomials for sin and cos on [-pi/4, pi/4] (fdlibm's kernels)
+inline double sin_kernel(double r) {
+    double z = r * r;
+    double p = 8.33333333332248946124e-03 +
+               z * (-1.98412698298579493134e-04 +
+                    z * (2.75573137070700676789e-06 +
+                         z * (-2.50507602534068634195e-08 +
+                              z * 1.58969099521155010221e-10)));
+    return r + r * z * (-1.66666666666666324348e-01 + z * p);
+}
+
+inline double cos_kernel(double r) {
+    double z = r * r;
+    double p = 4.16666666666666019037e-02 +
+               z * (-1.38888888888741095749e-03 +
+                    z * (2.48015872894767294178e-05 +
+                         z * (-2.75573143513906633035e-07 +
+                              z * (2.08757232129817482790e-09 +
+                                   z * -1.13596475577881948265e-11))));
+    return 1.0 - 0.5 * z + z * z * p;
+}
+
+// arctan for x >= 0: 1/x folds x > 1 onto [0, 1], and
+// arctan(t) = pi/6 + arctan((t sqrt(3) - 1) / (t + sqrt(3))) folds that onto
+// [0, tan(pi/12)], where the Taylor series is down to 1e-16 by u^23
+inline double arctan_positive(double x) {
+    uint64_t inverted = above_mask(x, 1.0);
+    double t = select(inverted, 1.0 / x, x);
+    uint64_t shifted = above_mask(t, TAN_PI_12);
+    double u = select(shifted, (t * SQRT3 - 1.0) / (t + SQRT3), t);
+    double z = u * u;
+    double p =
+        1.0 / 3 - z * (1.0 / 5 -
+              z * (1.0 / 7 -
+                   z * (1.0 / 9 -
+                        z * (1.0 / 11 -
+                             z * (1.0 / 13 -
+                                  z * (1.0 / 15 -
+                                       z * (1.0 / 17 -
+                                            z * (1.0 / 19 -
+                                                 z * (1.0 / 21 -
+                                                      z / 23)))))))));
+    double result = u - u * z * p + select(shifted, PI / 6, 0.0);
+    return select(inverted, HALF_PI - result, result);
+}
+
+inline double arctan_any(double x) {
+    return std::copysign(arctan_positive(std::fabs(x)), x);
+}
+
+// arcsin(x) = arctan(x / sqrt(1 - x^2)), which is +-pi/2 at +-1 and NaN
+// beyond
+inline double arcsin_any(double x) {
+    return std::copysign(
+        arctan_positive(std::fabs(x) / std::sqrt((1.0 - x) * (1.0 + x))), x);
+}
+
+// arccos(x) = 2 arctan(sqrt((1 - x) / (1 + x))), accurate near 1 where
+// pi/2 - arcsin(x) would cancel
+inline double arccos_any(double x) {
+    return 2.0 * arctan_positive(std::sqrt((1.0 - x) / (1.0 + x)));
+}
+
+// ln for normal positive x: x = m 2^e with m in [sqrt(2)/2, sqrt(2)), and
+// ln(m) = 2 artanh(s) with s = (m - 1) / (m + 1), |s| < 0.172
+inline double ln_normal(double x) {
+    uint64_t bits = std::bit_cast<uint64_t>(x);
+    // The exponent field put into a double's mantissa reads as 2^52 + field
+    double e = std::bit_cast<double>((bits >> 52) | 0x4330000000000000ULL) -
+               (0x1p52 + 1023);
+    double m = std::bit_cast<double>((bits & 0x000fffffffffffffULL) |
+                                     0x3ff0000000000000ULL);
+    uint64_t high = above_mask(m, SQRT2);
+    m = select(high, 0.5 * m, m);
+    e += select(high, 1.0, 0.0);
+    double f = m - 1.0;
+    double s = f / (2.0 + f);
+    double z = s * s;
+    double p =
+        1.0 / 3 + z * (1.0 / 5 +
+              z * (1.0 / 7 +
+                   z * (1.0 / 9 +
+                        z * (1.0 / 11 +
+                             z * (1.0 / 13 +
+                                  z * (1.0 / 15 +
+                                       z * (1.0 / 17 + z / 19)))))));
+    double ln_m = f - s * (f - 2.0 * z * p);
+    return e * LN2_HEAD + (ln_m + e * LN2_TAIL);
+}
+
+inline bool ln_in_range(double x) {
+    return x >= std::numeric_limits<double>::min() &&
+           x <= std::numeric_limits<double>::max();
+}
+
+// exp for |y| <= EXP_LIMIT: y = r + n ln 2 with |r| <= ln(2)/2, the Taylor
+// series of exp(r) to r^12 and 2^n put straight into the exponent bits
+inline double exp_limited(double y) {
+    double shifted = y * LOG2_E + ROUNDER;
+    double k = shifted - ROUNDER;
+    double r = (y - k * LN2_HEAD) - k * LN2_TAIL;
+    double p =
+        1.0 / 2 + r * (1.0 / 6 +
+              r * (1.0 / 24 +
+                   r * (1.0 / 120 +
+                        r * (1.0 / 720 +
+                             r * (1.0 / 5040 +
+                                  r * (1.0 / 40320 +
+                                       r * (1.0 / 362880 +
+                                            r * (1.0 / 3628800 +
+                                                 r * (1.0 / 39916800 +
+                                                      r / 479001600)))))))));
+    double exp_r = 1.0 + r + r * r * p;
+    // The rounded k sits in the low bits of shifted; moved into the
+    // exponent field it makes 2^k, the bits of ROUNDER shifting out
+    double scale =
+        std::bit_cast<double>((std::bit_cast<uint64_t>(shifted) + 1023) << 52);
+    return exp_r * scale;
+}
+
+inline double sin_reduced(double x) {
+    uint64_t quadrant;
+    double r = reduce_half_pi(x, quadrant);
+    return negate_if(quadrant, select(odd_mask(quadrant), cos_kernel(r),
+                                      sin_kernel(r)));
+}
+
+inline double cos_reduced(double x) {
+    uint64_t quadrant;
+    double r = reduce_half_pi(x, quadrant);
+    return negate_if(quadrant + 1, select(odd_mask(quadrant), sin_kernel(r),
+                                          cos_kernel(r)));
+}
+
+inline double tan_reduced(double x) {
+    uint64_t quadrant;
+    double r = reduce_half_pi(x, quadrant);
+    double s = sin_kernel(r), c = cos_kernel(r);
+    uint64_t odd = odd_mask(quadrant);
+    return select(odd, -c, s) / select(odd, s, c);
+}
+
+inline double log_normal(double x) { return ln_normal(x) * INV_LN10; }
+
+// Exponents up to POWER_LIMIT that are whole numbers; y equals itself
+// rounded to the nearest integer exactly when it is one
+inline bool is_small_integer(double y) {
+    return std::fabs(y) <= POWER_LIMIT && (y + ROUNDER) - ROUNDER == y;
+}
+
+double power_by_squaring(double a, double b) {
+    unsigned n = static_cast<unsigned>(std::fabs(b));
+    double result = 1.0;
+    for (double factor = a; n > 0; n >>= 1, factor *= factor) {
+        if (n & 1) {
+            result *= factor;
+        }
+    }
+    return b < 0 ? 1.0 / result : result;
+}
+
+inline bool trig_in_range(double x) { return std::fabs(x) <= TRIG_LIMIT; }
+
+bool always(double) { return true; }
+
+// Lanes per block of the batch loops; a fixed count the compiler can unroll
+// into vector instructions at -O2
+const size_t BLOCK = 64;
+
+// Calls step(k) for the lanes of a block. A full block is a loop of fixed
+// length, which the compiler vectorizes at -O2 where it would not a loop
+// of unknown length.
+template <typename Step> void for_lanes(size_t lanes, Step step) {
+    if (lanes == BLOCK) {
+        for (size_t k = 0; k < BLOCK; ++k) {
+            step(k);
+        }
+    } else {
+        for (size_t k = 0; k < lanes; ++k) {
+            step(k);
+        }
+    }
+}
+
+// Runs an approximation over a block of lanes at a time, then copies the
+// block out, redoing the rare lanes outside its range with libm. The block
+// is local so the compiler knows it overlaps nothing, and the first loop
+// has no calls or branches in it.
+template <typename T, typename Fast, typename InRange, typename Exact>
+void apply_unary(const T *a, T *out, size_t count, Fast fast,
+                 InRange in_range, Exact exact) {
+    double block[BLOCK];
+    for (size_t begin = 0; begin < count; begin += BLOCK) {
+        size_t lanes = std::min(BLOCK, count - begin);
+        const T *in = a + begin;
+        for_lanes(lanes, [&](size_t k) {
+            block[k] = fast(static_cast<double>(in[k]));
+        });
+        for (size_t k = 0; k < lanes; ++k) {
+            double x = static_cast<double>(in[k]);
+            out[begin + k] = static_cast<T>(in_range(x) ? block[k] : exact(x));
+        }
+    }
+}
+
+// The same for a^b = exp(b ln(a)). Blocks whose exponents are all small
+// integers (x^2 and the like) skip it for multiplication.
+template <typename T>
+void apply_power(const T *a, const T *b, T *out, size_t count) {
+    double logs[BLOCK], block[BLOCK];
+    for (size_t begin = 0; begin < count; begin += BLOCK) {
+        size_t lanes = std::min(BLOCK, count - begin);
+        const T *base = a + begin, *exponent = b + begin;
+        bool integral = true;
+        for (size_t k = 0; k < lanes; ++k) {
+            integral &= is_small_integer(static_cast<double>(exponent[k]));
+        }
+        if (!integral) {
+            for_lanes(lanes, [&](size_t k) {
+                logs[k] = static_cast<double>(exponent[k]) *
+                          ln_normal(static_cast<double>(base[k]));
+                block[k] = exp_limited(logs[k]);
+            });
+        }
+        for (size_t k = 0; k < lanes; ++k) {
+            double x = static_cast<double>(base[k]);
+            double y = static_cast<double>(exponent[k]);
+            out[begin + k] = static_cast<T>(
+                is_small_integer(y) ? power_by_squaring(x, y)
+                : ln_in_range(x) && std::fabs(logs[k]) <= EXP_LIMIT
+                    ? block[k]
+                    : std::pow(x, y));
+        }
+    }
+}
+
+template <typename T>
+bool apply_fast(OpCode op, const T *a, const T *b, T *out, size_t count) {
+    switch (op) {
+    case OpCode::Sin:
+        apply_unary(a, out, count, [](double x) { return sin_reduced(x); },
+                    trig_in_range,
+                    [](double x) { return std::sin(x); });
+        return true;
+    case OpCode::Cos:
+        apply_unary(a, out, count, [](double x) { return cos_reduced(x); },
+                    trig_in_range,
+                    [](double x) { return std::cos(x); });
+        return true;
+    case OpCode::Tan:
+        apply_unary(a, out, count, [](double x) { return tan_reduced(x); },
+                    trig_in_range,
+                    [](double x) { return std::tan(x); });
+        return true;
+    case OpCode::Arcsin:
+        apply_unary(a, out, count, [](double x) { return arcsin_any(x); },
+                    always, fast_arcsin);
+        return true;
+    case OpCode::Arccos:
+        apply_unary(a, out, count, [](double x) { return arccos_any(x); },
+                    always, fast_arccos);
+        return true;
+    case OpCode::Arctan:
+        apply_unary(a, out, count, [](double x) { return arctan_any(x); },
+                    always, fast_arctan);
+        return true;
+    case OpCode::Log:
+        apply_unary(a, out, count, [](double x) { return log_normal(x); },
+                    ln_in_range,
+                    [](double x) { return std::log10(x); });
+        return true;
+    case OpCode::Ln:
+        apply_unary(a, out, count, [](double x) { return ln_normal(x); },
+                    ln_in_range,
+                    [](double x) { return std::log(x); });
+        return true;
+    case OpCode::Power:
+        apply_power(a, b, out, count);
+        return true;
+    default:
+        return false;
+    }
+}
+
+} // namespace
+
+double fast_sin(double x) {
+    return trig_in_range(x) ? sin_reduced(x) : std::sin(x);
+}
+
+double fast_cos(double x) {
+    return trig_in_range(x) ? cos_reduced(x) : std::cos(x);
+}
+
+double fast_tan(double x) {
+    return trig_in_range(x) ? tan_reduced(x) : std::tan(x);
+}
+
+double fast_arctan(double x) { return arctan_any(x); }
+
+double fast_arcsin(double x) { return arcsin_any(x); }
+
+double fast_arccos(double x) { return arccos_any(x); }
+
+double fast_ln(double x) {
+    return ln_in_range(x) ? ln_normal(x) : std::log(x);
+}
+
+double fast_log(double x) {
+    return ln_in_range(x) ? log_normal(x) : std::log10(x);
+}
+
+double fast_pow(double a, double b) {
+    if (is_small_integer(b)) {
+        return power_by_squaring(a, b);
+    }
+    if (ln_in_range(a) && std::isfinite(b)) {
+        double y = b * ln_normal(a);
+        if (std::fabs(y) <= EXP_LIMIT) {
+            return exp_limited(y);
+        }
+    }
+    return std::pow(a, b);
+}
+
+bool apply_fast_operation(OpCode op, const double *a, const double *b,
+                          double *out, size_t count) {
+    return apply_fast(op, a, b, out, count);
+}
+
+bool apply_fast_operation(OpCode op, const float *a, const float *b,
+                          float *out, size_t count) {
+    return apply_fast(op, a, b, out, count);
+}
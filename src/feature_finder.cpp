@@ -0,0 +1,296 @@
+#include "feature_finder.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <mutex>
+#include <utility>
+
+namespace {
+
+// Both ends finite and on opposite sides of zero, or the first exactly zero
+bool brackets_zero(double a, double b) {
+    if (!std::isfinite(a) || !std::isfinite(b)) {
+        return false;
+    }
+    return a == 0.0 || (a < 0.0 && b > 0.0) || (a > 0.0 && b < 0.0);
+}
+
+const char *kind_name(FeatureKind kind) {
+    switch (kind) {
+    case FeatureKind::Root:
+        return "root";
+    case FeatureKind::Minimum:
+        return "minimum";
+    case FeatureKind::Maximum:
+        return "maximum";
+    default:
+        return "crossing";
+    }
+}
+
+} // namespace
+
+FeatureFinder::FeatureFinder(const SampleSeries &samples, Evaluator function,
+                             Evaluator slope)
+    : samples_(samples), function_(std::move(function)),
+      slope_(std::move(slope)) {}
+
+// A sign change between neighbours brackets a root, or a pole, which the
+// refined value tells apart: near a pole it exceeds both ends
+void FeatureFinder::find_roots() {
+    TRACE_SPAN("find_roots", "analysis");
+    if (samples_.size() < 2) {
+        return;
+    }
+    std::vector<size_t> candidates =
+        scan(0, samples_.size() - 1, [this](size_t i) {
+            return brackets_zero(samples_.y(i), samples_.y(i + 1));
+        });
+    refine(candidates, [this](size_t i, Feature &feature, size_t &evals) {
+        double fa = samples_.y(i), fb = samples_.y(i + 1);
+        feature.kind = FeatureKind::Root;
+        feature.x = fa == 0.0 ? samples_.x(i)
+                              : brent(function_, samples_.x(i),
+                                      samples_.x(i + 1), fa, fb, evals);
+        feature.y = fa == 0.0 ? 0.0 : function_(feature.x);
+        evals += fa == 0.0 ? 0 : 1;
+        return std::fabs(feature.y) <=
+               std::max(std::fabs(fa), std::fabs(fb));
+    });
+}
+
+// Where the differences between neighbours change sign the slope does too,
+// between the samples either side. A pole changes the differences but not
+// the slope, so it is dropped.
+void FeatureFinder::find_extrema() {
+    TRACE_SPAN("find_extrema", "analysis");
+    if (samples_.size() < 3) {
+        return;
+    }
+    std::vector<size_t> candidates =
+        scan(1, samples_.size() - 1, [this](size_t i) {
+            double before = samples_.y(i) - samples_.y(i - 1);
+            double after = samples_.y(i + 1) - samples_.y(i);
+            return std::isfinite(before) && std::isfinite(after) &&
+                   ((before > 0.0 && after < 0.0) ||
+                    (before < 0.0 && after > 0.0));
+        });
+    refine(candidates, [this](size_t i, Feature &feature, size_t &evals) {
+        bool maximum = samples_.y(i) > samples_.y(i - 1);
+        double a = samples_.x(i - 1), b = samples_.x(i + 1);
+        double sa = slope_(a), sb = slope_(b);
+        evals += 2;
+        feature.kind = maximum ? FeatureKind::Maximum : FeatureKind::Minimum;
+        feature.x = samples_.x(i);
+        feature.y = samples_.y(i);
+        if (!brackets_zero(sa, sb) && !brackets_zero(sb, sa)) {
+            return false;
+        }
+        double x = sa == 0.0   ? a
+                   : sb == 0.0 ? b
+                               : brent(slope_, a, b, sa, sb, evals);
+        double y = function_(x);
+        ++evals;
+        // A cusp or jump can leave the slope's zero worse than the sample
+        // it started from
+        if (maximum ? y >= feature.y : y <= feature.y) {
+            feature.x = x;
+            feature.y = y;
+        }
+        return true;
+    });
+}
+
+void FeatureFinder::find_intersections(const SampleSeries &other_samples,
+                                       Evaluator other, size_t index) {
+    TRACE_SPAN("find_intersections", "analysis");
+    size_t count = std::min(samples_.size(), other_samples.size());
+    if (count < 2) {
+        return;
+    }
+    auto gap = [&](size_t i) { return samples_.y(i) - other_samples.y(i); };
+    std::vector<size_t> candidates = scan(0, count - 1, [&](size_t i) {
+        return brackets_zero(gap(i), gap(i + 1));
+    });
+    Evaluator difference = [&](double x) { return function_(x) - other(x); };
+    refine(candidates, [&](size_t i, Feature &feature, size_t &evals) {
+        double ga = gap(i), gb = gap(i + 1);
+        feature.kind = FeatureKind::Intersection;
+        feature.other = index;
+        if (ga == 0.0) {
+            feature.x = samples_.x(i);
+            feature.y = samples_.y(i);
+            return true;
+        }
+        feature.x =
+            brent(difference, samples_.x(i), samples_.x(i + 1), ga, gb, evals);
+        feature.y = function_(feature.x);
+        double refined = feature.y - other(feature.x);
+        evals += 2;
+        return std::fabs(refined) <= std::max(std::fabs(ga), std::fabs(gb));
+    });
+}
+
+// Getter for features_
+const std::vector<Feature> &FeatureFinder::get_features() const {
+    return features_;
+}
+
+// Getter for evaluations_
+size_t FeatureFinder::get_evaluations() const { return evaluations_; }
+
+// Getter for truncated_
+bool FeatureFinder::is_truncated() const { return truncated_; }
+
+std::vector<std::string> FeatureFinder::report(size_t width) const {
+    std::vector<std::string> lines;
+    size_t counts[4] = {};
+    for (const Feature &feature : features_) {
+        ++counts[static_cast<int>(feature.kind)];
+    }
+    char buffer[160];
+    std::snprintf(buffer, sizeof(buffer),
+                  "%zu roots, %zu minima, %zu maxima, %zu crossings; %zu "
+                  "evaluations to refine%s",
+                  counts[0], counts[1], counts[2], counts[3], evaluations_,
+                  truncated_ ? " (list cut short)" : "");
+    lines.push_back(buffer);
+    std::snprintf(buffer, sizeof(buffer), "%-12s %20s  %20s", "kind", "x",
+                  "f1(x)");
+    lines.push_back(buffer);
+    for (const Feature &feature : features_) {
+        std::string kind = kind_name(feature.kind);
+        if (feature.kind == FeatureKind::Intersection) {
+            kind += " f" + std::to_string(feature.other + 1);
+        }
+        std::snprintf(buffer, sizeof(buffer), "%-12s %20.12g  %20.12g",
+                      kind.c_str(), feature.x, feature.y);
+        std::string line = buffer;
+        if (line.length() > width) {
+            line = line.substr(0, width > 3 ? width - 3 : 0) + "...";
+        }
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+// Brent's method: inverse quadratic or secant steps while they shrink the
+// bracket fast enough, bisection otherwise
+double FeatureFinder::brent(const Evaluator &f, double a, double b, double fa,
+                            double fb, size_t &evaluations) {
+    double c = b, fc = fb;
+    double d = b - a, e = d;
+    double scale = std::fabs(b - a);
+    for (int iteration = 0; iteration < MAX_ITERATIONS; ++iteration) {
+        if ((fb > 0.0) == (fc > 0.0)) { // c on the other side of the root
+            c = a;
+            fc = fa;
+            d = e = b - a;
+        }
+        if (std::fabs(fc) < std::fabs(fb)) { // b the best estimate so far
+            a = b;
+            b = c;
+            c = a;
+            fa = fb;
+            fb = fc;
+            fc = fa;
+        }
+        double tolerance = 2.0 * DBL_EPSILON * (std::fabs(b) + scale);
+        double middle = 0.5 * (c - b);
+        if (std::fabs(middle) <= tolerance || fb == 0.0) {
+            return b;
+        }
+        if (std::fabs(e) < tolerance || std::fabs(fa) <= std::fabs(fb)) {
+            d = e = middle;
+        } else {
+            double s = fb / fa, p, q;
+            if (a == c) { // Secant
+                p = 2.0 * middle * s;
+                q = 1.0 - s;
+            } else { // Inverse quadratic interpolation
+                double r = fb / fc;
+                q = fa / fc;
+                p = s * (2.0 * middle * q * (q - r) - (b - a) * (r - 1.0));
+                q = (q - 1.0) * (r - 1.0) * (s - 1.0);
+            }
+            if (p > 0.0) {
+                q = -q;
+            } else {
+                p = -p;
+            }
+            if (2.0 * p < std::min(3.0 * middle * q - std::fabs(tolerance * q),
+                                   std::fabs(e * q))) {
+                e = d;
+                d = p / q;
+            } else {
+                d = e = middle;
+            }
+        }
+        a = b;
+        fa = fb;
+        b += std::fabs(d) > tolerance ? d
+                                      : (middle > 0.0 ? tolerance : -tolerance);
+        fb = f(b);
+        ++evaluations;
+    }
+    return b;
+}
+
+std::vector<size_t>
+FeatureFinder::scan(size_t begin, size_t end,
+                    const std::function<bool(size_t)> &found) const {
+    TRACE_SPAN_ITEMS("scan", "analysis", end - begin);
+    // Each range collects its own hits; sorting the ranges by start keeps
+    // the hits in order
+    std::vector<std::pair<size_t, std::vector<size_t>>> ranges;
+    std::mutex mutex;
+    ThreadPool::shared().parallel_for(
+        end - begin, SCAN_CHUNK, [&](size_t first, size_t last) {
+            std::vector<size_t> hits;
+            for (size_t i = begin + first; i < begin + last; ++i) {
+                if (found(i)) {
+                    hits.push_back(i);
+                }
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            ranges.emplace_back(first, std::move(hits));
+        });
+    std::sort(ranges.begin(), ranges.end(),
+              [](const auto &a, const auto &b) { return a.first < b.first; });
+    std::vector<size_t> candidates;
+    for (const auto &[first, hits] : ranges) {
+        candidates.insert(candidates.end(), hits.begin(), hits.end());
+    }
+    return candidates;
+}
+
+void FeatureFinder::refine(
+    const std::vector<size_t> &candidates,
+    const std::function<bool(size_t, Feature &, size_t &)> &refine_one) {
+    TRACE_SPAN_ITEMS("refine", "analysis", candidates.size());
+    size_t count = std::min(candidates.size(), MAX_FEATURES);
+    truncated_ = truncated_ || candidates.size() > MAX_FEATURES;
+    std::vector<Feature> refined(count);
+    std::vector<char> kept(count, 0);
+    std::atomic<size_t> evaluations{0};
+    ThreadPool::shared().parallel_for(count, 16, [&](size_t begin, size_t end) {
+        size_t spent = 0;
+        for (size_t k = begin; k < end; ++k) {
+            kept[k] = refine_one(candidates[k], refined[k], spent);
+        }
+        evaluations += spent;
+    });
+    evaluations_ += evaluations;
+    for (size_t k = 0; k < count; ++k) {
+        if (kept[k]) {
+            features_.push_back(refined[k]);
+        }
+    }
+    std::stable_sort(
+        features_.begin(), features_.end(),
+        [](const Feature &a, const Feature &b) { return a.x < b.x; });
+}
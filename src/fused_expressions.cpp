@@ -0,0 +1,91 @@
+#include "fused_expressions.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <tuple>
+
+FusedExpressions::FusedExpressions() {}
+
+FusedExpressions::FusedExpressions(
+    const std::vector<const CompiledExpression *> &functions) {
+    // Operands are remapped to fused slots before lookup, so equal keys mean
+    // equal subtrees, not just equal operations
+    using Key = std::tuple<OpCode, int, int, std::uint64_t>;
+    std::map<Key, int> slots;
+
+    for (const CompiledExpression *function : functions) {
+        const std::vector<Instruction> &program = function->get_instructions();
+        if (program.empty()) {
+            throw std::runtime_error("Expression is not compiled.");
+        }
+        std::vector<int> remap(program.size());
+        for (size_t i = 0; i < program.size(); ++i) {
+            Instruction instruction = program[i];
+            if (instruction.left >= 0) {
+                instruction.left = remap[instruction.left];
+            }
+            if (instruction.right >= 0) {
+                instruction.right = remap[instruction.right];
+            }
+            Key key{instruction.op, instruction.left, instruction.right,
+                    std::bit_cast<std::uint64_t>(instruction.value)};
+            auto [it, inserted] =
+                slots.emplace(key, static_cast<int>(instructions_.size()));
+            if (inserted) {
+                instructions_.push_back(instruction);
+            } else {
+                ++shared_count_;
+            }
+            remap[i] = it->second;
+        }
+        outputs_.push_back(remap.back());
+    }
+}
+
+bool FusedExpressions::empty() const { return outputs_.empty(); }
+
+size_t FusedExpressions::get_function_count() const {
+    return outputs_.size();
+}
+
+size_t FusedExpressions::size() const { return instructions_.size(); }
+
+size_t FusedExpressions::get_shared_count() const { return shared_count_; }
+
+void FusedExpressions::evaluate(const double *x, double *const *ys,
+                                size_t count, MathTier tier) const {
+    evaluate_lanes(x, ys, count, tier);
+}
+
+void FusedExpressions::evaluate(const float *x, float *const *ys,
+                                size_t count, MathTier tier) const {
+    evaluate_lanes(x, ys, count, tier);
+}
+
+template <typename T>
+void FusedExpressions::evaluate_lanes(const T *x, T *const *ys, size_t count,
+                                      MathTier tier) const {
+    if (instructions_.empty()) {
+        throw std::runtime_error("Expression is not compiled.");
+    }
+    const size_t batch = CompiledExpression::BATCH_SIZE;
+    thread_local std::vector<T> scratch;
+    scratch.resize(instructions_.size() * batch);
+    for (size_t begin = 0; begin < count; begin += batch) {
+        size_t lanes = std::min(batch, count - begin);
+        for (size_t i = 0; i < instructions_.size(); ++i) {
+            const Instruction &instruction = instructions_[i];
+            apply_instruction(instruction, x + begin,
+                              scratch.data() + i * batch,
+                              scratch.data() + instruction.left * batch,
+                              scratch.data() + instruction.right * batch,
+                              lanes, nullptr, tier);
+        }
+        for (size_t k = 0; k < outputs_.size(); ++k) {
+            const T *result = scratch.data() + outputs_[k] * batch;
+            std::copy(result, result + lanes, ys[k] + begin);
+        }
+    }
+}
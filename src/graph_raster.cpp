@@ -0,0 +1,123 @@
+#include "graph_raster.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cmath>
+
+GraphRaster::GraphRaster(int width, int height, double min_x, double max_x,
+                         double min_y, double max_y)
+    : width_(std::max(0, width)), height_(std::max(0, height)),
+      min_x_(std::min(min_x, max_x)), max_x_(std::max(min_x, max_x)),
+      min_y_(std::min(min_y, max_y)), max_y_(std::max(min_y, max_y)),
+      cells_((height_ + 1) * (width_ + 1), 0) {
+    // Avoid division by zero in scaling
+    x_range_ = max_x_ - min_x_ != 0 ? max_x_ - min_x_ : 1;
+    y_range_ = max_y_ - min_y_ != 0 ? max_y_ - min_y_ : 1;
+}
+
+int GraphRaster::get_width() const { return width_; }
+
+int GraphRaster::get_height() const { return height_; }
+
+int GraphRaster::column_of(double x) const {
+    return static_cast<int>(((x - min_x_) / x_range_) * width_);
+}
+
+int GraphRaster::row_of(double y) const {
+    return height_ - static_cast<int>(((y - min_y_) / y_range_) * height_);
+}
+
+void GraphRaster::plot(const SampleSeries &series, char glyph) {
+    TRACE_SPAN_ITEMS("rasterize", "render", series.size());
+    for (size_t i = 0; i < series.size(); ++i) {
+        double x = series.x(i);
+        double y = series.y(i);
+        // NaN fails every comparison, so it is skipped here too
+        if (!(x >= min_x_ && x <= max_x_ && y >= min_y_ && y <= max_y_)) {
+            continue;
+        }
+        int column = column_of(x);
+        int row = row_of(y);
+        if (column > 0 && column < width_ && row > 0 && row < height_) {
+            cells_[row * (width_ + 1) + column] = glyph;
+        }
+    }
+}
+
+void GraphRaster::plot_lines(const SampleSeries &series, char glyph) {
+    TRACE_SPAN_ITEMS("rasterize lines", "render", series.size());
+    bool has_previous = false;
+    double previous_x = 0.0, previous_y = 0.0;
+    for (size_t i = 0; i < series.size(); ++i) {
+        double x = series.x(i);
+        double y = series.y(i);
+        if (!std::isfinite(x) || !std::isfinite(y)) {
+            has_previous = false;
+            continue;
+        }
+        if (has_previous) {
+            draw_segment(previous_x, previous_y, x, y, glyph);
+        } else {
+            draw_segment(x, y, x, y, glyph);
+        }
+        previous_x = x;
+        previous_y = y;
+        has_previous = true;
+    }
+}
+
+void GraphRaster::draw_segment(double x0, double y0, double x1, double y1,
+                               char glyph) {
+    // Work in fractional cells counted up from the bottom edge, truncated
+    // the same way as column_of and row_of
+    double c0 = (x0 - min_x_) / x_range_ * width_;
+    double c1 = (x1 - min_x_) / x_range_ * width_;
+    double r0 = (y0 - min_y_) / y_range_ * height_;
+    double r1 = (y1 - min_y_) / y_range_ * height_;
+
+    // Liang-Barsky clip to the window, so a segment leaving it far behind
+    // costs no more than one crossing it
+    double dc = c1 - c0, dr = r1 - r0;
+    double enter = 0.0, leave = 1.0;
+    const double p[] = {-dc, dc, -dr, dr};
+    const double q[] = {c0, width_ - c0, r0, height_ - r0};
+    for (int k = 0; k < 4; ++k) {
+        if (p[k] == 0.0) {
+            if (q[k] < 0.0) {
+                return; // Parallel to and outside this edge
+            }
+            continue;
+        }
+        double ratio = q[k] / p[k];
+        if (p[k] < 0.0) {
+            enter = std::max(enter, ratio);
+        } else {
+            leave = std::min(leave, ratio);
+        }
+    }
+    if (enter > leave) {
+        return;
+    }
+
+    double start_c = c0 + enter * dc, start_r = r0 + enter * dr;
+    double span_c = (leave - enter) * dc, span_r = (leave - enter) * dr;
+    int steps = static_cast<int>(
+        std::ceil(std::max(std::abs(span_c), std::abs(span_r))));
+    for (int k = 0; k <= steps; ++k) {
+        double fraction = steps > 0 ? static_cast<double>(k) / steps : 0.0;
+        int column = static_cast<int>(start_c + fraction * span_c);
+        int row = height_ - static_cast<int>(start_r + fraction * span_r);
+        if (column > 0 && column < width_ && row > 0 && row < height_) {
+            cells_[row * (width_ + 1) + column] = glyph;
+        }
+    }
+}
+
+void GraphRaster::clear() { std::fill(cells_.begin(), cells_.end(), 0); }
+
+char GraphRaster::at(int row, int column) const {
+    return cells_[row * (width_ + 1) + column];
+}
+
+size_t GraphRaster::count_filled() const {
+    return cells_.size() - std::count(cells_.begin(), cells_.end(), 0);
+}
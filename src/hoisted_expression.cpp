@@ -0,0 +1,154 @@
+#include "hoisted_expression.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+const size_t BATCH_SIZE = CompiledExpression::BATCH_SIZE;
+
+} // namespace
+
+HoistedExpression::HoistedExpression() {}
+
+HoistedExpression::HoistedExpression(const CompiledExpression &expression)
+    : instructions_(expression.get_instructions()),
+      dependence_(instructions_.size(), NONE),
+      column_(instructions_.size(), -1), scalars_(instructions_.size(), 0.0),
+      lanes_(instructions_.size() * BATCH_SIZE, 0.0) {
+    if (instructions_.empty()) {
+        throw std::runtime_error("Expression is not compiled.");
+    }
+    for (size_t i = 0; i < instructions_.size(); ++i) {
+        const Instruction &instruction = instructions_[i];
+        switch (instruction.op) {
+        case OpCode::Constant:
+            break;
+        case OpCode::Variable:
+            dependence_[i] = ON_X;
+            break;
+        case OpCode::SecondVariable:
+            dependence_[i] = ON_T;
+            break;
+        default:
+            dependence_[i] = dependence_[instruction.left] |
+                             (instruction.right >= 0
+                                  ? dependence_[instruction.right]
+                                  : static_cast<unsigned char>(NONE));
+            break;
+        }
+        if (dependence_[i] == ON_X) {
+            column_[i] = static_cast<int>(x_columns_++);
+        }
+    }
+
+    // Slots on neither input never change; folding leaves few of them
+    for (size_t i = 0; i < instructions_.size(); ++i) {
+        const Instruction &instruction = instructions_[i];
+        if (dependence_[i] != NONE) {
+            continue;
+        }
+        scalars_[i] = instruction.op == OpCode::Constant
+                          ? instruction.value
+                          : apply_operation(instruction.op,
+                                            scalars_[instruction.left],
+                                            instruction.right >= 0
+                                                ? scalars_[instruction.right]
+                                                : 0.0);
+        broadcast(i, scalars_[i]);
+    }
+}
+
+void HoistedExpression::set_x(const double *x, size_t count) {
+    TRACE_SPAN_ITEMS("hoist", "evaluate", count);
+    count_ = count;
+    x_values_.assign(x_columns_ * count, 0.0);
+    for (size_t begin = 0; begin < count; begin += BATCH_SIZE) {
+        size_t lanes = std::min(BATCH_SIZE, count - begin);
+        for (size_t i = 0; i < instructions_.size(); ++i) {
+            if (dependence_[i] != ON_X) {
+                continue;
+            }
+            const Instruction &instruction = instructions_[i];
+            apply_instruction(instruction, x + begin,
+                              x_values_.data() + column_[i] * count_ + begin,
+                              operand(instruction.left, begin),
+                              operand(instruction.right, begin), lanes);
+        }
+    }
+}
+
+void HoistedExpression::evaluate(double t, double *out) {
+    // The t-only slots are single values for the whole frame
+    for (size_t i = 0; i < instructions_.size(); ++i) {
+        const Instruction &instruction = instructions_[i];
+        if (dependence_[i] != ON_T) {
+            continue;
+        }
+        scalars_[i] = instruction.op == OpCode::SecondVariable
+                          ? t
+                          : apply_operation(instruction.op,
+                                            scalars_[instruction.left],
+                                            instruction.right >= 0
+                                                ? scalars_[instruction.right]
+                                                : 0.0);
+        broadcast(i, scalars_[i]);
+    }
+
+    size_t root = instructions_.size() - 1;
+    if (!(dependence_[root] & ON_X)) {
+        std::fill(out, out + count_, scalars_[root]);
+        return;
+    }
+    if (dependence_[root] == ON_X) {
+        const double *column = x_values_.data() + column_[root] * count_;
+        std::copy(column, column + count_, out);
+        return;
+    }
+    for (size_t begin = 0; begin < count_; begin += BATCH_SIZE) {
+        size_t lanes = std::min(BATCH_SIZE, count_ - begin);
+        for (size_t i = 0; i < instructions_.size(); ++i) {
+            if (dependence_[i] != (ON_X | ON_T)) {
+                continue;
+            }
+            const Instruction &instruction = instructions_[i];
+            apply_instruction(instruction, nullptr,
+                              lanes_.data() + i * BATCH_SIZE,
+                              operand(instruction.left, begin),
+                              operand(instruction.right, begin), lanes);
+        }
+        const double *result = lanes_.data() + root * BATCH_SIZE;
+        std::copy(result, result + lanes, out + begin);
+    }
+}
+
+// x-only slots read their hoisted column; every other slot reads its lanes,
+// which hold the broadcast scalar or this batch's values
+const double *HoistedExpression::operand(int slot, size_t begin) {
+    if (slot < 0) {
+        return nullptr;
+    }
+    if (dependence_[slot] == ON_X) {
+        return x_values_.data() + column_[slot] * count_ + begin;
+    }
+    return lanes_.data() + slot * BATCH_SIZE;
+}
+
+void HoistedExpression::broadcast(int slot, double value) {
+    std::fill(lanes_.begin() + slot * BATCH_SIZE,
+              lanes_.begin() + (slot + 1) * BATCH_SIZE, value);
+}
+
+size_t HoistedExpression::size() const { return count_; }
+
+size_t HoistedExpression::get_hoisted_count() const {
+    return std::count(dependence_.begin(), dependence_.end(), ON_X);
+}
+
+size_t HoistedExpression::get_per_frame_count() const {
+    return std::count(dependence_.begin(), dependence_.end(), ON_T);
+}
+
+size_t HoistedExpression::get_per_value_count() const {
+    return std::count(dependence_.begin(), dependence_.end(), ON_X | ON_T);
+}
@@ -1,6 +1,14 @@
 #include "TUI.hpp"
+#include "batch_cli.hpp"
+
+int main(int argc, char **argv) {
+    // Any argument selects the headless batch mode, which never starts
+    // ncurses
+    if (argc > 1) {
+        BatchCLI cli(argc, argv);
+        return cli.run();
+    }
 
-int main() {
     TUI tui;
     tui.initialize();
     tui.run();
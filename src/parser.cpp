@@ -33,12 +33,30 @@ std::unique_ptr<ASTNode> Parser::parse_term() {
 }
 
 std::unique_ptr<ASTNode> Parser::parse_factor() {
+    // Unary minus, as 0 - factor so -x^2 is -(x^2)
+    if (current_token_index < tokens.size() &&
+        tokens[current_token_index] == "-") {
+        current_token_index++;
+        return std::make_unique<BinaryOpNode>(
+            '-', std::make_unique<NumberNode>(0.0), parse_factor());
+    }
     auto node = parse_primary();
     while (current_token_index < tokens.size() &&
            tokens[current_token_index] == "^") {
         char op = tokens[current_token_index++][0];
+        // A signed exponent, x^-1
+        bool negative = current_token_index < tokens.size() &&
+                        tokens[current_token_index] == "-";
+        if (negative) {
+            current_token_index++;
+        }
+        std::unique_ptr<ASTNode> exponent = parse_primary();
+        if (negative) {
+            exponent = std::make_unique<BinaryOpNode>(
+                '-', std::make_unique<NumberNode>(0.0), std::move(exponent));
+        }
         node = std::make_unique<BinaryOpNode>(op, std::move(node),
-                                              parse_primary());
+                                              std::move(exponent));
     }
     return node;
 }
@@ -100,7 +118,7 @@ std::unique_ptr<ASTNode> Parser::parse_primary() {
     if (std::regex_match(tokens[current_token_index],
                          std::regex(R"([a-zA-Z])"))) {
         char variable = tokens[current_token_index++][0];
-        if (variable != parameters.get_variable() &&
+        if (!parameters.is_independent_variable(variable) &&
             !parameters.get_reserved_chars().contains(variable)) {
             throw std::invalid_argument("Unexpected variable '" +
                                         std::string(1, variable) + "' found.");
@@ -0,0 +1,163 @@
+#include "pipe_filter.hpp"
+#include "thread_pool.hpp"
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace {
+
+PipeFormat parse_pipe_format(const std::string &value) {
+    if (value == "txt" || value == "text") {
+        return PipeFormat::Text;
+    }
+    if (value == "bin" || value == "binary") {
+        return PipeFormat::Binary;
+    }
+    throw std::invalid_argument("Unknown pipe format '" + value +
+                                "', expected txt or bin.");
+}
+
+bool is_separator(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == ',';
+}
+
+// Reads at most size bytes, returning 0 only at end of input
+size_t read_some(int fd, char *data, size_t size) {
+    while (true) {
+        ssize_t count = ::read(fd, data, size);
+        if (count >= 0) {
+            return static_cast<size_t>(count);
+        }
+        if (errno != EINTR) {
+            throw std::runtime_error("Error reading input: " +
+                                     std::string(std::strerror(errno)));
+        }
+    }
+}
+
+} // namespace
+
+void parse_pipe_formats(const std::string &value, PipeFormat &input,
+                        PipeFormat &output) {
+    size_t colon = value.find(':');
+    input = parse_pipe_format(value.substr(0, colon));
+    output = colon == std::string::npos
+                 ? input
+                 : parse_pipe_format(value.substr(colon + 1));
+}
+
+PipeFilter::PipeFilter(const CompiledExpression &expression, PipeFormat input,
+                       PipeFormat output, int precision)
+    : expression_(expression), input_(input), output_(output),
+      formatter_(precision) {}
+
+bool PipeFilter::read_text(int fd) {
+    size_t carried = pending_.size();
+    pending_.resize(carried + READ_SIZE);
+    size_t count = read_some(fd, pending_.data() + carried, READ_SIZE);
+    pending_.resize(carried + count);
+    bool eof = count == 0;
+
+    // A trailing token is only complete once a separator or EOF follows it
+    const char *cursor = pending_.data();
+    const char *last = pending_.data() + pending_.size();
+    if (!eof) {
+        while (last > cursor && !is_separator(last[-1])) {
+            --last;
+        }
+        if (last == cursor && pending_.size() > READ_SIZE) {
+            throw std::runtime_error("Input value is too long.");
+        }
+    }
+    while (cursor < last) {
+        if (is_separator(*cursor)) {
+            ++cursor;
+            continue;
+        }
+        const char *token = cursor;
+        if (*cursor == '+') {
+            ++cursor; // from_chars rejects an explicit plus sign
+        }
+        double x;
+        std::from_chars_result result = std::from_chars(cursor, last, x);
+        if (result.ec != std::errc() ||
+            (result.ptr < last && !is_separator(*result.ptr))) {
+            const char *end = token;
+            while (end < last && !is_separator(*end)) {
+                ++end;
+            }
+            throw std::runtime_error("Invalid input value '" +
+                                     std::string(token, end) + "'.");
+        }
+        xs_.push_back(x);
+        cursor = result.ptr;
+    }
+    pending_.erase(0, cursor - pending_.data());
+    return !eof;
+}
+
+bool PipeFilter::read_binary(int fd) {
+    // Bytes of a value split across reads wait in pending_
+    size_t carried = pending_.size();
+    size_t first = xs_.size();
+    xs_.resize(first + (carried + READ_SIZE) / sizeof(double) + 1);
+    char *bytes = reinterpret_cast<char *>(xs_.data() + first);
+    std::memcpy(bytes, pending_.data(), carried);
+    size_t count = read_some(fd, bytes + carried, READ_SIZE);
+
+    size_t total = carried + count;
+    size_t values = total / sizeof(double);
+    pending_.assign(bytes + values * sizeof(double),
+                    total - values * sizeof(double));
+    xs_.resize(first + values);
+    if (count == 0 && !pending_.empty()) {
+        throw std::runtime_error("Input ends inside a value.");
+    }
+    return count != 0;
+}
+
+void PipeFilter::evaluate_and_write(int fd) {
+    if (xs_.empty()) {
+        return;
+    }
+    ys_.resize(xs_.size());
+    ThreadPool::shared().parallel_for(
+        xs_.size(), 1 << 14, [&](size_t begin, size_t end) {
+            expression_.evaluate(xs_.data() + begin, ys_.data() + begin,
+                                 end - begin);
+        });
+
+    if (output_ == PipeFormat::Binary) {
+        write_fully(fd, ys_.data(), ys_.size() * sizeof(double));
+        stats_.bytes += ys_.size() * sizeof(double);
+    } else {
+        text_.clear();
+        formatter_.format_values(ys_.data(), ys_.size(), text_);
+        write_fully(fd, text_.data(), text_.size());
+        stats_.bytes += text_.size();
+    }
+    stats_.rows += xs_.size();
+    xs_.clear();
+}
+
+ExportStats PipeFilter::run(int in_fd, int out_fd) {
+    auto started = std::chrono::steady_clock::now();
+    stats_ = ExportStats();
+    pending_.clear();
+    xs_.clear();
+
+    bool more = true;
+    while (more) {
+        more = input_ == PipeFormat::Text ? read_text(in_fd)
+                                          : read_binary(in_fd);
+        evaluate_and_write(out_fd);
+    }
+
+    stats_.seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - started)
+                         .count();
+    return stats_;
+}
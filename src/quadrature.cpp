@@ -0,0 +1,251 @@
+#include "quadrature.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Kronrod abscissae on [-1, 1], outermost first; the odd ones and the
+// centre are also the Gauss points
+const double KRONROD_NODES[8] = {
+    0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+    0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+    0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+    0.207784955007898467600689403773245, 0.0};
+const double KRONROD_WEIGHTS[8] = {
+    0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+    0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+    0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+    0.204432940075298892414161999234649, 0.209482141084727828012999174891714};
+const double GAUSS_WEIGHTS[4] = {
+    0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+    0.381830050505118944950369775488975, 0.417959183673469387755102040816327};
+
+struct Interval {
+        double a;
+        double b;
+};
+
+// What one range of intervals contributes to a round
+struct Range {
+        size_t begin = 0;
+        CompensatedSum value;
+        CompensatedSum error;
+        size_t accepted = 0;
+        double worst_error = 0.0;
+        double worst_x = 0.0;
+        std::vector<Interval> split; // Halves for the next round
+};
+
+struct Estimate {
+        double value = 0.0;
+        double error = 0.0;
+        bool rounding = false; // error is what rounding alone leaves
+        bool finite = true;
+        double trouble_x = 0.0;
+};
+
+// Node k of an interval: the centre, then pairs either side of it
+double node(const Interval &interval, size_t k) {
+    double centre = 0.5 * (interval.a + interval.b);
+    double half = 0.5 * (interval.b - interval.a);
+    if (k == 0) {
+        return centre;
+    }
+    size_t j = (k - 1) / 2;
+    return k % 2 == 1 ? centre - half * KRONROD_NODES[j]
+                      : centre + half * KRONROD_NODES[j];
+}
+
+// The Kronrod value and QUADPACK's error estimate from the 15 values f
+// takes at the nodes
+Estimate estimate(const Interval &interval, const double *f) {
+    Estimate result;
+    for (size_t k = 0; k < Quadrature::NODES; ++k) {
+        if (!std::isfinite(f[k])) {
+            result.finite = false;
+            result.trouble_x = node(interval, k);
+            return result;
+        }
+    }
+    double half = 0.5 * (interval.b - interval.a);
+    double kronrod = f[0] * KRONROD_WEIGHTS[7];
+    double gauss = f[0] * GAUSS_WEIGHTS[3];
+    double absolute = std::fabs(kronrod);
+    for (size_t j = 0; j < 7; ++j) {
+        double pair = f[1 + 2 * j] + f[2 + 2 * j];
+        kronrod += KRONROD_WEIGHTS[j] * pair;
+        absolute += KRONROD_WEIGHTS[j] *
+                    (std::fabs(f[1 + 2 * j]) + std::fabs(f[2 + 2 * j]));
+        if (j % 2 == 1) {
+            gauss += GAUSS_WEIGHTS[j / 2] * pair;
+        }
+    }
+    double mean = 0.5 * kronrod;
+    double spread = KRONROD_WEIGHTS[7] * std::fabs(f[0] - mean);
+    for (size_t j = 0; j < 7; ++j) {
+        spread += KRONROD_WEIGHTS[j] * (std::fabs(f[1 + 2 * j] - mean) +
+                                        std::fabs(f[2 + 2 * j] - mean));
+    }
+    result.value = kronrod * half;
+    absolute *= std::fabs(half);
+    spread *= std::fabs(half);
+    double error = std::fabs((kronrod - gauss) * half);
+    if (spread != 0.0 && error != 0.0) {
+        error = spread * std::min(1.0, std::pow(200.0 * error / spread, 1.5));
+    }
+    if (absolute > DBL_MIN / (50.0 * DBL_EPSILON) &&
+        error <= 50.0 * DBL_EPSILON * absolute) {
+        error = 50.0 * DBL_EPSILON * absolute;
+        result.rounding = true;
+    }
+    result.error = error;
+    return result;
+}
+
+} // namespace
+
+void CompensatedSum::add(double value) {
+    double total = sum + value;
+    compensation += std::fabs(sum) >= std::fabs(value)
+                        ? (sum - total) + value
+                        : (value - total) + sum;
+    sum = total;
+}
+
+void CompensatedSum::merge(const CompensatedSum &other) {
+    add(other.sum);
+    add(other.compensation);
+}
+
+double CompensatedSum::get() const { return sum + compensation; }
+
+Quadrature::Quadrature(Evaluator evaluator)
+    : evaluator_(std::move(evaluator)) {}
+
+QuadratureResult Quadrature::integrate(double a, double b,
+                                       double tolerance) const {
+    TRACE_SPAN("integrate", "analysis");
+    QuadratureResult result;
+    if (a == b) {
+        result.converged = true;
+        return result;
+    }
+    double sign = 1.0;
+    if (a > b) {
+        std::swap(a, b);
+        sign = -1.0;
+    }
+
+    std::vector<Interval> open(INITIAL_INTERVALS);
+    double width = (b - a) / INITIAL_INTERVALS;
+    for (size_t i = 0; i < INITIAL_INTERVALS; ++i) {
+        open[i] = {a + i * width, i + 1 == INITIAL_INTERVALS
+                                      ? b
+                                      : a + (i + 1) * width};
+    }
+
+    CompensatedSum value, error;
+    double worst_error = 0.0;
+    std::vector<Estimate> estimates;
+    for (int round = 0; !open.empty(); ++round) {
+        TRACE_SPAN_ITEMS("quadrature round", "analysis", open.size());
+        estimates.assign(open.size(), Estimate());
+
+        // One batch call per range of intervals, all 15 nodes of each
+        ThreadPool::shared().parallel_for(
+            open.size(), CHUNK_INTERVALS, [&](size_t begin, size_t end) {
+                std::vector<double> xs((end - begin) * NODES);
+                std::vector<double> ys(xs.size());
+                for (size_t i = begin; i < end; ++i) {
+                    for (size_t k = 0; k < NODES; ++k) {
+                        xs[(i - begin) * NODES + k] = node(open[i], k);
+                    }
+                }
+                evaluator_(xs.data(), ys.data(), xs.size());
+                for (size_t i = begin; i < end; ++i) {
+                    estimates[i] =
+                        estimate(open[i], ys.data() + (i - begin) * NODES);
+                }
+            });
+        result.evaluations += open.size() * NODES;
+
+        // A value that is not finite makes the integral undefined; report
+        // the leftmost one
+        for (size_t i = 0; i < open.size(); ++i) {
+            if (!estimates[i].finite) {
+                result.finite = false;
+                result.trouble_x = estimates[i].trouble_x;
+                result.value = std::numeric_limits<double>::quiet_NaN();
+                result.error = std::numeric_limits<double>::infinity();
+                return result;
+            }
+        }
+
+        // Accepted intervals go into per-range compensated partials that
+        // are merged in order, so the total does not depend on scheduling
+        bool last_round = round + 1 >= MAX_ROUNDS ||
+                          open.size() * 2 > MAX_INTERVALS;
+        std::vector<Range> ranges;
+        std::mutex mutex;
+        ThreadPool::shared().parallel_for(
+            open.size(), 1024, [&](size_t begin, size_t end) {
+                Range range;
+                range.begin = begin;
+                for (size_t i = begin; i < end; ++i) {
+                    const Interval &interval = open[i];
+                    double share = tolerance * (interval.b - interval.a) /
+                                   (b - a);
+                    double centre = 0.5 * (interval.a + interval.b);
+                    // Too narrow to split any further in doubles
+                    bool narrow = interval.b - interval.a <=
+                                  64.0 * DBL_EPSILON *
+                                      std::max(1.0, std::fabs(centre));
+                    // Halving cannot beat rounding, so such an interval is
+                    // as good as it gets
+                    bool resolved = estimates[i].error <= share ||
+                                    estimates[i].rounding;
+                    if (!resolved && !narrow && !last_round) {
+                        range.split.push_back({interval.a, centre});
+                        range.split.push_back({centre, interval.b});
+                        continue;
+                    }
+                    range.value.add(estimates[i].value);
+                    range.error.add(estimates[i].error);
+                    ++range.accepted;
+                    // Accepted without meeting its share
+                    if (!resolved && estimates[i].error > range.worst_error) {
+                        range.worst_error = estimates[i].error;
+                        range.worst_x = centre;
+                    }
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                ranges.push_back(std::move(range));
+            });
+        std::sort(ranges.begin(), ranges.end(),
+                  [](const Range &x, const Range &y) {
+                      return x.begin < y.begin;
+                  });
+        open.clear();
+        for (Range &range : ranges) {
+            value.merge(range.value);
+            error.merge(range.error);
+            result.intervals += range.accepted;
+            if (range.worst_error > worst_error) {
+                worst_error = range.worst_error;
+                result.trouble_x = range.worst_x;
+            }
+            open.insert(open.end(), range.split.begin(), range.split.end());
+        }
+    }
+
+    result.value = sign * value.get();
+    result.error = error.get();
+    result.converged = worst_error == 0.0;
+    return result;
+}
@@ -0,0 +1,59 @@
+#include "sample_grid.hpp"
+#include <cstdint>
+#include <numeric>
+
+SampleGrid::SampleGrid() : start_(0), end_(0), num_samples_(0) {}
+
+SampleGrid::SampleGrid(int start, int end, int num_samples)
+    : start_(start), end_(end), num_samples_(num_samples) {}
+
+int SampleGrid::get_start() const { return start_; }
+
+int SampleGrid::get_end() const { return end_; }
+
+int SampleGrid::get_num_samples() const { return num_samples_; }
+
+size_t SampleGrid::size() const {
+    return num_samples_ > 0 ? static_cast<size_t>(num_samples_) + 1 : 0;
+}
+
+double SampleGrid::get_step() const {
+    return (static_cast<double>(end_) - start_) / num_samples_;
+}
+
+// Matches SampleSeries::x so a uniform series built from this grid agrees
+double SampleGrid::x_at(size_t index) const {
+    return start_ + static_cast<double>(index) * get_step();
+}
+
+std::vector<long> SampleGrid::map_onto(const SampleGrid &previous) const {
+    std::vector<long> mapping(size(), -1);
+    if (previous.size() == 0 || size() == 0) {
+        return mapping;
+    }
+
+    // Point i lies at previous index j = A_i * N0 / (N * L0), where
+    // A_i = (start - start0) * N + i * L. Reducing N0 against the
+    // denominator keeps every intermediate inside 64 bits.
+    const std::int64_t length = static_cast<std::int64_t>(end_) - start_;
+    const std::int64_t previous_length =
+        static_cast<std::int64_t>(previous.end_) - previous.start_;
+    const std::int64_t denominator = num_samples_ * previous_length;
+    const std::int64_t divisor = std::gcd(
+        static_cast<std::int64_t>(previous.num_samples_), denominator);
+    const std::int64_t reduced_denominator = denominator / divisor;
+    const std::int64_t index_scale = previous.num_samples_ / divisor;
+
+    std::int64_t offset =
+        (static_cast<std::int64_t>(start_) - previous.start_) * num_samples_;
+    for (size_t i = 0; i < mapping.size(); ++i, offset += length) {
+        if (offset < 0 || offset % reduced_denominator != 0) {
+            continue;
+        }
+        std::int64_t quotient = offset / reduced_denominator;
+        if (quotient <= divisor) {
+            mapping[i] = static_cast<long>(quotient * index_scale);
+        }
+    }
+    return mapping;
+}
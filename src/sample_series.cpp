@@ -0,0 +1,171 @@
+#include "sample_series.hpp"
+#include <stdexcept>
+
+// Constructor for a series with an explicit x column
+SampleSeries::SampleSeries() : uniform_(false), start_(0.0), step_(0.0) {}
+
+// Constructor for a uniform series, preallocated to its final size in
+// the column of its precision
+SampleSeries::SampleSeries(double start, double step, size_t size,
+                           Precision precision)
+    : uniform_(true), precision_(precision), start_(start), step_(step),
+      y_(precision == Precision::Float64 ? size : 0),
+      y32_(precision == Precision::Float32 ? size : 0) {}
+
+bool SampleSeries::is_uniform() const { return uniform_; }
+
+// Getter for precision_
+Precision SampleSeries::get_precision() const { return precision_; }
+
+double SampleSeries::get_start() const { return start_; }
+
+double SampleSeries::get_step() const { return step_; }
+
+size_t SampleSeries::size() const {
+    return precision_ == Precision::Float32 ? y32_.size() : y_.size();
+}
+
+bool SampleSeries::empty() const { return size() == 0; }
+
+double SampleSeries::x(size_t index) const {
+    if (uniform_) {
+        return start_ + static_cast<double>(index) * step_;
+    }
+    return x_[index];
+}
+
+double SampleSeries::y(size_t index) const {
+    return precision_ == Precision::Float32 ? y32_[index] : y_[index];
+}
+
+double *SampleSeries::y_data() { return y_.data(); }
+
+const double *SampleSeries::y_data() const { return y_.data(); }
+
+float *SampleSeries::y32_data() { return y32_.data(); }
+
+const float *SampleSeries::y32_data() const { return y32_.data(); }
+
+const double *SampleSeries::x_data() const {
+    return uniform_ ? nullptr : x_.data();
+}
+
+// Turns the series into a uniform float64 one, reusing its y storage
+void SampleSeries::assign_uniform(double start, double step, size_t size) {
+    uniform_ = true;
+    precision_ = Precision::Float64;
+    start_ = start;
+    step_ = step;
+    x_.clear();
+    y32_.clear();
+    y_.resize(size);
+}
+
+void SampleSeries::reserve(size_t capacity) {
+    if (!uniform_) {
+        x_.reserve(capacity);
+    }
+    if (precision_ == Precision::Float32) {
+        y32_.reserve(capacity);
+    } else {
+        y_.reserve(capacity);
+    }
+}
+
+void SampleSeries::resize(size_t size) {
+    if (!uniform_) {
+        x_.resize(size);
+    }
+    if (precision_ == Precision::Float32) {
+        y32_.resize(size);
+    } else {
+        y_.resize(size);
+    }
+}
+
+void SampleSeries::clear() {
+    x_.clear();
+    y_.clear();
+    y32_.clear();
+}
+
+void SampleSeries::set_y(size_t index, double value) {
+    if (precision_ == Precision::Float32) {
+        y32_[index] = static_cast<float>(value);
+    } else {
+        y_[index] = value;
+    }
+}
+
+void SampleSeries::append(double y) {
+    if (!uniform_) {
+        throw std::logic_error("Explicit series needs an x value.");
+    }
+    if (precision_ == Precision::Float32) {
+        y32_.push_back(static_cast<float>(y));
+    } else {
+        y_.push_back(y);
+    }
+}
+
+void SampleSeries::append(double x, double y) {
+    if (uniform_) {
+        throw std::logic_error("Uniform series cannot take an x value.");
+    }
+    x_.push_back(x);
+    y_.push_back(y);
+}
+
+// Scans below are branch-free so the compiler can vectorize them; v - v is
+// zero only for finite v. They run over whichever column holds y.
+namespace {
+
+template <typename T> ValueRange range_of(const T *y, size_t n) {
+    ValueRange range;
+    for (size_t i = 0; i < n; ++i) {
+        const double v = y[i];
+        const bool finite = v - v == 0.0;
+        range.min = (finite && v < range.min) ? v : range.min;
+        range.max = (finite && v > range.max) ? v : range.max;
+    }
+    return range;
+}
+
+template <typename T> size_t nan_in(const T *y, size_t n) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; ++i) {
+        count += y[i] != y[i];
+    }
+    return count;
+}
+
+template <typename T> size_t inf_in(const T *y, size_t n) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; ++i) {
+        count += (y[i] == std::numeric_limits<T>::infinity()) |
+                 (y[i] == -std::numeric_limits<T>::infinity());
+    }
+    return count;
+}
+
+} // namespace
+
+ValueRange SampleSeries::y_range() const {
+    return precision_ == Precision::Float32 ? range_of(y32_.data(), size())
+                                            : range_of(y_.data(), size());
+}
+
+size_t SampleSeries::count_nan() const {
+    return precision_ == Precision::Float32 ? nan_in(y32_.data(), size())
+                                            : nan_in(y_.data(), size());
+}
+
+size_t SampleSeries::count_inf() const {
+    return precision_ == Precision::Float32 ? inf_in(y32_.data(), size())
+                                            : inf_in(y_.data(), size());
+}
+
+size_t SampleSeries::memory_bytes() const {
+    return (x_.capacity() + y_.capacity()) * sizeof(double) +
+           y32_.capacity() * sizeof(float);
+}
@@ -0,0 +1,189 @@
+#include "sample_stats.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+void SampleStats::add(double value) {
+    if (std::isnan(value)) {
+        ++nan_;
+        return;
+    }
+    if (std::isinf(value)) {
+        ++inf_;
+        return;
+    }
+    if (histogram_.empty()) {
+        histogram_.assign(BUCKETS, 0);
+    }
+    ++histogram_[bucket_of(value)];
+    ++finite_;
+    sum_ += value;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+}
+
+void SampleStats::add(const double *values, size_t count) {
+    add_values(values, count);
+}
+
+void SampleStats::add(const float *values, size_t count) {
+    add_values(values, count);
+}
+
+// The same as add for each value, with the running totals kept in locals;
+// v - v is zero only for finite v
+template <typename T>
+void SampleStats::add_values(const T *values, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    if (histogram_.empty()) {
+        histogram_.assign(BUCKETS, 0);
+    }
+    uint64_t *histogram = histogram_.data();
+    size_t finite = 0, nan = 0;
+    double sum = 0.0, min = min_, max = max_;
+    for (size_t i = 0; i < count; ++i) {
+        const double v = values[i];
+        if (v - v == 0.0) {
+            ++histogram[bucket_of(v)];
+            ++finite;
+            sum += v;
+            min = v < min ? v : min;
+            max = v > max ? v : max;
+        } else {
+            nan += v != v;
+        }
+    }
+    finite_ += finite;
+    nan_ += nan;
+    inf_ += count - finite - nan;
+    sum_ += sum;
+    min_ = min;
+    max_ = max;
+}
+
+void SampleStats::merge(const SampleStats &other) {
+    if (!other.histogram_.empty()) {
+        if (histogram_.empty()) {
+            histogram_.assign(BUCKETS, 0);
+        }
+        for (size_t b = 0; b < BUCKETS; ++b) {
+            histogram_[b] += other.histogram_[b];
+        }
+    }
+    finite_ += other.finite_;
+    nan_ += other.nan_;
+    inf_ += other.inf_;
+    sum_ += other.sum_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+}
+
+// Getter for the number of values added
+size_t SampleStats::get_count() const { return finite_ + nan_ + inf_; }
+
+// Getter for finite_
+size_t SampleStats::get_finite() const { return finite_; }
+
+// Getter for nan_
+size_t SampleStats::get_nan() const { return nan_; }
+
+// Getter for inf_
+size_t SampleStats::get_inf() const { return inf_; }
+
+// Getter for min_
+double SampleStats::get_min() const { return min_; }
+
+// Getter for max_
+double SampleStats::get_max() const { return max_; }
+
+double SampleStats::get_mean() const {
+    return finite_ > 0 ? sum_ / finite_
+                       : std::numeric_limits<double>::quiet_NaN();
+}
+
+// Finds the bucket holding the wanted rank and interpolates linearly inside
+// it, which is exact for values spread evenly over the bucket
+double SampleStats::percentile(double p) const {
+    if (finite_ == 0) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    if (p <= 0.0) {
+        return min_;
+    }
+    if (p >= 1.0) {
+        return max_;
+    }
+    double rank = p * (finite_ - 1);
+    double below = 0.0;
+    size_t b = 0;
+    while (b + 1 < BUCKETS && below + histogram_[b] <= rank) {
+        below += histogram_[b];
+        ++b;
+    }
+    double fraction = histogram_[b] > 0
+                          ? (rank - below + 0.5) / histogram_[b]
+                          : 0.5;
+    double value = 0.0;
+    if (b > SIDE) {
+        double low = magnitude_of(b - SIDE - 1);
+        double high = magnitude_of(b - SIDE);
+        value = low + fraction * (high - low);
+    } else if (b < SIDE) {
+        double low = magnitude_of(SIDE - 1 - b);
+        double high = magnitude_of(SIDE - b);
+        value = -high + fraction * (high - low);
+    }
+    return std::clamp(value, min_, max_);
+}
+
+ValueRange SampleStats::fit_range() const {
+    ValueRange range;
+    if (finite_ == 0) {
+        return range;
+    }
+    double lower = percentile(0.25);
+    double upper = percentile(0.75);
+    double spread = upper - lower;
+    range.min = std::max(min_, lower - FENCE * spread);
+    range.max = std::min(max_, upper + FENCE * spread);
+    // A constant, or nearly so, is shown in a unit band around its value
+    if (range.max - range.min <=
+        1e-12 * std::max(1.0, std::fabs(range.max))) {
+        range.min -= 1.0;
+        range.max += 1.0;
+        return range;
+    }
+    double margin = MARGIN * (range.max - range.min);
+    range.min -= margin;
+    range.max += margin;
+    return range;
+}
+
+// Buckets run in order of value: negative magnitudes from the largest
+// down, zero, then positive magnitudes from the smallest up. The exponent
+// and the top mantissa bits of the double give the bucket directly.
+size_t SampleStats::bucket_of(double value) {
+    uint64_t bits = std::bit_cast<uint64_t>(std::fabs(value));
+    int exponent = static_cast<int>(bits >> 52) - 1023;
+    if (exponent < MIN_EXPONENT) {
+        return SIDE;
+    }
+    size_t mantissa =
+        (bits >> (52 - MANTISSA_BITS)) & (BUCKETS_PER_OCTAVE - 1);
+    size_t offset = exponent >= MAX_EXPONENT
+                        ? SIDE - 1
+                        : static_cast<size_t>(exponent - MIN_EXPONENT) *
+                                  BUCKETS_PER_OCTAVE +
+                              mantissa;
+    return value > 0.0 ? SIDE + 1 + offset : SIDE - 1 - offset;
+}
+
+double SampleStats::magnitude_of(size_t offset) {
+    int exponent = static_cast<int>(offset / BUCKETS_PER_OCTAVE) + MIN_EXPONENT;
+    double mantissa =
+        1.0 + static_cast<double>(offset % BUCKETS_PER_OCTAVE) /
+                  BUCKETS_PER_OCTAVE;
+    return std::ldexp(mantissa, exponent);
+}
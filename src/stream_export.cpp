@@ -0,0 +1,192 @@
+#include "stream_export.hpp"
+#include "binary_export.hpp"
+#include "compressed_archive.hpp"
+#include "telemetry.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+
+// TextChunkSink Implementation
+TextChunkSink::TextChunkSink(const std::filesystem::path &path,
+                             const TextExporter &exporter)
+    : fd_(open_output_file(path)), exporter_(exporter), bytes_(0) {}
+
+TextChunkSink::~TextChunkSink() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+void TextChunkSink::write_chunk(const SampleSeries &chunk) {
+    std::vector<std::string> blocks = exporter_.format_blocks(chunk);
+    bytes_ += TextExporter::write_blocks(fd_, blocks);
+}
+
+void TextChunkSink::finish() {
+    ::close(fd_);
+    fd_ = -1;
+}
+
+size_t TextChunkSink::bytes_written() const { return bytes_; }
+
+std::string extension_for(ExportFormat format) {
+    switch (format) {
+    case ExportFormat::Binary:
+        return ".bin";
+    case ExportFormat::Archive:
+        return ".gor";
+    default:
+        return ".txt";
+    }
+}
+
+std::unique_ptr<ChunkSink> make_chunk_sink(ExportFormat format,
+                                           const std::filesystem::path &path,
+                                           const AnalysisParameters &params,
+                                           long long num_samples) {
+    const double start = params.get_start();
+    const double step =
+        (static_cast<double>(params.get_end()) - start) / num_samples;
+
+    if (format == ExportFormat::Binary) {
+        BinaryRunInfo info;
+        info.expression = params.get_expression();
+        info.variable = params.get_variable();
+        info.start = start;
+        info.end = params.get_end();
+        info.step = step;
+        info.sample_count = num_samples + 1;
+        return std::make_unique<BinaryChunkSink>(path, info);
+    }
+    if (format == ExportFormat::Archive) {
+        return std::make_unique<ArchiveEncoder>(path, params.get_expression(),
+                                                params.get_variable(), false,
+                                                start, step);
+    }
+    return std::make_unique<TextChunkSink>(
+        path, TextExporter(params.get_export_precision()));
+}
+
+// StreamExporter Implementation
+StreamExporter::StreamExporter(AnalysisParameters &params, size_t chunk_size)
+    : parameters(params), chunk_size_(std::max<size_t>(1, chunk_size)) {}
+
+ExportStats StreamExporter::run(long long num_samples, ChunkSink &sink,
+                                const std::function<void(double)> &progress) {
+    TELEMETRY_SCOPE(TelemetryStage::Export);
+    auto started = std::chrono::steady_clock::now();
+
+    const double start = parameters.get_start();
+    const double step =
+        (static_cast<double>(parameters.get_end()) - start) / num_samples;
+    const unsigned long long total = num_samples + 1;
+
+    SampleSeries slots[2];
+    bool full[2] = {false, false};
+    bool evaluation_done = false;
+    std::exception_ptr writer_error;
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    // Writer: drains the ring in order until evaluation is done and empty
+    std::thread writer([&]() {
+        TRACE_THREAD_NAME("stream writer");
+        for (size_t k = 0;; ++k) {
+            SampleSeries &slot = slots[k % 2];
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock,
+                             [&] { return full[k % 2] || evaluation_done; });
+                if (!full[k % 2]) {
+                    return;
+                }
+            }
+            try {
+                sink.write_chunk(slot);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                writer_error = std::current_exception();
+                full[k % 2] = false;
+                changed.notify_all();
+                return;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            full[k % 2] = false;
+            changed.notify_all();
+        }
+    });
+
+    std::exception_ptr evaluation_error;
+    try {
+        size_t k = 0;
+        for (unsigned long long first = 0; first < total;
+             first += chunk_size_, ++k) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock,
+                             [&] { return !full[k % 2] || writer_error; });
+                if (writer_error) {
+                    break;
+                }
+            }
+            size_t count = std::min<unsigned long long>(chunk_size_,
+                                                        total - first);
+            slots[k % 2].assign_uniform(start + first * step, step, count);
+            evaluate_chunk(slots[k % 2]);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                full[k % 2] = true;
+            }
+            changed.notify_all();
+            if (progress) {
+                progress(static_cast<double>(first + count) / total);
+            }
+        }
+    } catch (...) {
+        evaluation_error = std::current_exception();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        evaluation_done = true;
+    }
+    changed.notify_all();
+    writer.join();
+
+    if (evaluation_error) {
+        std::rethrow_exception(evaluation_error);
+    }
+    if (writer_error) {
+        std::rethrow_exception(writer_error);
+    }
+    sink.finish();
+
+    ExportStats stats;
+    stats.rows = total;
+    stats.bytes = sink.bytes_written();
+    stats.seconds = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - started)
+                        .count();
+    return stats;
+}
+
+void StreamExporter::evaluate_chunk(SampleSeries &chunk) {
+    // The compiled expression is read-only, so slices of the chunk are
+    // evaluated in batches on the shared pool
+    double *y = chunk.y_data();
+    ThreadPool::shared().parallel_for(
+        chunk.size(), 4096, [&](size_t begin, size_t end) {
+            TRACE_SPAN_ITEMS("evaluate chunk", "evaluate", end - begin);
+            std::vector<double> xs(end - begin);
+            for (size_t i = begin; i < end; ++i) {
+                xs[i - begin] = chunk.x(i);
+            }
+            parameters.evaluate_batch(xs.data(), y + begin, xs.size());
+        });
+}
@@ -0,0 +1,96 @@
+#include "surface_grid.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+SurfaceGrid::SurfaceGrid() : SurfaceGrid(0, 0, 0.0, 0.0, 0.0, 0.0) {}
+
+SurfaceGrid::SurfaceGrid(size_t columns, size_t rows, double min_x,
+                         double max_x, double min_y, double max_y)
+    : columns_(columns), rows_(rows), min_x_(min_x), max_x_(max_x),
+      min_y_(min_y), max_y_(max_y), values_(columns * rows, 0.0) {}
+
+size_t SurfaceGrid::get_columns() const { return columns_; }
+
+size_t SurfaceGrid::get_rows() const { return rows_; }
+
+double SurfaceGrid::get_min_x() const { return min_x_; }
+
+double SurfaceGrid::get_max_x() const { return max_x_; }
+
+double SurfaceGrid::get_min_y() const { return min_y_; }
+
+double SurfaceGrid::get_max_y() const { return max_y_; }
+
+size_t SurfaceGrid::size() const { return values_.size(); }
+
+bool SurfaceGrid::empty() const { return values_.empty(); }
+
+double SurfaceGrid::x_at(size_t column) const {
+    return columns_ > 1 ? min_x_ + (max_x_ - min_x_) * column / (columns_ - 1)
+                        : min_x_;
+}
+
+double SurfaceGrid::y_at(size_t row) const {
+    return rows_ > 1 ? max_y_ - (max_y_ - min_y_) * row / (rows_ - 1) : max_y_;
+}
+
+double SurfaceGrid::at(size_t row, size_t column) const {
+    return values_[row * columns_ + column];
+}
+
+const double *SurfaceGrid::data() const { return values_.data(); }
+
+ValueRange SurfaceGrid::range() const {
+    ValueRange range;
+    for (double value : values_) {
+        if (std::isfinite(value)) {
+            range.min = std::min(range.min, value);
+            range.max = std::max(range.max, value);
+        }
+    }
+    return range;
+}
+
+size_t SurfaceGrid::memory_bytes() const {
+    return values_.capacity() * sizeof(double);
+}
+
+void SurfaceGrid::evaluate(const CompiledExpression &surface) {
+    size_t tile_columns = (columns_ + TILE_COLUMNS - 1) / TILE_COLUMNS;
+    size_t tile_rows = (rows_ + TILE_ROWS - 1) / TILE_ROWS;
+
+    ThreadPool::shared().parallel_for(
+        tile_columns * tile_rows, 1, [&](size_t begin, size_t end) {
+            TRACE_SPAN_ITEMS("evaluate tiles", "evaluate", end - begin);
+            std::vector<double> xs, ys, out;
+            for (size_t tile = begin; tile < end; ++tile) {
+                size_t first_row = tile / tile_columns * TILE_ROWS;
+                size_t first_column = tile % tile_columns * TILE_COLUMNS;
+                size_t height = std::min(TILE_ROWS, rows_ - first_row);
+                size_t width = std::min(TILE_COLUMNS, columns_ - first_column);
+
+                // One batch per tile: every point with its own (x, y)
+                xs.resize(width * height);
+                ys.resize(width * height);
+                out.resize(width * height);
+                for (size_t r = 0; r < height; ++r) {
+                    double y = y_at(first_row + r);
+                    for (size_t c = 0; c < width; ++c) {
+                        xs[r * width + c] = x_at(first_column + c);
+                        ys[r * width + c] = y;
+                    }
+                }
+                surface.evaluate(xs.data(), ys.data(), out.data(),
+                                 out.size());
+                for (size_t r = 0; r < height; ++r) {
+                    std::copy(out.begin() + r * width,
+                              out.begin() + (r + 1) * width,
+                              values_.begin() + (first_row + r) * columns_ +
+                                  first_column);
+                }
+            }
+        });
+}
@@ -0,0 +1,101 @@
+#include "telemetry.hpp"
+#include <algorithm>
+
+Telemetry::Telemetry()
+    : evaluated_(0), reused_(0), nan_(0), inf_(0), memory_(0),
+      peak_memory_(0) {}
+
+Telemetry &Telemetry::instance() {
+    static Telemetry telemetry;
+    return telemetry;
+}
+
+void Telemetry::record(TelemetryStage stage, double seconds) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    StageTiming &timing = timings_[static_cast<int>(stage)];
+    timing.last_seconds = seconds;
+    timing.total_seconds += seconds;
+    ++timing.calls;
+}
+
+StageTiming Telemetry::get_timing(TelemetryStage stage) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return timings_[static_cast<int>(stage)];
+}
+
+void Telemetry::record_samples(size_t evaluated, size_t reused, size_t nan,
+                               size_t inf) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    evaluated_ = evaluated;
+    reused_ = reused;
+    nan_ = nan;
+    inf_ = inf;
+}
+
+void Telemetry::record_memory(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    memory_ = bytes;
+    peak_memory_ = std::max(peak_memory_, bytes);
+}
+
+size_t Telemetry::get_evaluated() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return evaluated_;
+}
+
+size_t Telemetry::get_reused() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return reused_;
+}
+
+size_t Telemetry::get_nan() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return nan_;
+}
+
+size_t Telemetry::get_inf() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return inf_;
+}
+
+size_t Telemetry::get_memory() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return memory_;
+}
+
+size_t Telemetry::get_peak_memory() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return peak_memory_;
+}
+
+const char *Telemetry::stage_name(TelemetryStage stage) {
+    switch (stage) {
+    case TelemetryStage::Parse:
+        return "parse";
+    case TelemetryStage::Evaluate:
+        return "evaluate";
+    case TelemetryStage::Render:
+        return "render";
+    case TelemetryStage::Export:
+        return "export";
+    default:
+        return "?";
+    }
+}
+
+ScopedTimer::ScopedTimer(TelemetryStage stage)
+    : stage_(stage), started_(std::chrono::steady_clock::now()),
+      running_(true) {}
+
+ScopedTimer::~ScopedTimer() { stop(); }
+
+void ScopedTimer::stop() {
+    if (!running_) {
+        return;
+    }
+    running_ = false;
+    Telemetry::instance().record(
+        stage_, std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - started_)
+                    .count());
+}
@@ -0,0 +1,118 @@
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+ThreadPool::ThreadPool(unsigned num_threads) : stopping_(false) {
+    num_threads = std::max(1u, num_threads);
+    for (unsigned i = 0; i < num_threads; ++i) {
+        workers_.emplace_back(&ThreadPool::worker_loop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    condition_.notify_all();
+    for (std::thread &worker : workers_) {
+        worker.join();
+    }
+}
+
+ThreadPool &ThreadPool::shared() {
+    static ThreadPool pool(std::thread::hardware_concurrency());
+    return pool;
+}
+
+unsigned ThreadPool::size() const {
+    return static_cast<unsigned>(workers_.size());
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push(std::move(task));
+    }
+    condition_.notify_one();
+}
+
+void ThreadPool::parallel_for(size_t count, size_t min_chunk,
+                              const std::function<void(size_t, size_t)> &fn) {
+    if (count == 0) {
+        return;
+    }
+    min_chunk = std::max<size_t>(1, min_chunk);
+    // A few ranges per worker keeps the load balanced when ranges differ in
+    // cost (e.g. NaN regions that short-circuit)
+    size_t chunk = std::max(min_chunk, count / (size() * 4 + 1) + 1);
+    size_t num_chunks = (count + chunk - 1) / chunk;
+    if (num_chunks == 1) {
+        fn(0, count);
+        return;
+    }
+
+    // Shared so helpers that start after the caller returns stay valid
+    struct State {
+            std::atomic<size_t> next{0};
+            std::atomic<size_t> done{0};
+            std::mutex mutex;
+            std::condition_variable finished;
+            std::exception_ptr error;
+    };
+    auto state = std::make_shared<State>();
+
+    auto work = [state, &fn, count, chunk, num_chunks]() {
+        size_t index;
+        while ((index = state->next.fetch_add(1)) < num_chunks) {
+            size_t begin = index * chunk;
+            try {
+                fn(begin, std::min(count, begin + chunk));
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (!state->error) {
+                    state->error = std::current_exception();
+                }
+            }
+            if (state->done.fetch_add(1) + 1 == num_chunks) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->finished.notify_all();
+            }
+        }
+    };
+
+    size_t helpers = std::min<size_t>(size(), num_chunks - 1);
+    for (size_t i = 0; i < helpers; ++i) {
+        // Helpers only touch fn while chunks remain, and the caller waits
+        // for every chunk, so capturing fn by reference is safe
+        submit(work);
+    }
+    work();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [&] { return state->done == num_chunks; });
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
+
+void ThreadPool::worker_loop() {
+    TRACE_THREAD_NAME("pool worker");
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            condition_.wait(lock,
+                            [this] { return stopping_ || !tasks_.empty(); });
+            if (stopping_ && tasks_.empty()) {
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop();
+        }
+        task();
+    }
+}
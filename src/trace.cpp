@@ -0,0 +1,178 @@
+#include "trace.hpp"
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+TraceRing::TraceRing(std::uint32_t thread_id, std::string thread_name)
+    : events_(CAPACITY), head_(0), thread_id_(thread_id),
+      thread_name_(std::move(thread_name)) {}
+
+void TraceRing::push(const TraceEvent &event) {
+    std::uint64_t head = head_.load(std::memory_order_relaxed);
+    // The writer half of snapshot's seqlock: a reader that sees any of the
+    // new event also sees head_ at least at head
+    std::atomic_thread_fence(std::memory_order_release);
+    events_[head % CAPACITY] = event;
+    head_.store(head + 1, std::memory_order_release);
+}
+
+std::vector<TraceEvent> TraceRing::snapshot() const {
+    std::uint64_t head = head_.load(std::memory_order_acquire);
+    std::uint64_t first = head > CAPACITY ? head - CAPACITY : 0;
+    std::vector<TraceEvent> events;
+    events.reserve(head - first);
+    for (std::uint64_t i = first; i < head; ++i) {
+        events.push_back(events_[i % CAPACITY]);
+    }
+
+    // Slots the owner reached while we copied may hold newer events, and
+    // the slot of event after may be half written by a push in progress;
+    // keep only those that were certainly untouched. The fence orders the
+    // copies above before the second load of head_, as in a seqlock.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    std::uint64_t after = head_.load(std::memory_order_relaxed);
+    std::uint64_t overwritten =
+        after + 1 > CAPACITY ? after + 1 - CAPACITY : 0;
+    if (overwritten > first) {
+        size_t drop = std::min<std::uint64_t>(overwritten - first,
+                                              events.size());
+        events.erase(events.begin(), events.begin() + drop);
+    }
+    return events;
+}
+
+std::uint32_t TraceRing::get_thread_id() const { return thread_id_; }
+
+const std::string &TraceRing::get_thread_name() const { return thread_name_; }
+
+void TraceRing::set_thread_name(std::string name) {
+    thread_name_ = std::move(name);
+}
+
+namespace {
+
+// The calling thread's ring, created on its first recorded span
+thread_local std::shared_ptr<TraceRing> thread_ring;
+thread_local const char *thread_label = nullptr;
+
+} // namespace
+
+Tracer::Tracer()
+    : enabled_(false), epoch_(std::chrono::steady_clock::now()) {}
+
+Tracer &Tracer::instance() {
+    static Tracer tracer;
+    return tracer;
+}
+
+void Tracer::start() { enabled_.store(true, std::memory_order_relaxed); }
+
+void Tracer::stop() { enabled_.store(false, std::memory_order_relaxed); }
+
+bool Tracer::is_enabled() const {
+    return enabled_.load(std::memory_order_relaxed);
+}
+
+std::uint64_t Tracer::now_ns() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - epoch_)
+        .count();
+}
+
+TraceRing &Tracer::ring_for_thread() {
+    // Rings are shared with the registry so they outlive pool threads
+    if (!thread_ring) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::uint32_t id = static_cast<std::uint32_t>(rings_.size()) + 1;
+        thread_ring = std::make_shared<TraceRing>(
+            id, thread_label != nullptr ? std::string(thread_label)
+                                        : "thread " + std::to_string(id));
+        rings_.push_back(thread_ring);
+    }
+    return *thread_ring;
+}
+
+void Tracer::record(const char *name, const char *category,
+                    std::uint64_t start_ns, std::uint64_t items) {
+    ring_for_thread().push(
+        TraceEvent{name, category, start_ns, now_ns() - start_ns, items});
+}
+
+void Tracer::set_thread_name(const char *name) {
+    thread_label = name;
+    if (thread_ring) {
+        std::lock_guard<std::mutex> lock(mutex_); // write() reads the name
+        thread_ring->set_thread_name(name);
+    }
+}
+
+size_t Tracer::write(const std::filesystem::path &path) const {
+    std::ofstream out(path);
+    if (!out) {
+        throw std::runtime_error("Error opening trace file: " +
+                                 path.string());
+    }
+
+    std::vector<std::shared_ptr<TraceRing>> rings;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        rings = rings_;
+    }
+
+    size_t written = 0;
+    bool first = true;
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    char buffer[64];
+    for (const auto &ring : rings) {
+        std::string thread_name;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            thread_name = ring->get_thread_name();
+        }
+        out << (first ? "\n" : ",\n")
+            << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+            << ring->get_thread_id() << ",\"args\":{\"name\":\""
+            << thread_name << "\"}}";
+        first = false;
+
+        for (const TraceEvent &event : ring->snapshot()) {
+            // Microseconds with nanosecond resolution
+            std::snprintf(buffer, sizeof(buffer), "\"ts\":%.3f,\"dur\":%.3f",
+                          event.start_ns / 1e3, event.duration_ns / 1e3);
+            out << ",\n{\"name\":\"" << event.name << "\",\"cat\":\""
+                << event.category << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                << ring->get_thread_id() << "," << buffer;
+            if (event.items > 0) {
+                out << ",\"args\":{\"items\":" << event.items << "}";
+            }
+            out << "}";
+            ++written;
+        }
+    }
+    out << "\n]}\n";
+    if (!out) {
+        throw std::runtime_error("Error writing trace file: " +
+                                 path.string());
+    }
+    return written;
+}
+
+TraceSpan::TraceSpan(const char *name, const char *category,
+                     std::uint64_t items)
+    : name_(name), category_(category), start_ns_(0), items_(items),
+      active_(Tracer::instance().is_enabled()) {
+    if (active_) {
+        start_ns_ = Tracer::instance().now_ns();
+    }
+}
+
+TraceSpan::~TraceSpan() { end(); }
+
+void TraceSpan::end() {
+    if (active_) {
+        active_ = false;
+        Tracer::instance().record(name_, category_, start_ns_, items_);
+    }
+}
+
+void TraceSpan::set_items(std::uint64_t items) { items_ = items; }